@@ -23,24 +23,394 @@
 //--------------------------------------------------------------------------------------------------------------------------------------------------------------
 
 #include "StatefulCanvas.h"
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <vector>
+#include <string>
+#include <chrono>
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+#if defined(__AVX__) // point kernels -- compile time selection, scalar tail and fallback
+#define STATEFUL_CANVAS_AVX
+#include <immintrin.h>
+#endif
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+#define STATEFUL_CANVAS_SSE2
+#include <emmintrin.h>
+#endif
 
 //--------------------------------------------------------------------------------------------------------------------------------------------------------------
 namespace ImGui {
 
 //--------------------------------------------------------------------------------------------------------------------------------------------------------------
-void StatefulCanvas::Points::move(float x, float y) {
-  ImVec2 m(x, y);
+void StatefulCanvas::transformPoints(ImVec2 *out, const ImVec2 *in, int n, float scale, const ImVec2 &offset) {
+  int i = 0;
+#ifdef STATEFUL_CANVAS_AVX
+  __m256 scale8  = _mm256_set1_ps(scale),
+         offset8 = _mm256_setr_ps(offset.x, offset.y, offset.x, offset.y, offset.x, offset.y, offset.x, offset.y);
+
+  for (; i + 4 <= n; i += 4)
+    _mm256_storeu_ps(&out[i].x, _mm256_add_ps(_mm256_mul_ps(_mm256_loadu_ps(&in[i].x), scale8), offset8));
+#endif
+#ifdef STATEFUL_CANVAS_SSE2
+  __m128 scale4  = _mm_set1_ps(scale),
+         offset4 = _mm_setr_ps(offset.x, offset.y, offset.x, offset.y);
+
+  for (; i + 2 <= n; i += 2)
+    _mm_storeu_ps(&out[i].x, _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(&in[i].x), scale4), offset4));
+#endif
+
+  for (; i < n; ++i)
+    out[i] = in[i] * scale + offset;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+void StatefulCanvas::translatePoints(ImVec2 *out, const ImVec2 *in, int n, const ImVec2 &offset) {
+  int i = 0;
+#ifdef STATEFUL_CANVAS_AVX
+  __m256 offset8 = _mm256_setr_ps(offset.x, offset.y, offset.x, offset.y, offset.x, offset.y, offset.x, offset.y);
+
+  for (; i + 4 <= n; i += 4)
+    _mm256_storeu_ps(&out[i].x, _mm256_add_ps(_mm256_loadu_ps(&in[i].x), offset8));
+#endif
+#ifdef STATEFUL_CANVAS_SSE2
+  __m128 offset4 = _mm_setr_ps(offset.x, offset.y, offset.x, offset.y);
+
+  for (; i + 2 <= n; i += 2)
+    _mm_storeu_ps(&out[i].x, _mm_add_ps(_mm_loadu_ps(&in[i].x), offset4));
+#endif
+
+  for (; i < n; ++i)
+    out[i] = in[i] + offset;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+void StatefulCanvas::scalePoints(ImVec2 *out, const ImVec2 *in, int n, float scale) {
+  int i = 0;
+#ifdef STATEFUL_CANVAS_AVX
+  __m256 scale8 = _mm256_set1_ps(scale);
+
+  for (; i + 4 <= n; i += 4)
+    _mm256_storeu_ps(&out[i].x, _mm256_mul_ps(_mm256_loadu_ps(&in[i].x), scale8));
+#endif
+#ifdef STATEFUL_CANVAS_SSE2
+  __m128 scale4 = _mm_set1_ps(scale);
+
+  for (; i + 2 <= n; i += 2)
+    _mm_storeu_ps(&out[i].x, _mm_mul_ps(_mm_loadu_ps(&in[i].x), scale4));
+#endif
+
+  for (; i < n; ++i)
+    out[i] = in[i] * scale;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+void StatefulCanvas::Points::extent(ImRect *rect, float expand) const {
+  *rect = ImRect(ImVec2(FLT_MAX, FLT_MAX), ImVec2(-FLT_MAX, -FLT_MAX));
 
   for (int i = 0; i < points.size(); ++i)
-    points[i] += m;
+    rect->Add(points[i]);
+
+  rect->Expand(expand);
 }
 
 //--------------------------------------------------------------------------------------------------------------------------------------------------------------
-StatefulCanvas::StatefulCanvas(float width, float height) {
-  assert((width > 0) && (height > 0));
+void StatefulCanvas::Points::move(float x, float y) {
+  translatePoints(points.Data, points.Data, points.Size, ImVec2(x, y));
+}
+
+static void *PoolMemAlloc(size_t size, void *) { return ImGui::MemAlloc(size); }
+static void PoolMemFree(void *ptr, void *) { ImGui::MemFree(ptr); }
+
+static std::atomic<ImU64>        Allocations(0); // see countAllocations()
+static StatefulCanvas::AllocFunc CountedAllocFunc;
+static StatefulCanvas::FreeFunc  CountedFreeFunc;
+static void                      *CountedUserData;
+
+static void *CountingMemAlloc(size_t size, void *) {
+  ++Allocations;
+  return CountedAllocFunc ? CountedAllocFunc(size, CountedUserData) : malloc(size);
+}
+
+static void CountingMemFree(void *ptr, void *) {
+  if (CountedFreeFunc)
+    CountedFreeFunc(ptr, CountedUserData);
+  else
+    free(ptr);
+}
+
+static const int ParallelChunkMin = 128;       // primitives per chunk -- smaller flushes are drawn serially
+static const int CircleSegmentMax = 512;       // IM_DRAWLIST_CIRCLE_AUTO_SEGMENT_MAX -- automatic circle segment counts stay below it
+static const int BezierPointsMax  = 1026;      // adaptive bezier subdivision depth 10, end points included
+static const int RoundedPointsMax = 16;        // rounded rect path -- four corner arcs of PathArcToFast()
+static const int IngestBatchMin   = 16;        // items per IngestFunc call -- bounds how far a batch can overrun the budget
+static const int IngestBatchMax   = 65536;
+static const int CompactMinSlots  = 1024;      // autoCompact() leaves smaller canvases alone
+static const int StringsPackMin   = 64 * 1024; // dead string bytes before packStrings() is worth a pass over the slots
+static const int QueueReserveMin  = 64;        // handles reserved for queued adds from the start -- grown to twice a frame's queued adds that ran out
+static const int CommandNodeSize  = 128;       // bytes per pooled command, header included -- larger commands come from operator new
+static const int CommandNodeAlign = 16;        // header size, keeping the command after it aligned
+static const int CommandNodeBlock = 64;        // nodes allocated together when a producer's pool runs dry
+static const int StreamSlackMax   = 1 << 24;   // ring points a snapshot may reserve beyond those it holds -- bounds what a corrupt capacity allocates
+
+static std::atomic<ImU64> QueueIds(0); // never reused, so a destroyed canvas's queue can't match a thread's cached producer
+
+static const size_t PrimitiveSizes[StatefulCanvas::PrimitiveType_Custom] = { // indexed by PrimitiveType
+  sizeof(StatefulCanvas::Line), sizeof(StatefulCanvas::Rect), sizeof(StatefulCanvas::RectFilled), sizeof(StatefulCanvas::RectFilledMultiColor),
+  sizeof(StatefulCanvas::Quad), sizeof(StatefulCanvas::QuadFilled), sizeof(StatefulCanvas::Triangle), sizeof(StatefulCanvas::TriangleFilled),
+  sizeof(StatefulCanvas::Circle), sizeof(StatefulCanvas::CircleFilled), sizeof(StatefulCanvas::Ngon), sizeof(StatefulCanvas::NgonFilled),
+  sizeof(StatefulCanvas::Text), sizeof(StatefulCanvas::Text2), sizeof(StatefulCanvas::Polyline), sizeof(StatefulCanvas::ConvexPolyFilled),
+  sizeof(StatefulCanvas::BezierCurve), sizeof(StatefulCanvas::Image), sizeof(StatefulCanvas::ImageQuad), sizeof(StatefulCanvas::ImageRounded),
+  sizeof(StatefulCanvas::StreamingPolyline)
+};
+
+#ifdef STATEFUL_CANVAS_STATS
+#define STATS_ONLY(...) __VA_ARGS__
+
+static thread_local StatefulCanvas::Stats *StatsTarget; // drawing canvas's stats, or a parallel chunk's on pool threads
+
+static double StatsNow() {
+  return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static void StatsDrawn(StatefulCanvas::Stats &stats, int type, const ImDrawList *drawList, int vtxStart, int idxStart, double start) {
+  StatefulCanvas::Stats::Type &t = stats.types[ImMin(type, (int)StatefulCanvas::PrimitiveType_Custom)]; // registered types count as Custom
+  ++t.drawn;
+  ++stats.drawn;
+  t.vertices += drawList->VtxBuffer.Size - vtxStart;
+  t.indices  += drawList->IdxBuffer.Size - idxStart;
+  t.ms       += (float)(StatsNow() - start);
+}
+
+static float StatsLayerMs(void *data, int l) { // PlotHistogram() values getter over Stats::layers
+  return (*(const ImVector<StatefulCanvas::Stats::Layer> *)data)[l].ms;
+}
+
+static void StatsLayer(StatefulCanvas::Stats &stats, int z, int drawnStart, double start) {
+  stats.layers.push_back({z, stats.drawn - drawnStart, (float)(StatsNow() - start)});
+  ++stats.zLayers;
+}
+
+StatefulCanvas::Stats *StatefulCanvas::statsTarget() { return StatsTarget; } // for drawBatch(), which lives in the header
+double StatefulCanvas::statsNow() { return StatsNow(); }
+void StatefulCanvas::statsDrawn(int type, const ImDrawList *drawList, int vtxStart, int idxStart, double start) {
+  StatsDrawn(*StatsTarget, type, drawList, vtxStart, idxStart, start);
+}
+#else
+#define STATS_ONLY(...)
+#endif
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+struct StatefulCanvas::Workers { // pool threads and the drawing thread claim chunks_ until none are left
+  const StatefulCanvas     *canvas;
+  std::vector<std::thread> threads;
+  std::mutex               mutex;
+  std::condition_variable  start,
+                           finish;
+  unsigned int             job;  // bumped to start a job
+  int                      busy; // pool threads still on job
+  bool                     quit;
+  std::atomic<int>         next; // chunk to claim
+  int                      nChunks;
+  ImVec2                   loc;
+  ImVec4                   clipRect; // state of window draw list, reproduced in each chunk's
+  int                      vertices, // largest chunk's output so far -- chunk draw lists are presized to it, so workers needn't grow them
+                           indices,
+                           cmds,
+                           points;   // largest TessellationBound() so far
+};
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+struct StatefulCanvas::Queue { // commands pushed by any thread, taken by applyQueue() in one exchange -- handles come from a window of reserved slots
+  struct Window {
+    std::atomic<int> first,
+                     count,
+                     generation;
+  };
+  struct Producer { // command nodes of one thread -- only it takes them, applyQueue() hands them back through returned
+    Producer              *next;
+    std::thread::id       thread;
+    void                  *free;     // owner only
+    std::atomic<void *>   returned;  // freed by applyQueue(), taken all at once by owner when free runs out
+    std::vector<void *>   blocks;    // std::vector, as ImGui::MemAlloc() updates context metrics unsynchronized
+  };
+  struct Cached {
+    ImU64    queue;
+    Producer *producer;
+  };
+  std::atomic<Command *> head;   // most recent first
+  std::atomic<ImU64>     state;  // window epoch in upper 32 bits (its low bit selects windows[]), handles taken in lower 32 bits
+  Window                 windows[2];
+  int                    reserve;
+  std::atomic<int>       misses; // queued adds the window couldn't serve since last refillReserve()
+  ImU64                  id;
+  std::mutex             mutex;  // producers list -- taken by a thread's first command only
+  Producer               *producers;
+};
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+struct StatefulCanvas::QueuedChange : Command { // static helpers apply each kind
+  static void applyCustom(StatefulCanvas *canvas, Command *command);
+  static void applyErase(StatefulCanvas *canvas, Command *command);
+  static void applyVisible(StatefulCanvas *canvas, Command *command);
+  static void applySetZ(StatefulCanvas *canvas, Command *command);
+  static void applyMoveTo(StatefulCanvas *canvas, Command *command);
+
+  Primitive *primitive; // queueCustom()
+  float     x, y;       // queueMoveTo()
+  bool      state;      // queueVisible()
+};
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+struct StatefulCanvas::QueuedText : Command {
+  QueuedText(const ImVec2 &pos, ImU32 color, std::string &&string) : pos(pos), color(color), string(std::move(string)) { }
+  static void apply(StatefulCanvas *canvas, Command *command);
+
+  ImVec2      pos;
+  ImU32       color;
+  std::string string; // ImGui::MemAlloc() would update context metrics unsynchronized
+};
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+struct StatefulCanvas::QueuedPolyline : Command {
+  QueuedPolyline(std::vector<ImVec2> &&points, ImU32 color, bool closed, float thickness) :
+    points(std::move(points)), color(color), closed(closed), thickness(thickness) { }
+  static void apply(StatefulCanvas *canvas, Command *command);
+
+  std::vector<ImVec2> points; // as QueuedText::string
+  ImU32               color;
+  bool                closed;
+  float               thickness;
+};
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+struct StatefulCanvas::LinesInit {
+  void operator()(Line *line, int i) const {
+    line->p0        = p0s[i];
+    line->p1        = p1s[i];
+    line->color     = colors[i];
+    line->thickness = thickness;
+  }
+
+  const ImVec2 *p0s,
+               *p1s;
+  const ImU32  *colors;
+  float        thickness;
+};
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+struct StatefulCanvas::RectsFilledInit {
+  void operator()(RectFilled *rect, int i) const {
+    rect->p0          = mins[i];
+    rect->p1          = maxs[i];
+    rect->color       = colors[i];
+    rect->rounding    = rounding;
+    rect->cornerFlags = roundingCorners;
+  }
+
+  const ImVec2      *mins,
+                    *maxs;
+  const ImU32       *colors;
+  float             rounding;
+  ImDrawCornerFlags roundingCorners;
+};
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+struct StatefulCanvas::CirclesInit {
+  void operator()(Circle *circle, int i) const {
+    circle->center    = centers[i];
+    circle->radius    = radii[i];
+    circle->color     = colors[i];
+    circle->segments  = nSegments;
+    circle->thickness = thickness;
+  }
+
+  const ImVec2 *centers;
+  const float  *radii;
+  const ImU32  *colors;
+  int          nSegments;
+  float        thickness;
+};
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+struct StatefulCanvas::TextsInit {
+  void operator()(Text *text, int i) const {
+    text->p         = positions[i];
+    text->color     = colors[i];
+    text->string    = canvas->storeString(strings[i], nullptr);
+    text->stringEnd = text->string + strlen(strings[i]);
+  }
+
+  StatefulCanvas    *canvas; // owns the string arena
+  const ImVec2      *positions;
+  const ImU32       *colors;
+  const char *const *strings;
+};
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+struct StatefulCanvas::LineInit {
+  void operator()(Line *line) const {
+    line->p0        = p0;
+    line->p1        = p1;
+    line->color     = color;
+    line->thickness = thickness;
+  }
+
+  ImVec2 p0,
+         p1;
+  ImU32  color;
+  float  thickness;
+};
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+struct StatefulCanvas::RectFilledInit {
+  void operator()(RectFilled *rect) const {
+    rect->p0          = min;
+    rect->p1          = max;
+    rect->color       = color;
+    rect->rounding    = 0.0f;
+    rect->cornerFlags = ImDrawCornerFlags_All;
+  }
+
+  ImVec2 min,
+         max;
+  ImU32  color;
+};
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+struct StatefulCanvas::CircleInit {
+  void operator()(Circle *circle) const {
+    circle->center    = center;
+    circle->radius    = radius;
+    circle->color     = color;
+    circle->segments  = nSegments;
+    circle->thickness = thickness;
+  }
+
+  ImVec2 center;
+  float  radius;
+  ImU32  color;
+  int    nSegments;
+  float  thickness;
+};
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+StatefulCanvas::StatefulCanvas(float width, float height) : StatefulCanvas(0, 0, width, height) {
   useCursorPosition_ = true;
-  location_          = {0, 0};
-  size_              = {width, height};
 }
 
 //--------------------------------------------------------------------------------------------------------------------------------------------------------------
@@ -48,12 +418,170 @@ StatefulCanvas::StatefulCanvas(float x, float y, float width, float height) {
   assert((width > 0) && (height > 0));
   useCursorPosition_ = false;
   location_          = {x, y};
+  drawLocation_      = {x, y};
   size_              = {width, height};
+  orderMin_          = 0;
+  orderMax_          = 0;
+  freeSlot_          = -1;
+  slotsUsed_         = 0;
+  slotGeneration_    = 0;
+  compactRatio_      = 0.0f;
+  compactedHoles_    = 0;
+  ownsMemory_        = 0;
+  allocFunc_         = PoolMemAlloc;
+  freeFunc_          = PoolMemFree;
+  allocUserData_     = nullptr;
+  saveCustom_        = nullptr;
+  loadCustom_        = nullptr;
+  snapshotUserData_  = nullptr;
+  batchByType_       = false;
+  sortByState_       = false;
+  spatialIndex_      = false;
+  cellSize_          = 128.0f;
+  mark_              = 0;
+  culling_           = false;
+  cacheGeometry_     = false;
+  cacheDrawList_     = nullptr;
+  cacheFlags_        = 0;
+  cacheFontTexture_  = nullptr;
+  buildingRuns_      = false;
+  displacedStale_    = false;
+  threads_           = 1;
+  workers_           = nullptr;
+  deferTarget_       = nullptr;
+  ingestBudget_      = 2.0f;
+  ingestItems_       = 0;
+  ingestDone_        = 0;
+  ingestNs_          = 1000.0f; // until measured
+  queue_             = IM_NEW(Queue)();
+  queue_->head       = nullptr;
+  queue_->state      = 0;
+  queue_->reserve    = QueueReserveMin; // or queueReserve()
+  queue_->misses     = 0;
+  queue_->id         = ++QueueIds;
+  queue_->producers  = nullptr;
+
+  for (int w = 0; w < 2; ++w) {
+    queue_->windows[w].first      = 0;
+    queue_->windows[w].count      = 0;
+    queue_->windows[w].generation = 0;
+  }
+
+  freeGroup_         = -1;
+  groupsDirty_       = false;
+  groupsDisplaced_   = false;
+  groupMark_         = 0;
+  drawCmds_          = 0;
+  stateChanges_      = 0;
+  lastClipRect_      = -2;
+  lastVertices_      = 0;
+  lastIndices_       = 0;
+  lastTexture_       = nullptr;
+
+  Group root;
+  root.parent          = -1;
+  root.children        = 0;
+  root.offsetZ         = 0;
+  root.offset          = ImVec2(0, 0);
+  root.dragOffset      = ImVec2(0, 0);
+  root.visible         = true;
+  root.live            = true;
+  root.composedZ       = 0;
+  root.composedVisible = true;
+  root.mark            = 0;
+  root.indexed         = 0;
+  groups_.push_back(std::move(root));
+  groupOffsets_.push_back(ImVec2(0, 0));
+  grids_.resize(1);
+
+  for (int i = 0; i < PrimitiveType_MAX; ++i) {
+    Pool &pool      = pools_[i];
+    pool.objectSize = 0;
+    pool.block      = 0;
+    pool.used       = 0;
+    pool.freeList   = nullptr;
+  }
+
+  for (int i = 0; i < PrimitiveType_MAX - PrimitiveType_COUNT; ++i) {
+    registered_[i] = nullptr;
+    relocators_[i] = nullptr;
+    movers_[i]     = nullptr;
+    typeIds_[i]    = 0;
+  }
+
+  strings_.block = 0;
+  strings_.used  = 0;
+  strings_.bytes = 0;
+  strings_.dead  = 0;
+  refillReserve(); // queued adds get handles from the start
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+StatefulCanvas::~StatefulCanvas() {
+  Command *command = queue_->head.exchange(nullptr, std::memory_order_acquire);
+
+  while (command) { // freed unapplied -- custom primitives were handed over with them
+    Command *next = command->next;
+
+    if (command->apply == QueuedChange::applyCustom)
+      delete static_cast<QueuedChange *>(command)->primitive;
+
+    freeCommand(command);
+    command = next;
+  }
+
+  clear();
+
+  while (Queue::Producer *producer = queue_->producers) {
+    queue_->producers = producer->next;
+
+    for (size_t b = 0; b < producer->blocks.size(); ++b)
+      ::operator delete(producer->blocks[b]);
+
+    delete producer;
+  }
+
+  IM_DELETE(queue_);
+  IM_DELETE(cacheDrawList_);
+  stopWorkers();
+
+  for (int i = 0; i < PrimitiveType_MAX; ++i)
+    for (int b = 0; b < pools_[i].blocks.size(); ++b)
+      freeFunc_(pools_[i].blocks[b], allocUserData_);
+
+  for (int b = 0; b < strings_.blocks.size(); ++b)
+    freeFunc_(strings_.blocks[b], allocUserData_);
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+void StatefulCanvas::setAllocatorFunctions(AllocFunc allocFunc, FreeFunc freeFunc, void *userData) {
+  for (int i = 0; i < PrimitiveType_MAX; ++i)
+    assert(pools_[i].blocks.size() == 0);
+
+  assert(strings_.blocks.size() == 0);
+  allocFunc_     = allocFunc;
+  freeFunc_      = freeFunc;
+  allocUserData_ = userData;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+void StatefulCanvas::countAllocations(AllocFunc allocFunc, FreeFunc freeFunc, void *userData) { // ImGui's functions until now, if set
+  assert(!allocFunc == !freeFunc);
+  Allocations      = 0;
+  CountedAllocFunc = allocFunc;
+  CountedFreeFunc  = freeFunc;
+  CountedUserData  = userData;
+  ImGui::SetAllocatorFunctions(CountingMemAlloc, CountingMemFree);
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+ImU64 StatefulCanvas::allocations() {
+  return Allocations;
 }
 
 //--------------------------------------------------------------------------------------------------------------------------------------------------------------
 StatefulCanvas::draw_idx_t StatefulCanvas::line(const ImVec2 &p0, const ImVec2 &p1, ImU32 color, float thickness) {
-  Line *line      = new Line;
+  Line *line      = allocate<Line>(PrimitiveType_Line);
   line->z         = z();
   line->p0        = p0;
   line->p1        = p1;
@@ -65,7 +593,7 @@ StatefulCanvas::draw_idx_t StatefulCanvas::line(const ImVec2 &p0, const ImVec2 &
 //--------------------------------------------------------------------------------------------------------------------------------------------------------------
 StatefulCanvas::draw_idx_t StatefulCanvas::rect(const ImVec2 &min, const ImVec2 &max, ImU32 color, float rounding, ImDrawCornerFlags roundingCorners,
                                                 float thickness) {
-  Rect *rect        = new Rect;
+  Rect *rect        = allocate<Rect>(PrimitiveType_Rect);
   rect->z           = z();
   rect->p0          = min;
   rect->p1          = max;
@@ -79,7 +607,7 @@ StatefulCanvas::draw_idx_t StatefulCanvas::rect(const ImVec2 &min, const ImVec2
 //--------------------------------------------------------------------------------------------------------------------------------------------------------------
 StatefulCanvas::draw_idx_t StatefulCanvas::rectFilled(const ImVec2 &min, const ImVec2 &max, ImU32 color, float rounding,
                                                       ImDrawCornerFlags roundingCorners) {
-  RectFilled *rect  = new RectFilled;
+  RectFilled *rect  = allocate<RectFilled>(PrimitiveType_RectFilled);
   rect->z           = z();
   rect->p0          = min;
   rect->p1          = max;
@@ -92,7 +620,7 @@ StatefulCanvas::draw_idx_t StatefulCanvas::rectFilled(const ImVec2 &min, const I
 //--------------------------------------------------------------------------------------------------------------------------------------------------------------
 StatefulCanvas::draw_idx_t StatefulCanvas::rectFilledMultiColor(const ImVec2 &min, const ImVec2 &max,
                                                                 ImU32 colorUpperLeft, ImU32 colorUpperRight, ImU32 colorBottomRight, ImU32 colorBottomLeft) {
-  RectFilledMultiColor *rect = new RectFilledMultiColor;
+  RectFilledMultiColor *rect = allocate<RectFilledMultiColor>(PrimitiveType_RectFilledMultiColor);
   rect->z                    = z();
   rect->p0                   = min;
   rect->p1                   = max;
@@ -105,7 +633,7 @@ StatefulCanvas::draw_idx_t StatefulCanvas::rectFilledMultiColor(const ImVec2 &mi
 
 //--------------------------------------------------------------------------------------------------------------------------------------------------------------
 StatefulCanvas::draw_idx_t StatefulCanvas::quad(const ImVec2 &p0, const ImVec2 &p1, const ImVec2 &p2, const ImVec2 &p3, ImU32 color, float thickness) {
-  Quad *quad      = new Quad;
+  Quad *quad      = allocate<Quad>(PrimitiveType_Quad);
   quad->z         = z();
   quad->p0        = p0;
   quad->p1        = p1;
@@ -118,7 +646,7 @@ StatefulCanvas::draw_idx_t StatefulCanvas::quad(const ImVec2 &p0, const ImVec2 &
 
 //--------------------------------------------------------------------------------------------------------------------------------------------------------------
 StatefulCanvas::draw_idx_t StatefulCanvas::quadFilled(const ImVec2 &p0, const ImVec2 &p1, const ImVec2 &p2, const ImVec2 &p3, ImU32 color) {
-  QuadFilled *quad = new QuadFilled;
+  QuadFilled *quad = allocate<QuadFilled>(PrimitiveType_QuadFilled);
   quad->z          = z();
   quad->p0         = p0;
   quad->p1         = p1;
@@ -130,7 +658,7 @@ StatefulCanvas::draw_idx_t StatefulCanvas::quadFilled(const ImVec2 &p0, const Im
 
 //--------------------------------------------------------------------------------------------------------------------------------------------------------------
 StatefulCanvas::draw_idx_t StatefulCanvas::triangle(const ImVec2 &p0, const ImVec2 &p1, const ImVec2 &p2, ImU32 color, float thickness) {
-  Triangle *tri  = new Triangle;
+  Triangle *tri  = allocate<Triangle>(PrimitiveType_Triangle);
   tri->z         = z();
   tri->p0        = p0;
   tri->p1        = p1;
@@ -142,7 +670,7 @@ StatefulCanvas::draw_idx_t StatefulCanvas::triangle(const ImVec2 &p0, const ImVe
 
 //--------------------------------------------------------------------------------------------------------------------------------------------------------------
 StatefulCanvas::draw_idx_t StatefulCanvas::triangleFilled(const ImVec2 &p0, const ImVec2 &p1, const ImVec2 &p2, ImU32 color) {
-  TriangleFilled *tri = new TriangleFilled;
+  TriangleFilled *tri = allocate<TriangleFilled>(PrimitiveType_TriangleFilled);
   tri->z              = z();
   tri->p0             = p0;
   tri->p1             = p1;
@@ -153,7 +681,7 @@ StatefulCanvas::draw_idx_t StatefulCanvas::triangleFilled(const ImVec2 &p0, cons
 
 //--------------------------------------------------------------------------------------------------------------------------------------------------------------
 StatefulCanvas::draw_idx_t StatefulCanvas::circle(const ImVec2 &center, float radius, ImU32 color, int nSegments, float thickness) {
-  Circle *circle    = new Circle;
+  Circle *circle    = allocate<Circle>(PrimitiveType_Circle);
   circle->z         = z();
   circle->center    = center;
   circle->radius    = radius;
@@ -165,7 +693,7 @@ StatefulCanvas::draw_idx_t StatefulCanvas::circle(const ImVec2 &center, float ra
 
 //--------------------------------------------------------------------------------------------------------------------------------------------------------------
 StatefulCanvas::draw_idx_t StatefulCanvas::circleFilled(const ImVec2 &center, float radius, ImU32 color, int nSegments) {
-  CircleFilled *circle = new CircleFilled;
+  CircleFilled *circle = allocate<CircleFilled>(PrimitiveType_CircleFilled);
   circle->z            = z();
   circle->center       = center;
   circle->radius       = radius;
@@ -176,7 +704,7 @@ StatefulCanvas::draw_idx_t StatefulCanvas::circleFilled(const ImVec2 &center, fl
 
 //--------------------------------------------------------------------------------------------------------------------------------------------------------------
 StatefulCanvas::draw_idx_t StatefulCanvas::ngon(const ImVec2 &center, float radius, ImU32 color, int nSegments, float thickness) {
-  Ngon *ngon      = new Ngon;
+  Ngon *ngon      = allocate<Ngon>(PrimitiveType_Ngon);
   ngon->z         = z();
   ngon->center    = center;
   ngon->radius    = radius;
@@ -188,7 +716,7 @@ StatefulCanvas::draw_idx_t StatefulCanvas::ngon(const ImVec2 &center, float radi
 
 //--------------------------------------------------------------------------------------------------------------------------------------------------------------
 StatefulCanvas::draw_idx_t StatefulCanvas::ngonFilled(const ImVec2 &center, float radius, ImU32 color, int nSegments) {
-  NgonFilled *ngon = new NgonFilled;
+  NgonFilled *ngon = allocate<NgonFilled>(PrimitiveType_NgonFilled);
   ngon->z          = z();
   ngon->center     = center;
   ngon->radius     = radius;
@@ -199,22 +727,24 @@ StatefulCanvas::draw_idx_t StatefulCanvas::ngonFilled(const ImVec2 &center, floa
 
 //--------------------------------------------------------------------------------------------------------------------------------------------------------------
 StatefulCanvas::draw_idx_t StatefulCanvas::text(const ImVec2 &pos, ImU32 color, const char *textBegin, const char *textEnd) {
-  Text *text   = new Text;
-  text->z      = z();
-  text->p      = pos;
-  text->color  = color;
-  text->string = textEnd ? std::string(textBegin, textEnd - textBegin) : std::string(textBegin);
+  Text *text      = allocate<Text>(PrimitiveType_Text);
+  text->z         = z();
+  text->p         = pos;
+  text->color     = color;
+  text->string    = storeString(textBegin, textEnd);
+  text->stringEnd = text->string + (textEnd ? textEnd - textBegin : strlen(textBegin));
   return addToDrawList(text);
 }
 
 //--------------------------------------------------------------------------------------------------------------------------------------------------------------
 StatefulCanvas::draw_idx_t StatefulCanvas::text(const ImFont *font, float fontSize, const ImVec2 &pos, ImU32 color,
                                                 const char *textBegin, const char *textEnd, float wrapWidth, const ImVec4 *cpuFineClipRect) {
-  Text2 *text           = new Text2;
+  Text2 *text           = allocate<Text2>(PrimitiveType_Text2);
   text->z               = z();
   text->p               = pos;
   text->color           = color;
-  text->string          = textEnd ? std::string(textBegin, textEnd - textBegin) : textBegin;
+  text->string          = storeString(textBegin, textEnd);
+  text->stringEnd       = text->string + (textEnd ? textEnd - textBegin : strlen(textBegin));
   text->font            = font;
   text->fontSize        = fontSize;
   text->wrapWidth       = wrapWidth;
@@ -222,36 +752,64 @@ StatefulCanvas::draw_idx_t StatefulCanvas::text(const ImFont *font, float fontSi
   return addToDrawList(text);
 }
 
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+StatefulCanvas::draw_idx_t StatefulCanvas::text(const ImVec2 &pos, ImU32 color, std::string_view string) {
+  const char *textBegin = string.empty() ? "" : string.data();
+  return text(pos, color, textBegin, textBegin + string.size());
+}
+
 //--------------------------------------------------------------------------------------------------------------------------------------------------------------
 StatefulCanvas::draw_idx_t StatefulCanvas::polyline(const ImVec2 *points, int nPoints, ImU32 color, bool closed, float thickness) {
-  Polyline *poly  = new Polyline(nPoints);
+  Polyline *poly  = allocate<Polyline>(PrimitiveType_Polyline);
   poly->z         = z();
   poly->color     = color;
   poly->thickness = thickness;
   poly->closed    = closed;
+  poly->points.resize(nPoints);
 
-  for (int i = 0; i < nPoints; ++i)
-    poly->points.push_back(points[i]);
+  if (nPoints > 0)
+    memcpy(poly->points.Data, points, nPoints * sizeof(ImVec2));
+
+  return addToDrawList(poly);
+}
 
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+StatefulCanvas::draw_idx_t StatefulCanvas::polyline(ImVector<ImVec2> &&points, ImU32 color, bool closed, float thickness) {
+  Polyline *poly  = allocate<Polyline>(PrimitiveType_Polyline);
+  poly->z         = z();
+  poly->color     = color;
+  poly->thickness = thickness;
+  poly->closed    = closed;
+  poly->points.swap(points);
   return addToDrawList(poly);
 }
 
 //--------------------------------------------------------------------------------------------------------------------------------------------------------------
 StatefulCanvas::draw_idx_t StatefulCanvas::convexPolyFilled(const ImVec2 *points, int nPoints, ImU32 color) {
-  ConvexPolyFilled *poly = new ConvexPolyFilled(nPoints);
+  ConvexPolyFilled *poly = allocate<ConvexPolyFilled>(PrimitiveType_ConvexPolyFilled);
   poly->z                = z();
   poly->color            = color;
+  poly->points.resize(nPoints);
 
-  for (int i = 0; i < nPoints; ++i)
-    poly->points.push_back(points[i]);
+  if (nPoints > 0)
+    memcpy(poly->points.Data, points, nPoints * sizeof(ImVec2));
+
+  return addToDrawList(poly);
+}
 
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+StatefulCanvas::draw_idx_t StatefulCanvas::convexPolyFilled(ImVector<ImVec2> &&points, ImU32 color) {
+  ConvexPolyFilled *poly = allocate<ConvexPolyFilled>(PrimitiveType_ConvexPolyFilled);
+  poly->z                = z();
+  poly->color            = color;
+  poly->points.swap(points);
   return addToDrawList(poly);
 }
 
 //--------------------------------------------------------------------------------------------------------------------------------------------------------------
 StatefulCanvas::draw_idx_t StatefulCanvas::bezierCurve(const ImVec2 &p0, const ImVec2 &p1, const ImVec2 &p2, const ImVec2 &p3, ImU32 color, float thickness,
                                                        int nSegments) {
-  BezierCurve *bezier = new BezierCurve;
+  BezierCurve *bezier = allocate<BezierCurve>(PrimitiveType_BezierCurve);
   bezier->z           = z();
   bezier->p0          = p0;
   bezier->p1          = p1;
@@ -266,7 +824,7 @@ StatefulCanvas::draw_idx_t StatefulCanvas::bezierCurve(const ImVec2 &p0, const I
 //--------------------------------------------------------------------------------------------------------------------------------------------------------------
 StatefulCanvas::draw_idx_t StatefulCanvas::image(ImTextureID textureId, const ImVec2 &min, const ImVec2 &max, const ImVec2 &uvMin,
                                                  const ImVec2 &uvMax, ImU32 color) {
-  Image *image     = new Image;
+  Image *image     = allocate<Image>(PrimitiveType_Image);
   image->z         = z();
   image->textureId = textureId;
   image->p0        = min;
@@ -280,7 +838,7 @@ StatefulCanvas::draw_idx_t StatefulCanvas::image(ImTextureID textureId, const Im
 //--------------------------------------------------------------------------------------------------------------------------------------------------------------
 StatefulCanvas::draw_idx_t StatefulCanvas::imageQuad(ImTextureID textureId, const ImVec2 &p0, const ImVec2 &p1, const ImVec2 &p2, const ImVec2 &p3,
                                                      const ImVec2 &uv0, const ImVec2 &uv1, const ImVec2 &uv2, const ImVec2 &uv3, ImU32 color) {
-  ImageQuad *image = new ImageQuad;
+  ImageQuad *image = allocate<ImageQuad>(PrimitiveType_ImageQuad);
   image->z         = z();
   image->textureId = textureId;
   image->p0        = p0;
@@ -299,7 +857,7 @@ StatefulCanvas::draw_idx_t StatefulCanvas::imageQuad(ImTextureID textureId, cons
 StatefulCanvas::draw_idx_t StatefulCanvas::imageRounded(ImTextureID textureId, const ImVec2 &min, const ImVec2 &max,
                                                         const ImVec2 &uvMin, const ImVec2 &uvMax, ImU32 color, float rounding,
                                                         ImDrawCornerFlags roundingCorners) {
-  ImageRounded *image = new ImageRounded;
+  ImageRounded *image = allocate<ImageRounded>(PrimitiveType_ImageRounded);
   image->z            = z();
   image->textureId    = textureId;
   image->p0           = min;
@@ -312,6 +870,30 @@ StatefulCanvas::draw_idx_t StatefulCanvas::imageRounded(ImTextureID textureId, c
   return addToDrawList(image);
 }
 
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+StatefulCanvas::draw_idx_t StatefulCanvas::streamingPolyline(int capacity, ImU32 color, float thickness) {
+  assert(capacity > 0);
+  StreamingPolyline *stream = allocate<StreamingPolyline>(PrimitiveType_StreamingPolyline);
+  stream->z                 = z();
+  stream->color             = color;
+  stream->thickness         = thickness;
+  stream->origin            = ImVec2(0, 0);
+  stream->ring.resize(capacity);
+  stream->span(stream->ring.Data, capacity, 0, 0);
+  return addToDrawList(stream);
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+StatefulCanvas::draw_idx_t StatefulCanvas::streamingPolyline(const ImVec2 *points, int capacity, int head, int count, ImU32 color, float thickness) {
+  StreamingPolyline *stream = allocate<StreamingPolyline>(PrimitiveType_StreamingPolyline);
+  stream->z                 = z();
+  stream->color             = color;
+  stream->thickness         = thickness;
+  stream->origin            = ImVec2(0, 0);
+  stream->span(points, capacity, head, count);
+  return addToDrawList(stream);
+}
+
 //--------------------------------------------------------------------------------------------------------------------------------------------------------------
 StatefulCanvas::draw_idx_t StatefulCanvas::custom(Primitive *c) {
   c->z = z();
@@ -319,289 +901,4326 @@ StatefulCanvas::draw_idx_t StatefulCanvas::custom(Primitive *c) {
 }
 
 //--------------------------------------------------------------------------------------------------------------------------------------------------------------
-bool StatefulCanvas::visible(draw_idx_t idx) const {
-  assert((idx >= 0) && (idx < drawList_.size()));
-  Primitive *item = drawList_[idx];
-  assert(item);
-  return item->visible;
+void StatefulCanvas::reserve(int n, PrimitiveType type) {
+  assert(n >= 0);
+  drawList_.reserve(slotsUsed_ + n);
+  ZLayer &layer = zLayer(z());
+  layer.raised.reserve(layer.raised.size() + n);
+
+  assert((type <= PrimitiveType_Custom) || registered_[type - PrimitiveType_COUNT]);
+
+  if (type != PrimitiveType_Custom)
+    poolReserve(type, (type < PrimitiveType_Custom) ? PrimitiveSizes[type] : (size_t)pools_[type].objectSize, n);
 }
 
 //--------------------------------------------------------------------------------------------------------------------------------------------------------------
-void StatefulCanvas::visible(draw_idx_t idx, bool state) {
-  assert((idx >= 0) && (idx < drawList_.size()));
-  Primitive *item = drawList_[idx];
-  assert(item);
-  item->visible = state;
+StatefulCanvas::DrawIdxRange StatefulCanvas::lines(const ImVec2 *p0s, const ImVec2 *p1s, const ImU32 *colors, int n, float thickness) {
+  return addRangeToDrawList<Line>(PrimitiveType_Line, n, LinesInit{p0s, p1s, colors, thickness});
 }
 
 //--------------------------------------------------------------------------------------------------------------------------------------------------------------
-void StatefulCanvas::draw(const char *label, bool clip) const {
-  if (drawList_.size() == 0)
-    return;
+StatefulCanvas::DrawIdxRange StatefulCanvas::rectsFilled(const ImVec2 *mins, const ImVec2 *maxs, const ImU32 *colors, int n, float rounding,
+                                                        ImDrawCornerFlags roundingCorners) {
+  return addRangeToDrawList<RectFilled>(PrimitiveType_RectFilled, n, RectsFilledInit{mins, maxs, colors, rounding, roundingCorners});
+}
 
-  ImGuiWindow *window = ImGui::GetCurrentWindow();
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+StatefulCanvas::DrawIdxRange StatefulCanvas::circles(const ImVec2 *centers, const float *radii, const ImU32 *colors, int n, int nSegments,
+                                                    float thickness) {
+  return addRangeToDrawList<Circle>(PrimitiveType_Circle, n, CirclesInit{centers, radii, colors, nSegments, thickness});
+}
 
-  if (window->SkipItems)
-    return;
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+StatefulCanvas::DrawIdxRange StatefulCanvas::texts(const ImVec2 *positions, const ImU32 *colors, const char *const *strings, int n) {
+  return addRangeToDrawList<Text>(PrimitiveType_Text, n, TextsInit{this, positions, colors, strings});
+}
 
-  ImVec2 loc;
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+bool StatefulCanvas::valid(draw_idx_t idx) const {
+  return findSlot(idx) != nullptr;
+}
 
-  if (useCursorPosition_)
-    loc = window->DC.CursorPos;
-  else
-    loc = location_;
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+bool StatefulCanvas::visible(draw_idx_t idx) const {
+  const Slot *slot = findSlot(idx);
+  return slot && slot->primitive->visible;
+}
 
-  ImDrawList *drawList = ImGui::GetWindowDrawList();
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+void StatefulCanvas::visible(draw_idx_t idx, bool state) {
+  Slot *slot = findSlot(idx);
 
-  if (clip)
-    drawList->PushClipRect(loc, loc + size_);
+  if (slot && (slot->primitive->visible != state)) {
+    slot->primitive->visible = state;
+    dirtyDrawnZ(*slot);
+  }
+}
 
-  int min = INT_MAX,
-      max = INT_MIN;
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+int StatefulCanvas::z(draw_idx_t idx) const {
+  const Slot *slot = findSlot(idx);
+  assert(slot);
+  return slot->z;
+}
 
-  for (int i = 0; i < drawList_.size(); ++i) { // find zMin and zMax
-    Primitive *primitive = drawList_[i];
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+void StatefulCanvas::setZ(draw_idx_t idx, int z) {
+  Slot *slot = findSlot(idx);
+  assert(slot);
 
-    if (primitive) {
-      int z = primitive->z + primitive->offsetZ;
+  if (slot->z == z)
+    return;
 
-      if (z < min)
-        min = z;
+  int oldZ           = slot->z;
+  slot->primitive->z = z;
+  slot->z            = z;
+  slot->order        = ++orderMax_; // invalidates old z layer entry
+  displacedStale_    = displacedStale_ || groupsDisplaced_;
+  unindexZ(oldZ);
+  ZLayer &layer = zLayer(z);
+  layer.dirty   = true;
+  layer.raised.push_back({slotIndex(idx), slot->order});
+  ++layer.live;
+}
 
-      if (z > max)
-        max = z;
-    }
-  }
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+void StatefulCanvas::raise(draw_idx_t idx) {
+  Slot *slot = findSlot(idx);
+  assert(slot);
+  ZLayer &layer   = zIndex_[findZLayer(slot->z)];
+  slot->order     = ++orderMax_;
+  layer.dirty     = true;
+  displacedStale_ = displacedStale_ || groupsDisplaced_;
+  layer.raised.push_back({slotIndex(idx), slot->order});
 
-  for (int z = min; z <= max; ++z) // poor performance with sparse z values -- designed for several, adjacent z layers on a canvas
-    for (int i = 0; i < drawList_.size(); ++i) {
-      Primitive *primitive = drawList_[i];
+  if ((layer.lowered.size() + layer.raised.size()) > (layer.live * 2))
+    compactZLayer(layer);
+}
 
-      if (primitive && primitive->visible && ((primitive->z + primitive->offsetZ) == z)) {
-        if (primitive->clip) {
-          const ImVec4 &rect = primitive->clipRect;
-          drawList->PushClipRect(ImVec2(rect.x, rect.y), ImVec2(rect.z, rect.w));
-        }
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+void StatefulCanvas::lower(draw_idx_t idx) {
+  Slot *slot = findSlot(idx);
+  assert(slot);
+  ZLayer &layer   = zIndex_[findZLayer(slot->z)];
+  slot->order     = --orderMin_;
+  layer.dirty     = true;
+  displacedStale_ = displacedStale_ || groupsDisplaced_;
+  layer.lowered.push_back({slotIndex(idx), slot->order});
 
-        primitive->draw(drawList, loc);
+  if ((layer.lowered.size() + layer.raised.size()) > (layer.live * 2))
+    compactZLayer(layer);
+}
 
-        if (primitive->clip)
-          drawList->PopClipRect();
-      }
-    }
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+void StatefulCanvas::dragAndDropStart(draw_idx_t idx, int z) {
+  Slot *slot = findSlot(idx);
+  assert(slot);
+  slot->primitive->dragAndDropStart(z);
+  dirtyZ(slot->z);
 
-  if (useCursorPosition_) {
-    ItemSize(size_);
-    ItemAdd(ImRect(window->DC.CursorPos, window->DC.CursorPos + size_), window->GetID(label));
+  if (z && !slot->dragged) {
+    slot->dragged = true;
+    dragged_.push_back(slotIndex(idx));
   }
+}
 
-  if (clip)
-    drawList->PopClipRect();
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+void StatefulCanvas::dragAndDropUpdate(draw_idx_t idx, float x, float y) {
+  Slot *slot = findSlot(idx);
+  assert(slot);
+  slot->primitive->dragAndDropUpdate(x, y);
+  touch(slotIndex(idx));
+
+  if (!slot->dragged) // otherwise drawn outside of its z layer's geometry
+    dirtyZ(slot->z);
 }
 
 //--------------------------------------------------------------------------------------------------------------------------------------------------------------
-void StatefulCanvas::erase(draw_idx_t idx) {
-  assert((idx >= 0) && (idx < drawList_.size()) && drawList_[idx]);
-  delete drawList_[idx];
-  drawList_[idx] = nullptr;
+void StatefulCanvas::dragAndDropEnd(draw_idx_t idx) {
+  Slot *slot = findSlot(idx);
+  assert(slot);
+  slot->primitive->dragAndDropEnd(); // draw() drops it from dragged_
+  dirtyZ(slot->z);
+  touch(slotIndex(idx));
 }
 
 //--------------------------------------------------------------------------------------------------------------------------------------------------------------
-void StatefulCanvas::clear() {
-  for (int i = 0; i < drawList_.size(); ++i)
-    delete drawList_[i];
+void StatefulCanvas::dragAndDropEnd(draw_idx_t idx, float x, float y) {
+  Slot *slot = findSlot(idx);
+  assert(slot);
+  slot->primitive->dragAndDropEnd(x, y);
+  dirtyZ(slot->z);
+  touch(slotIndex(idx));
+}
 
-  drawList_.clear();
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+void StatefulCanvas::moveTo(draw_idx_t idx, float x, float y) {
+  Slot *slot = findSlot(idx);
+  assert(slot);
+  slot->primitive->moveTo(x, y);
+  dirtyZ(slot->z);
+  touch(slotIndex(idx));
 }
 
 //--------------------------------------------------------------------------------------------------------------------------------------------------------------
-StatefulCanvas::draw_idx_t StatefulCanvas::addToDrawList(Primitive *primitive) {
-  addClipRect(primitive);
+void StatefulCanvas::translate(const draw_idx_t *handles, int n, float dx, float dy) {
+  moved_.resize(n);
 
-  for (int i = 0; i < drawList_.size(); ++i)
-    if (!drawList_[i]) {
-      drawList_[i] = primitive;
-      return i;
-    }
+  for (int i = 0, z = 0; i < n; ++i) {
+    Slot *slot = findSlot(handles[i]);
+    assert(slot);
+    moved_[i] = slot->primitive;
+    touch(slotIndex(handles[i]));
+
+    if ((i == 0) || (slot->z != z)) // a run of handles in one layer dirties it once
+      dirtyZ(z = slot->z);
+  }
 
-  drawList_.push_back(primitive);
-  return drawList_.size() - 1;
+  moveBatches(dx, dy);
 }
 
 //--------------------------------------------------------------------------------------------------------------------------------------------------------------
-void StatefulCanvas::addClipRect(Primitive *primitive) const {
-  if (clipRectStack_.size() == 0)
-    primitive->clip = false;
-  else {
-    ImVec4 intersection(INT_MIN, INT_MIN, INT_MAX, INT_MAX);
-
-    for (int i = 0; i < clipRectStack_.size(); ++i) {
-      const ImVec4 &clipRect = clipRectStack_[i];
+void StatefulCanvas::translateAll(float dx, float dy) { // moves geometry -- see groupMove() for moving without touching it
+  moved_.resize(0);
 
-      if (clipRect.x > intersection.x)
-        intersection.x = clipRect.x;
+  for (int i = 0; i < slotsUsed_; ++i)
+    if (drawList_[i].primitive)
+      moved_.push_back(drawList_[i].primitive);
 
-      if (clipRect.y > intersection.y)
-        intersection.y = clipRect.y;
+  moveBatches(dx, dy);
+  invalidate();
 
-      if (clipRect.z < intersection.z)
-        intersection.z = clipRect.z;
+  if (spatialIndex_)
+    spatialIndex(true, cellSize_); // reindexed in one pass
+}
 
-      if (clipRect.w < intersection.w)
-        intersection.w = clipRect.w;
-    }
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+StatefulCanvas::group_idx_t StatefulCanvas::newGroup(group_idx_t parent) {
+  assert(groups_[parent].live);
+  int g = freeGroup_;
 
-    primitive->clip     = true;
-    primitive->clipRect = intersection;
+  if (g >= 0)
+    freeGroup_ = groups_[g].parent;
+  else {
+    g = (int)groups_.size();
+    groups_.push_back(Group());
+    groupOffsets_.push_back(ImVec2(0, 0));
+    grids_.resize(groups_.size());
   }
-}
 
-//--------------------------------------------------------------------------------------------------------------------------------------------------------------
-void StatefulCanvas::Line::draw(ImDrawList *drawList, const ImVec2 &loc) {
-  ImVec2 offs;
-  offset(loc, &offs);
-  drawList->AddLine(p0 + offs, p1 + offs, color, thickness);
+  Group &group          = groups_[g];
+  group.parent          = parent;
+  group.children        = 0;
+  group.offsetZ         = 0;
+  group.offset          = ImVec2(0, 0);
+  group.dragOffset      = ImVec2(0, 0);
+  group.visible         = true;
+  group.live            = true;
+  group.composedZ       = 0;
+  group.composedVisible = true;
+  group.mark            = 0;
+  group.indexed         = 0;
+  groupOffsets_[g]      = ImVec2(0, 0);
+  groupsDirty_          = true; // compose with parent before members are drawn or indexed
+  ++groups_[parent].children;
+  return g;
 }
 
 //--------------------------------------------------------------------------------------------------------------------------------------------------------------
-void StatefulCanvas::Rect::draw(ImDrawList *drawList, const ImVec2 &loc) {
-  ImVec2 offs;
-  offset(loc, &offs);
-  drawList->AddRect(p0 + offs, p1 + offs, color, rounding, cornerFlags, thickness);
-}
+void StatefulCanvas::eraseGroup(group_idx_t g) {
+  Group &group = groups_[g];
+  assert((g != GROUP_ROOT) && group.live && (group.children == 0));
 
-//--------------------------------------------------------------------------------------------------------------------------------------------------------------
-void StatefulCanvas::RectFilled::draw(ImDrawList *drawList, const ImVec2 &loc) {
-  ImVec2 offs;
-  offset(loc, &offs);
-  drawList->AddRectFilled(p0 + offs, p1 + offs, color, rounding, cornerFlags);
-}
+  while (group.members.size() > 0) {
+    int s = group.members.back();
+    eraseSlot(handle(s, drawList_[s].generation)); // leaves group
+  }
 
-//--------------------------------------------------------------------------------------------------------------------------------------------------------------
-void StatefulCanvas::RectFilledMultiColor::draw(ImDrawList *drawList, const ImVec2 &loc) {
-  ImVec2 offs;
-  offset(loc, &offs);
-  drawList->AddRectFilledMultiColor(p0 + offs, p1 + offs, color0, color1, color2, color3);
+  --groups_[group.parent].children;
+  group.live    = false;
+  group.parent  = freeGroup_;
+  freeGroup_    = g;
+  group.members.clear();
+
+  if (compactDue())
+    compact();
+  else if (packStringsDue())
+    packStrings();
 }
 
 //--------------------------------------------------------------------------------------------------------------------------------------------------------------
-void StatefulCanvas::Quad::draw(ImDrawList *drawList, const ImVec2 &loc) {
-  ImVec2 offs;
-  offset(loc, &offs);
-  drawList->AddQuad(p0 + offs, p1 + offs, p2 + offs, p3 + offs, color, thickness);
+StatefulCanvas::group_idx_t StatefulCanvas::group(draw_idx_t idx) const {
+  const Slot *slot = findSlot(idx);
+  assert(slot);
+  return slot->primitive->group;
 }
 
 //--------------------------------------------------------------------------------------------------------------------------------------------------------------
-void StatefulCanvas::QuadFilled::draw(ImDrawList *drawList, const ImVec2 &loc) {
-  ImVec2 offs;
-  offset(loc, &offs);
-  drawList->AddQuadFilled(p0 + offs, p1 + offs, p2 + offs, p3 + offs, color);
+void StatefulCanvas::setGroup(draw_idx_t idx, group_idx_t group) {
+  Slot *slot = findSlot(idx);
+  assert(slot && groups_[group].live);
+
+  if (slot->primitive->group == group)
+    return;
+
+  if (slot->spatial != Spatial_None) // from its group's grid -- reindexed in the new group's by touch()
+    unindexBounds(slotIndex(idx));
+
+  leaveGroup(slotIndex(idx));
+  joinGroup(slotIndex(idx), group);
+  dirtyZ(slot->z);
+  touch(slotIndex(idx));
 }
 
 //--------------------------------------------------------------------------------------------------------------------------------------------------------------
-void StatefulCanvas::Triangle::draw(ImDrawList *drawList, const ImVec2 &loc) {
-  ImVec2 offs;
-  offset(loc, &offs);
-  drawList->AddTriangle(p0 + offs, p1 + offs, p2 + offs, color, thickness);
+void StatefulCanvas::groupMove(group_idx_t g, float x, float y) {
+  Group &group = groups_[g];
+  assert(group.live);
+  group.offset += ImVec2(x, y);
+  groupsDirty_  = true; // composed by resolveGroups() -- members' bounds and cached geometry are in group space, so none are touched
 }
 
 //--------------------------------------------------------------------------------------------------------------------------------------------------------------
-void StatefulCanvas::TriangleFilled::draw(ImDrawList *drawList, const ImVec2 &loc) {
-  ImVec2 offs;
-  offset(loc, &offs);
-  drawList->AddTriangleFilled(p0 + offs, p1 + offs, p2 + offs, color);
+void StatefulCanvas::groupVisible(group_idx_t g, bool state) {
+  Group &group = groups_[g];
+  assert(group.live);
+  group.visible = state;
+  groupsDirty_  = true;
 }
 
 //--------------------------------------------------------------------------------------------------------------------------------------------------------------
-void StatefulCanvas::Circle::draw(ImDrawList *drawList, const ImVec2 &loc) {
-  ImVec2 offs;
-  offset(loc, &offs);
-  drawList->AddCircle(center + offs, radius, color, segments, thickness);
+void StatefulCanvas::groupDragAndDropStart(group_idx_t g, int z) {
+  Group &group = groups_[g];
+  assert(group.live);
+  group.offsetZ = z;
+  groupsDirty_  = true;
 }
 
 //--------------------------------------------------------------------------------------------------------------------------------------------------------------
-void StatefulCanvas::CircleFilled::draw(ImDrawList *drawList, const ImVec2 &loc) {
-  ImVec2 offs;
-  offset(loc, &offs);
-  drawList->AddCircleFilled(center + offs, radius, color, segments);
+void StatefulCanvas::groupDragAndDropUpdate(group_idx_t g, float x, float y) {
+  Group &group     = groups_[g];
+  assert(group.live);
+  group.dragOffset = ImVec2(x, y);
+  groupsDirty_     = true;
 }
 
 //--------------------------------------------------------------------------------------------------------------------------------------------------------------
-void StatefulCanvas::Ngon::draw(ImDrawList *drawList, const ImVec2 &loc) {
-  ImVec2 offs;
-  offset(loc, &offs);
-  drawList->AddNgon(center + offs, radius, color, segments, thickness);
+void StatefulCanvas::groupDragAndDropEnd(group_idx_t g) {
+  Group &group     = groups_[g];
+  assert(group.live);
+  group.offsetZ    = 0;
+  group.dragOffset = ImVec2(0, 0);
+  groupsDirty_     = true;
 }
 
 //--------------------------------------------------------------------------------------------------------------------------------------------------------------
-void StatefulCanvas::NgonFilled::draw(ImDrawList *drawList, const ImVec2 &loc) {
-  ImVec2 offs;
-  offset(loc, &offs);
-  drawList->AddNgonFilled(center + offs, radius, color, segments);
+void StatefulCanvas::groupDragAndDropEnd(group_idx_t g, float x, float y) {
+  groupDragAndDropEnd(g);
+  groupMove(g, x, y);
 }
 
 //--------------------------------------------------------------------------------------------------------------------------------------------------------------
-void StatefulCanvas::Text::draw(ImDrawList *drawList, const ImVec2 &loc) {
-  ImVec2 offs;
-  offset(loc, &offs);
-  drawList->AddText(p + offs, color, string.c_str());
+void StatefulCanvas::joinGroup(int s, group_idx_t g) {
+  Slot  &slot           = drawList_[s];
+  Group &group          = groups_[g];
+  slot.primitive->group = g;
+  slot.groupPos         = group.members.size();
+  group.members.push_back(s);
+  displacedStale_       = displacedStale_ || groupsDisplaced_;
 }
 
 //--------------------------------------------------------------------------------------------------------------------------------------------------------------
-void StatefulCanvas::Text2::draw(ImDrawList *drawList, const ImVec2 &loc) {
-  ImVec2 offs;
-  offset(loc, &offs);
-  drawList->AddText(font, fontSize, p + offs, color, string.c_str(), nullptr, wrapWidth, cpuFineClipRect);
+void StatefulCanvas::leaveGroup(int s) { // swap with group's last member
+  Slot          &slot    = drawList_[s];
+  ImVector<int> &members = groups_[slot.primitive->group].members;
+  int           last     = members.back();
+  members[slot.groupPos]   = last;
+  drawList_[last].groupPos = slot.groupPos;
+  members.pop_back();
+  displacedStale_          = displacedStale_ || groupsDisplaced_;
 }
 
 //--------------------------------------------------------------------------------------------------------------------------------------------------------------
-void StatefulCanvas::Polyline::draw(ImDrawList *drawList, const ImVec2 &loc) {
-  ImVec2 offs;
-  offset(loc, &offs);
+void StatefulCanvas::resolveGroups() const { // compose groups with their ancestors -- members of groups whose z or visibility changed are redrawn
+  if (!groupsDirty_)
+    return;
 
-  for (int i = 0; i < points.Size; ++i)
-    adjustedPoints[i] = points[i] + offs;
+  bool displaced   = groupsDisplaced_;
+  groupsDirty_     = false;
+  groupsDisplaced_ = false;
+  ++groupMark_;
+
+  for (int g = 0; g < (int)groups_.size(); ++g)
+    resolveGroup(g);
 
-  drawList->AddPolyline(adjustedPoints, points.Size, color, closed, thickness);
+  displacedStale_ = displacedStale_ || (displaced != groupsDisplaced_);
 }
 
 //--------------------------------------------------------------------------------------------------------------------------------------------------------------
-void StatefulCanvas::ConvexPolyFilled::draw(ImDrawList *drawList, const ImVec2 &loc) {
-  ImVec2 offs;
-  offset(loc, &offs);
+void StatefulCanvas::resolveGroup(int g) const {
+  const Group &group = groups_[g];
 
-  for (int i = 0; i < points.Size; ++i)
-    adjustedPoints[i] = points[i] + offs;
+  if (!group.live || (group.mark == groupMark_))
+    return;
+
+  group.mark     = groupMark_;
+  ImVec2 offset  = group.offset + group.dragOffset;
+  int    z       = group.offsetZ;
+  bool   visible = group.visible;
 
-  drawList->AddConvexPolyFilled(adjustedPoints, points.Size, color);
+  if (group.parent >= 0) {
+    resolveGroup(group.parent);
+    offset  += groupOffsets_[group.parent];
+    z       += groups_[group.parent].composedZ;
+    visible  = visible && groups_[group.parent].composedVisible;
+  }
+
+  bool changed = (z != group.composedZ) || (visible != group.composedVisible); // a move only changes groupOffsets_[g]
+
+  for (int i = 0; changed && cacheGeometry_ && (i < group.members.size()); ++i)
+    dirtyZ(drawList_[group.members[i]].z);
+
+  displacedStale_       = displacedStale_ || changed;
+  groupOffsets_[g]      = offset;
+  group.composedZ       = z;
+  group.composedVisible = visible;
+  groupsDisplaced_      = groupsDisplaced_ || (z && visible && (group.members.size() > 0));
 }
 
 //--------------------------------------------------------------------------------------------------------------------------------------------------------------
-void StatefulCanvas::BezierCurve::draw(ImDrawList *drawList, const ImVec2 &loc) {
-  ImVec2 offs;
-  offset(loc, &offs);
-  drawList->AddBezierCurve(p0 + offs, p1 + offs, p2 + offs, p3 + offs, color, thickness, segments);
+void StatefulCanvas::levelOfDetail(draw_idx_t idx, LevelOfDetail mode, float tolerance) {
+  Slot *slot = findSlot(idx);
+  assert(slot);
+  Lod *lod = findLod(slot->primitive);
+  assert(lod && (tolerance > 0.0f));
+  lod->lodMode      = mode;
+  lod->lodTolerance = tolerance;
+  lod->lodDirty     = true;
+  dirtyZ(slot->z);
 }
 
 //--------------------------------------------------------------------------------------------------------------------------------------------------------------
-void StatefulCanvas::Image::draw(ImDrawList *drawList, const ImVec2 &loc) {
-  ImVec2 offs;
-  offset(loc, &offs);
-  drawList->AddImage(textureId, p0 + offs, p1 + offs, uv0, uv1, color);
+void StatefulCanvas::setPoints(draw_idx_t idx, const ImVec2 *points, int nPoints) {
+  Points *dest = findPoints(item<Primitive>(idx)); // marks bounds, z layer and level of detail changed
+  assert(dest);
+  dest->points.resize(nPoints);
+
+  if (nPoints > 0)
+    memcpy(dest->points.Data, points, nPoints * sizeof(ImVec2));
 }
 
 //--------------------------------------------------------------------------------------------------------------------------------------------------------------
-void StatefulCanvas::ImageQuad::draw(ImDrawList *drawList, const ImVec2 &loc) {
-  ImVec2 offs;
-  offset(loc, &offs);
-  drawList->AddImageQuad(textureId, p0 + offs, p1 + offs, p2 + offs, p3 + offs, uv0, uv1, uv2, uv3, color);
+void StatefulCanvas::setPoints(draw_idx_t idx, ImVector<ImVec2> &&points) {
+  Points *dest = findPoints(item<Primitive>(idx));
+  assert(dest);
+  dest->points.swap(points);
 }
 
 //--------------------------------------------------------------------------------------------------------------------------------------------------------------
-void StatefulCanvas::ImageRounded::draw(ImDrawList *drawList, const ImVec2 &loc) {
+void StatefulCanvas::setText(draw_idx_t idx, std::string_view string) {
+  String *dest = findString(item<Primitive>(idx)); // marks bounds and z layer changed, and text layout stale
+  assert(dest);
+  int length = (int)string.size(),
+      stored = (int)(dest->stringEnd - dest->string);
+
+  if (length <= stored) { // fits where the current string is stored
+    char *text = const_cast<char *>(dest->string);
+
+    if (length > 0)
+      memmove(text, string.data(), length); // string may view the current one
+
+    text[length]   = 0;
+    strings_.dead += stored - length;
+  } else {
+    dest->string   = storeString(string.data(), string.data() + length);
+    strings_.dead += stored + 1;
+  }
+
+  dest->stringEnd = dest->string + length;
+
+  if (packStringsDue())
+    packStrings();
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+StatefulCanvas::Lod *StatefulCanvas::findLod(Primitive *primitive) {
+  if (primitive->type == PrimitiveType_Polyline)
+    return static_cast<Polyline *>(primitive);
+
+  if (primitive->type == PrimitiveType_ConvexPolyFilled)
+    return static_cast<ConvexPolyFilled *>(primitive);
+
+  return nullptr;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+StatefulCanvas::TextLayout *StatefulCanvas::findTextLayout(Primitive *primitive) {
+  if (primitive->type == PrimitiveType_Text)
+    return static_cast<Text *>(primitive);
+
+  if (primitive->type == PrimitiveType_Text2)
+    return static_cast<Text2 *>(primitive);
+
+  return nullptr;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+StatefulCanvas::String *StatefulCanvas::findString(Primitive *primitive) {
+  if (primitive->type == PrimitiveType_Text)
+    return static_cast<Text *>(primitive);
+
+  if (primitive->type == PrimitiveType_Text2)
+    return static_cast<Text2 *>(primitive);
+
+  return nullptr;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+StatefulCanvas::Points *StatefulCanvas::findPoints(Primitive *primitive) {
+  if (primitive->type == PrimitiveType_Polyline)
+    return static_cast<Polyline *>(primitive);
+
+  if (primitive->type == PrimitiveType_ConvexPolyFilled)
+    return static_cast<ConvexPolyFilled *>(primitive);
+
+  return nullptr;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+const char *StatefulCanvas::storeString(const char *textBegin, const char *textEnd) {
+  const int blockSize = 64 * 1024; // bytes -- longer strings get a block of their own
+  Arena     &arena    = strings_;
+  int       length    = (int)(textEnd ? textEnd - textBegin : strlen(textBegin));
+
+  while ((arena.block < arena.blocks.size()) && (arena.used + length + 1 > arena.capacities[arena.block])) {
+    ++arena.block;
+    arena.used = 0;
+  }
+
+  if (arena.block == arena.blocks.size()) {
+    arena.capacities.push_back(ImMax(blockSize, length + 1));
+    arena.blocks.push_back(allocFunc_(arena.capacities.back(), allocUserData_));
+  }
+
+  char *string = (char *)arena.blocks[arena.block] + arena.used;
+  memcpy(string, textBegin, length);
+  string[length] = 0;
+  arena.used    += length + 1;
+  arena.bytes   += length + 1;
+  return string;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+void StatefulCanvas::streamAppend(draw_idx_t idx, const ImVec2 *points, int n) {
+  StreamingPolyline *stream = item<StreamingPolyline>(idx); // marks bounds and z layer changed
+  assert(stream && (stream->type == PrimitiveType_StreamingPolyline));
+  stream->append(points, n);
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+void StatefulCanvas::streamEvict(draw_idx_t idx, int n) {
+  StreamingPolyline *stream = item<StreamingPolyline>(idx);
+  assert(stream && (stream->type == PrimitiveType_StreamingPolyline));
+  stream->evict(n);
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+void StatefulCanvas::streamSpan(draw_idx_t idx, const ImVec2 *points, int capacity, int head, int count) {
+  StreamingPolyline *stream = item<StreamingPolyline>(idx);
+  assert(stream && (stream->type == PrimitiveType_StreamingPolyline));
+  stream->span(points, capacity, head, count);
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+void StatefulCanvas::spatialIndex(bool state, float cellSize) {
+  assert(cellSize > 0);
+
+  for (int i = 0; i < touched_.size(); ++i)
+    drawList_[touched_[i]].touched = false;
+
+  for (int i = 0; i < slotsUsed_; ++i)
+    drawList_[i].spatial = Spatial_None;
+
+  for (int g = 0; g < (int)groups_.size(); ++g) {
+    groups_[g].unbounded.clear();
+    groups_[g].indexed = 0;
+    grids_[g].clear();
+  }
+
+  touched_.clear();
+  spatialIndex_ = state;
+  cellSize_     = cellSize;
+
+  for (int i = 0; (i < slotsUsed_) && state; ++i)
+    if (drawList_[i].primitive)
+      indexBounds(i);
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+void StatefulCanvas::queueReserve(int handles) {
+  assert(handles >= 0);
+  queue_->reserve = handles;
+  refillReserve();
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+StatefulCanvas::draw_idx_t StatefulCanvas::queueLine(const ImVec2 &p0, const ImVec2 &p1, ImU32 color, float thickness, int z) {
+  return queueAdd<Line>(PrimitiveType_Line, z, LineInit{p0, p1, color, thickness});
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+StatefulCanvas::draw_idx_t StatefulCanvas::queueRectFilled(const ImVec2 &min, const ImVec2 &max, ImU32 color, int z) {
+  return queueAdd<RectFilled>(PrimitiveType_RectFilled, z, RectFilledInit{min, max, color});
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+StatefulCanvas::draw_idx_t StatefulCanvas::queueCircle(const ImVec2 &center, float radius, ImU32 color, int nSegments, float thickness, int z) {
+  return queueAdd<Circle>(PrimitiveType_Circle, z, CircleInit{center, radius, color, nSegments, thickness});
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+StatefulCanvas::draw_idx_t StatefulCanvas::queueText(const ImVec2 &pos, ImU32 color, const char *textBegin, const char *textEnd, int z) {
+  return queueText(pos, color, std::string(textBegin, textEnd ? textEnd : textBegin + strlen(textBegin)), z); // copied until applied
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+StatefulCanvas::draw_idx_t StatefulCanvas::queueText(const ImVec2 &pos, ImU32 color, std::string &&string, int z) {
+  draw_idx_t idx = reserveHandle();
+
+  enqueue(newCommand<QueuedText>(pos, color, std::move(string)), idx, z, QueuedText::apply);
+
+  return idx;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+void StatefulCanvas::QueuedText::apply(StatefulCanvas *canvas, Command *command) {
+  QueuedText *queued = static_cast<QueuedText *>(command);
+  Text       *text   = canvas->allocate<Text>(PrimitiveType_Text);
+  text->z            = queued->z;
+  text->p            = queued->pos;
+  text->color        = queued->color;
+  text->string       = canvas->storeString(queued->string.data(), queued->string.data() + queued->string.size());
+  text->stringEnd    = text->string + queued->string.size();
+  canvas->adopt(queued->idx, text);
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+StatefulCanvas::draw_idx_t StatefulCanvas::queuePolyline(const ImVec2 *points, int nPoints, ImU32 color, bool closed, float thickness, int z) {
+  return queuePolyline(std::vector<ImVec2>(points, points + nPoints), color, closed, thickness, z); // ImVector would allocate through ImGui::MemAlloc()
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+StatefulCanvas::draw_idx_t StatefulCanvas::queuePolyline(std::vector<ImVec2> &&points, ImU32 color, bool closed, float thickness, int z) {
+  draw_idx_t idx = reserveHandle();
+
+  enqueue(newCommand<QueuedPolyline>(std::move(points), color, closed, thickness), idx, z, QueuedPolyline::apply);
+
+  return idx;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+void StatefulCanvas::QueuedPolyline::apply(StatefulCanvas *canvas, Command *command) {
+  QueuedPolyline *queued = static_cast<QueuedPolyline *>(command);
+  Polyline       *poly   = canvas->allocate<Polyline>(PrimitiveType_Polyline);
+  poly->z                = queued->z;
+  poly->color            = queued->color;
+  poly->thickness        = queued->thickness;
+  poly->closed           = queued->closed;
+  poly->points.resize((int)queued->points.size());
+
+  if (queued->points.size() > 0)
+    memcpy(poly->points.Data, queued->points.data(), queued->points.size() * sizeof(ImVec2));
+
+  canvas->adopt(queued->idx, poly);
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+StatefulCanvas::draw_idx_t StatefulCanvas::queueCustom(Primitive *c, int z) {
+  draw_idx_t   idx     = reserveHandle();
+  QueuedChange *change = newCommand<QueuedChange>();
+  change->primitive    = c;
+  enqueue(change, idx, z, QueuedChange::applyCustom);
+
+  return idx;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+void StatefulCanvas::QueuedChange::applyCustom(StatefulCanvas *canvas, Command *command) {
+  QueuedChange *change = static_cast<QueuedChange *>(command);
+  change->primitive->z = change->z;
+  canvas->adopt(change->idx, change->primitive);
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+void StatefulCanvas::queueErase(draw_idx_t idx) {
+  enqueue(newCommand<QueuedChange>(), idx, 0, QueuedChange::applyErase);
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+void StatefulCanvas::QueuedChange::applyErase(StatefulCanvas *canvas, Command *command) {
+  canvas->eraseSlot(command->idx); // applied by draw(), which doesn't compact
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+void StatefulCanvas::queueVisible(draw_idx_t idx, bool state) {
+  QueuedChange *change = newCommand<QueuedChange>();
+  change->state        = state;
+  enqueue(change, idx, 0, QueuedChange::applyVisible);
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+void StatefulCanvas::QueuedChange::applyVisible(StatefulCanvas *canvas, Command *command) {
+  canvas->visible(command->idx, static_cast<QueuedChange *>(command)->state);
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+void StatefulCanvas::queueSetZ(draw_idx_t idx, int z) {
+  enqueue(newCommand<QueuedChange>(), idx, z, QueuedChange::applySetZ);
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+void StatefulCanvas::QueuedChange::applySetZ(StatefulCanvas *canvas, Command *command) {
+  if (canvas->valid(command->idx))
+    canvas->setZ(command->idx, command->z);
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+void StatefulCanvas::queueMoveTo(draw_idx_t idx, float x, float y) {
+  QueuedChange *change = newCommand<QueuedChange>();
+  change->x            = x;
+  change->y            = y;
+  enqueue(change, idx, 0, QueuedChange::applyMoveTo);
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+void StatefulCanvas::QueuedChange::applyMoveTo(StatefulCanvas *canvas, Command *command) {
+  QueuedChange *change = static_cast<QueuedChange *>(command);
+
+  if (canvas->valid(change->idx))
+    canvas->moveTo(change->idx, change->x, change->y);
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+void StatefulCanvas::applyQueue() {
+  Command *command = queue_->head.exchange(nullptr, std::memory_order_acquire),
+          *ordered = nullptr;
+
+  while (command) { // reverse into queued order
+    Command *next = command->next;
+    command->next = ordered;
+    ordered       = command;
+    command       = next;
+  }
+
+  if (ordered) {
+    ClipRectStack clipRectStack; // queued adds ignore stacks pushed by UI thread
+    GroupStack    groupStack;
+    clipRectStack.swap(clipRectStack_);
+    groupStack.swap(groupStack_);
+
+    while (ordered) {
+      Command *next = ordered->next;
+      ordered->apply(this, ordered);
+      freeCommand(ordered);
+      ordered = next;
+    }
+
+    clipRectStack.swap(clipRectStack_);
+    groupStack.swap(groupStack_);
+  }
+
+  refillReserve();
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+void StatefulCanvas::ingest(IngestFunc func, int items, void *userData) {
+  assert(func && (items >= 0));
+  ingests_.push_back({func, userData, items, 0});
+  ingestItems_ += items;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+template<typename T>
+static void IngestGrow(ImVector<T> &vector, int used, int before, ImS64 left, int taken) { // used entries, before a batch that took taken items
+  if (used > before)
+    vector.reserve(ImMax(vector.Capacity, used + (int)ImMin(left * (used - before) / taken, (ImS64)INT_MAX / 2)));
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+void StatefulCanvas::applyIngest(float ms) { // batches sized from the measured time per item to fill what is left of ms
+  typedef std::chrono::steady_clock Clock;
+
+  if (ingests_.size() == 0)
+    return;
+
+  Clock::time_point start  = Clock::now();
+  double            budget = ms * 1e6,
+                    spent  = 0;
+  ZStack            zStack; // as applyQueue() -- ingests ignore stacks pushed by UI thread
+  ClipRectStack     clipRectStack;
+  GroupStack        groupStack;
+  zStack.swap(zStack_);
+  clipRectStack.swap(clipRectStack_);
+  groupStack.swap(groupStack_);
+
+  while ((ingests_.size() > 0) && (spent < budget)) {
+    Ingest ingest = ingests_[0]; // func may ingest() more
+    int    slots  = slotsUsed_,
+           root   = groups_[GROUP_ROOT].members.size();
+
+    for (int l = 0; l < (int)zIndex_.size(); ++l)
+      zIndex_[l].ingested = zIndex_[l].raised.size();
+
+    double fit   = ImClamp((budget - spent) / ingestNs_, (double)IngestBatchMin, (double)IngestBatchMax); // before the cast -- long budgets overflow int
+    int    n     = ImMin((int)fit, ingest.items - ingest.done),
+           taken = (n > 0) ? ingest.func(this, ingest.done, n, ingest.userData) : 0;
+    double batch = std::chrono::duration<double, std::nano>(Clock::now() - start).count() - spent;
+    assert((taken >= 0) && (taken <= n));
+    spent += batch;
+
+    if (ingests_.size() == 0) // func called clear()
+      break;
+
+    ingests_[0].done += taken;
+    ingestDone_      += taken;
+
+    if (taken > 0) {
+      ImS64 left = ingest.items - ingests_[0].done; // growing by this batch's share of what's left, so no frame pays to copy a large vector
+      ingestNs_  = ImClamp(0.5f * ingestNs_ + 0.5f * (float)(batch / taken), 1.0f, 1e6f);
+      IngestGrow(drawList_, slotsUsed_, slots, left, taken);
+      IngestGrow(groups_[GROUP_ROOT].members, groups_[GROUP_ROOT].members.size(), root, left, taken);
+
+      for (int l = 0; l < (int)zIndex_.size(); ++l)
+        IngestGrow(zIndex_[l].raised, zIndex_[l].raised.size(), zIndex_[l].ingested, left, taken);
+    }
+
+    if ((taken < n) || (ingests_[0].done == ingest.items)) { // source ran out, perhaps early
+      ingestDone_ += ingest.items - ingests_[0].done;
+      ingests_.erase(ingests_.begin());
+    }
+  }
+
+  if (ingests_.size() == 0) {
+    ingestItems_ = 0;
+    ingestDone_  = 0;
+  }
+
+  zStack.swap(zStack_);
+  clipRectStack.swap(clipRectStack_);
+  groupStack.swap(groupStack_);
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+StatefulCanvas::draw_idx_t StatefulCanvas::reserveHandle() { // take next handle of current window -- fails only when queued adds outran it
+  Queue &queue = *queue_;
+  ImU64 state  = queue.state.load(std::memory_order_acquire);
+
+  for (;;) {
+    const Queue::Window &window = queue.windows[(state >> 32) & 1];
+    int                 taken   = (int)(state & 0xFFFFFFFF),
+                        first   = window.first.load(std::memory_order_relaxed),
+                        count   = window.count.load(std::memory_order_relaxed),
+                        gen     = window.generation.load(std::memory_order_relaxed);
+
+    if (taken >= count) {
+      assert(!"queued adds ran past queueReserve() -- reserve a frame's adds");
+      queue.misses.fetch_add(1, std::memory_order_relaxed); // grows the next window
+      return DRAW_IDX_NONE;
+    }
+
+    if (queue.state.compare_exchange_weak(state, state + 1, std::memory_order_acquire))
+      return handle(first + taken, gen);
+  }
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+void StatefulCanvas::enqueue(Command *command, draw_idx_t idx, int z, void (*apply)(StatefulCanvas *canvas, Command *command)) {
+  command->idx   = idx;
+  command->z     = z;
+  command->apply = apply;
+  push(command);
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+void StatefulCanvas::push(Command *command) { // commands come from allocCommand() -- ImGui::MemAlloc() updates context metrics unsynchronized
+  command->next = queue_->head.load(std::memory_order_relaxed);
+
+  while (!queue_->head.compare_exchange_weak(command->next, command, std::memory_order_release, std::memory_order_relaxed))
+    ;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+void *StatefulCanvas::allocCommand(size_t size, size_t align) { // node from this thread's producer -- lock free once the thread has one
+  static thread_local Queue::Cached cached[4]; // producers this thread used last, most recent first
+  Queue                             &queue = *queue_;
+
+  if ((size > CommandNodeSize - CommandNodeAlign) || (align > CommandNodeAlign)) { // header marks it as not pooled
+    char *node                                  = static_cast<char *>(::operator new(CommandNodeAlign + size));
+    *reinterpret_cast<Queue::Producer **>(node) = nullptr;
+    return node + CommandNodeAlign;
+  }
+
+  int c = 0;
+
+  while ((c < IM_ARRAYSIZE(cached)) && (cached[c].queue != queue.id))
+    ++c;
+
+  Queue::Cached found;
+
+  if (c < IM_ARRAYSIZE(cached))
+    found = cached[c];
+  else {
+    c = IM_ARRAYSIZE(cached) - 1;
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    std::thread::id             thread   = std::this_thread::get_id();
+    Queue::Producer             *producer = queue.producers;
+
+    while (producer && (producer->thread != thread))
+      producer = producer->next;
+
+    if (!producer) {
+      producer           = new Queue::Producer;
+      producer->next     = queue.producers;
+      producer->thread   = thread;
+      producer->free     = nullptr;
+      producer->returned = nullptr;
+      queue.producers    = producer;
+    }
+
+    found.queue    = queue.id;
+    found.producer = producer;
+  }
+
+  for (; c > 0; --c)
+    cached[c] = cached[c - 1];
+
+  cached[0]                 = found;
+  Queue::Producer *producer = found.producer;
+
+  if (!producer->free)
+    producer->free = producer->returned.exchange(nullptr, std::memory_order_acquire);
+
+  if (!producer->free) {
+    char *block = static_cast<char *>(::operator new((size_t)CommandNodeSize * CommandNodeBlock));
+    producer->blocks.push_back(block);
+
+    for (int n = 0; n < CommandNodeBlock; ++n) {
+      char *node                                          = block + n * CommandNodeSize;
+      *reinterpret_cast<Queue::Producer **>(node)         = producer;
+      *reinterpret_cast<void **>(node + CommandNodeAlign) = producer->free;
+      producer->free                                      = node;
+    }
+  }
+
+  char *node     = static_cast<char *>(producer->free);
+  producer->free = *reinterpret_cast<void **>(node + CommandNodeAlign);
+  return node + CommandNodeAlign;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+void StatefulCanvas::freeCommand(Command *command) { // back to its producer's pool, or operator delete
+  command->~Command();
+  char            *node     = reinterpret_cast<char *>(command) - CommandNodeAlign;
+  Queue::Producer *producer = *reinterpret_cast<Queue::Producer **>(node);
+
+  if (!producer) {
+    ::operator delete(node);
+    return;
+  }
+
+  void *next = producer->returned.load(std::memory_order_relaxed);
+
+  do
+    *reinterpret_cast<void **>(node + CommandNodeAlign) = next;
+  while (!producer->returned.compare_exchange_weak(next, node, std::memory_order_release, std::memory_order_relaxed));
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+StatefulCanvas::draw_idx_t StatefulCanvas::adopt(draw_idx_t idx, Primitive *primitive) {
+  int slot = slotIndex(idx);
+
+  if ((idx < 0) || (slot >= slotsUsed_) || drawList_[slot].primitive || (drawList_[slot].generation != (int)(idx >> 32)))
+    return addToDrawList(primitive); // reserve ran out, or clear() released it
+
+  addClipRect(primitive);
+  attach(slot, primitive, zLayer(primitive->z));
+  return idx;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+void StatefulCanvas::refillReserve() { // replace a window less than half full with a new one, freeing slots not taken from it
+  Queue         &queue  = *queue_;
+  ImU64         state   = queue.state.load(std::memory_order_acquire),
+                epoch   = state >> 32;
+  Queue::Window &window = queue.windows[epoch & 1];
+  int           first   = window.first.load(std::memory_order_relaxed),
+                count   = window.count.load(std::memory_order_relaxed),
+                misses  = queue.misses.exchange(0, std::memory_order_relaxed);
+
+  if (misses > 0) // adds ran out since last refill -- next window holds twice as many
+    queue.reserve = ImMax(queue.reserve, ImMax(QueueReserveMin, (count + misses) * 2));
+
+  if ((misses == 0) && ((count - ImMin((int)(state & 0xFFFFFFFF), count)) * 2 >= queue.reserve))
+    return;
+
+  DrawIdxRange range = claimSlots(queue.reserve);
+
+  for (int i = 0; i < range.count; ++i)
+    drawList_[slotIndex(range.first) + i].primitive = nullptr; // reserved until adopt()
+
+  Queue::Window &next = queue.windows[(epoch + 1) & 1]; // inactive, so producers only read it once state publishes it
+  next.first.store(slotIndex(range.first), std::memory_order_relaxed);
+  next.count.store(range.count, std::memory_order_relaxed);
+  next.generation.store((int)(range.first >> 32), std::memory_order_relaxed);
+  state = queue.state.exchange((epoch + 1) << 32, std::memory_order_acq_rel);
+
+  for (int i = first + ImMin((int)(state & 0xFFFFFFFF), count); i < first + count; ++i) { // never handed out
+    drawList_[i].nextFree = freeSlot_;
+    freeSlot_             = i;
+  }
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+void StatefulCanvas::draw(const char *label, bool clip) {
+  applyQueue(); // queued changes become the state this draws
+  applyIngest(ingestBudget_);
+
+  STATS_ONLY(stats_.reset());
+
+  if (zIndex_.empty())
+    return;
+
+  ImGuiWindow *window = ImGui::GetCurrentWindow();
+
+  if (window->SkipItems)
+    return;
+
+  resolveGroups();
+
+  ImVec2 loc;
+
+  if (useCursorPosition_)
+    loc = window->DC.CursorPos;
+  else
+    loc = location_;
+
+  ImDrawList *drawList = ImGui::GetWindowDrawList();
+  STATS_ONLY(double start = StatsNow(); Stats *statsTarget = StatsTarget; StatsTarget = &stats_; stats_.clipPushes += clip;)
+
+  int cmdStart  = drawList->CmdBuffer.size() - 1, // for counting draw commands
+      elemStart = drawList->CmdBuffer.back().ElemCount,
+      vtxStart  = drawList->VtxBuffer.size(),
+      idxStart  = drawList->IdxBuffer.size();
+  drawList->VtxBuffer.reserve(vtxStart + lastVertices_); // grown once, up front, rather than while tessellating
+  drawList->IdxBuffer.reserve(idxStart + lastIndices_);
+  drawList->CmdBuffer.reserve(drawList->CmdBuffer.size() + drawCmds_ + 1);
+  stateChanges_ = 0;
+  lastClipRect_ = -2; // nothing drawn yet
+  lastTexture_  = nullptr;
+
+  if (clip)
+    drawList->PushClipRect(loc, loc + size_);
+
+  ImVec2 origin = loc + view_.pan; // canvas space (0, 0) on screen
+  drawLocation_ = loc;
+
+  for (int i = 0; i < dragged_.size(); ) { // drops dragged primitives whose z offset was cleared
+    const Slot &slot = drawList_[dragged_[i]];
+
+    if (slot.primitive->offsetZ == 0) {
+      slot.dragged    = false;
+      displacedStale_ = true;
+      dirtyZ(slot.z);
+      dragged_.erase_unsorted(dragged_.begin() + i);
+    }
+    else
+      ++i;
+  }
+
+  if (displacedStale_ || (dragged_.size() > 0)) // dragged z offsets may be changed directly through Primitive
+    collectDisplaced();
+
+  if (cacheGeometry_) {
+    ImTextureID fontTexture = ImGui::GetFont()->ContainerAtlas->TexID;
+
+    if ((drawList->Flags != cacheFlags_) || (fontTexture != cacheFontTexture_)) { // tessellation settings changed
+      cacheFlags_       = drawList->Flags;
+      cacheFontTexture_ = fontTexture;
+
+      for (int l = 0; l < (int)zIndex_.size(); ++l)
+        zIndex_[l].dirty = true;
+    }
+  }
+
+  culling_     = spatialIndex_ && !cacheGeometry_;
+  deferTarget_ = (threads_ > 1) ? drawList : nullptr; // drawPrimitive() defers to flushDeferred()
+
+  if (culling_) {
+    updateBounds();
+    visible_ = ImRect((drawList->GetClipRectMin() - origin) / view_.zoom, (drawList->GetClipRectMax() - origin) / view_.zoom);
+    visible_.Expand(view_.scaleThickness ? 0.0f : 16.0f / view_.zoom); // strokes keep their pixel width, so exceed bounds when zoomed out
+  }
+
+  bool culled = culling_ && drawCulled(drawList, origin); // otherwise walk z index, culling each primitive when culling_
+  int  d      = 0;
+
+  for (int l = 0; (l < (int)zIndex_.size()) && !culled; ++l) {
+    const ZLayer &layer = zIndex_[l];
+    STATS_ONLY(double layerStart = StatsNow(); int layerDrawn = stats_.drawn;)
+
+    for (; (d < displaced_.size()) && (displaced_[d].z < layer.z); ++d)
+      drawPrimitive(drawList, drawList_[displaced_[d].slot].primitive, origin);
+
+    if (cacheGeometry_) {
+      if (layer.dirty || !layer.geometry || (layer.geometry->zoom != view_.zoom) || !snapped(origin - layer.geometry->loc) || !groupsSnapped(*layer.geometry))
+        buildGeometry(layer, origin);
+      else
+        stateChanges_ += layer.geometry->stateChanges;
+
+      flushDeferred(drawList, origin);
+      drawGeometry(drawList, *layer.geometry, origin);
+#ifdef STATEFUL_CANVAS_STATS
+      stats_.copiedVertices += layer.geometry->vtx.size();
+      stats_.copiedIndices  += layer.geometry->idx.size();
+
+      for (int c = 0; c < layer.geometry->cmds.size(); ++c)
+        stats_.clipPushes += layer.geometry->cmds[c].clip;
+#endif
+    }
+    else
+      drawZLayer(drawList, layer, origin, &d);
+
+    for (; (d < displaced_.size()) && (displaced_[d].z == layer.z); ++d)
+      drawPrimitive(drawList, drawList_[displaced_[d].slot].primitive, origin);
+
+    STATS_ONLY(StatsLayer(stats_, layer.z, layerDrawn, layerStart));
+  }
+
+  for (; (d < displaced_.size()) && !culled; ++d)
+    drawPrimitive(drawList, drawList_[displaced_[d].slot].primitive, origin);
+
+  flushDeferred(drawList, origin);
+  deferTarget_ = nullptr;
+
+  if (useCursorPosition_) {
+    ItemSize(size_);
+    ItemAdd(ImRect(window->DC.CursorPos, window->DC.CursorPos + size_), window->GetID(label));
+  }
+
+  if (clip)
+    drawList->PopClipRect();
+
+  drawCmds_ = 0;
+
+  for (int c = cmdStart; c < drawList->CmdBuffer.size(); ++c) // commands which gained elements
+    if (drawList->CmdBuffer[c].ElemCount > (unsigned int)(c == cmdStart ? elemStart : 0))
+      ++drawCmds_;
+
+  lastVertices_ = drawList->VtxBuffer.size() - vtxStart;
+  lastIndices_  = drawList->IdxBuffer.size() - idxStart;
+  STATS_ONLY(stats_.visited = stats_.drawn + stats_.hidden + stats_.culled; stats_.ms = (float)(StatsNow() - start); StatsTarget = statsTarget;)
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+void StatefulCanvas::collectDisplaced() const { // primitives drawn at a z offset, merged in order with the z index by draw()
+  displaced_.resize(0);
+  displacedStale_ = false;
+
+  for (int i = 0; i < dragged_.size(); ++i) {
+    const Slot &slot = drawList_[dragged_[i]];
+    displaced_.push_back({drawnZ(slot), slot.order, dragged_[i]});
+  }
+
+  for (int g = 0; (g < (int)groups_.size()) && groupsDisplaced_; ++g) { // members of groups being dragged also draw at their offset z
+    const Group &group = groups_[g];
+
+    if (!group.live || !group.composedZ || !group.composedVisible)
+      continue;
+
+    for (int i = 0; i < group.members.size(); ++i) {
+      const Slot &slot = drawList_[group.members[i]];
+
+      if (!slot.dragged)
+        displaced_.push_back({drawnZ(slot), slot.order, group.members[i]});
+    }
+  }
+
+  std::sort(displaced_.begin(), displaced_.end(), drawnBefore);
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+void StatefulCanvas::drawZLayer(ImDrawList *drawList, const ZLayer &layer, const ImVec2 &loc, int *d) const { // d merges displaced_ by order
+  for (int pass = 0; pass < 2; ++pass) {
+    const ImVector<ZEntry> &entries = pass ? layer.raised : layer.lowered;
+
+    for (int e = 0; e < entries.size(); ++e) {
+      const ZEntry &entry = pass ? entries[e] : entries[entries.size() - 1 - e];
+
+      if (!validZEntry(entry))
+        continue;
+
+      for (; d && !batchByType_ && !sortByState_ && (*d < displaced_.size()) && (displaced_[*d].z == layer.z) && (displaced_[*d].order < entry.order); ++*d)
+        drawPrimitive(drawList, drawList_[displaced_[*d].slot].primitive, loc);
+
+      const Slot &slot = drawList_[entry.slot];
+      assert((slot.primitive->z == layer.z) && "Primitive::z written directly -- use StatefulCanvas::setZ()");
+
+      if (!walked(slot) || (culling_ && !inView(slot, loc))) {
+        STATS_ONLY(countSkipped(slot));
+        continue;
+      }
+
+      if (slot.primitive->offsetZ) { // z offset set directly through Primitive -- drawn in place this frame, at its offset z from the next
+        slot.dragged = true;
+        layer.dirty  = true;
+        dragged_.push_back(entry.slot);
+      }
+
+      if (buildingRuns_ && ((groupRuns_.size() == 0) || (groupRuns_.back().group != slot.primitive->group))) {
+        if (batch_.size() > 0) // batches don't span runs
+          drawBatches(drawList, loc);
+
+        groupRuns_.push_back({drawList->IdxBuffer.Size, slot.primitive->group, groupOffsets_[slot.primitive->group] * view_.zoom});
+      }
+
+      if (batchByType_ || sortByState_) {
+        countState(slot.primitive);
+        batch_.push_back(slot.primitive);
+      }
+      else
+        drawPrimitive(drawList, slot.primitive, loc);
+    }
+  }
+
+  if (batchByType_ || sortByState_)
+    drawBatches(drawList, loc);
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+void StatefulCanvas::buildGeometry(const ZLayer &layer, const ImVec2 &loc) const { // tessellate z layer into a private draw list and keep its output
+  if (!cacheDrawList_)
+    cacheDrawList_ = IM_NEW(ImDrawList)(ImGui::GetDrawListSharedData());
+
+  if (!layer.geometry)
+    layer.geometry = IM_NEW(Geometry)();
+
+  ImDrawList *drawList = cacheDrawList_;
+  drawList->_ResetForNewFrame();
+  drawList->Flags = cacheFlags_;
+  drawList->PushTextureID(cacheFontTexture_);
+  drawList->PushClipRectFullScreen();
+  ImVec4 fullScreen(drawList->GetClipRectMin().x, drawList->GetClipRectMin().y, drawList->GetClipRectMax().x, drawList->GetClipRectMax().y);
+  layer.dirty      = false; // before drawZLayer(), which may dirty it again
+  int stateChanges = stateChanges_;
+  groupRuns_.resize(0);
+  buildingRuns_ = true;
+  drawZLayer(drawList, layer, loc, nullptr);
+  buildingRuns_ = false;
+
+  Geometry &geometry    = *layer.geometry;
+  geometry.loc          = loc;
+  geometry.zoom         = view_.zoom;
+  geometry.stateChanges = stateChanges_ - stateChanges;
+  captureGeometry(drawList, fullScreen, &geometry, &groupRuns_);
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+void StatefulCanvas::captureGeometry(const ImDrawList *drawList, const ImVec4 &clipRect, Geometry *geometry, const GroupRuns *runs) { // per command and run
+  geometry->vtx.resize(0);
+  geometry->idx.resize(0);
+  geometry->cmds.resize(0);
+  int run = -1; // runs[run] holds the command's elements from its IdxOffset
+
+  for (int c = 0; c < drawList->CmdBuffer.size(); ++c) {
+    const ImDrawCmd &cmd = drawList->CmdBuffer[c];
+
+    if ((cmd.ElemCount == 0) || cmd.UserCallback)
+      continue;
+
+    for (unsigned int start = cmd.IdxOffset, end; start < cmd.IdxOffset + cmd.ElemCount; start = end) { // split where the drawn group changes
+      for (; runs && (run + 1 < runs->size()) && ((unsigned int)(*runs)[run + 1].idxOffset <= start); ++run)
+        ;
+
+      end = cmd.IdxOffset + cmd.ElemCount;
+
+      if (runs && (run + 1 < runs->size()))
+        end = ImMin(end, (unsigned int)(*runs)[run + 1].idxOffset);
+
+      const ImDrawIdx *idx    = drawList->IdxBuffer.Data + start;
+      unsigned int    idxMin  = idx[0],
+                      idxMax  = idx[0];
+
+      for (unsigned int i = 1; i < end - start; ++i) {
+        idxMin = ImMin(idxMin, (unsigned int)idx[i]);
+        idxMax = ImMax(idxMax, (unsigned int)idx[i]);
+      }
+
+      CachedCmd cached;
+      cached.clipRect  = cmd.ClipRect;
+      cached.clip      = memcmp(&cmd.ClipRect, &clipRect, sizeof(ImVec4)) != 0; // pushed by primitive
+      cached.group     = (run >= 0) ? (*runs)[run].group : -1;
+      cached.offset    = (run >= 0) ? (*runs)[run].offset : ImVec2(0, 0);
+      cached.textureId = cmd.TextureId;
+      cached.vtxOffset = geometry->vtx.size();
+      cached.vtxCount  = (int)(idxMax - idxMin + 1);
+      cached.idxOffset = geometry->idx.size();
+      cached.idxCount  = (int)(end - start);
+      geometry->cmds.push_back(cached);
+      geometry->vtx.resize(cached.vtxOffset + cached.vtxCount);
+      memcpy(geometry->vtx.Data + cached.vtxOffset, drawList->VtxBuffer.Data + cmd.VtxOffset + idxMin, cached.vtxCount * sizeof(ImDrawVert));
+      geometry->idx.resize(cached.idxOffset + cached.idxCount);
+
+      for (int i = 0; i < cached.idxCount; ++i)
+        geometry->idx[cached.idxOffset + i] = (ImDrawIdx)(idx[i] - idxMin);
+    }
+  }
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+void StatefulCanvas::drawGeometry(ImDrawList *drawList, const Geometry &geometry, const ImVec2 &loc) const { // copy cached z layer, translated to loc
+  for (int c = 0; c < geometry.cmds.size(); ++c) {
+    const CachedCmd &cmd  = geometry.cmds[c];
+    ImVec2          delta = loc - geometry.loc;
+
+    if (cmd.group >= 0) // group moved since its members were tessellated
+      delta += groupOffsets_[cmd.group] * view_.zoom - cmd.offset;
+
+    if (cmd.clip)
+      drawList->PushClipRect(ImVec2(cmd.clipRect.x, cmd.clipRect.y), ImVec2(cmd.clipRect.z, cmd.clipRect.w));
+
+    drawList->PushTextureID(cmd.textureId);
+    drawList->PrimReserve(cmd.idxCount, cmd.vtxCount);
+    ImDrawIdx        base = (ImDrawIdx)drawList->_VtxCurrentIdx;
+    const ImDrawVert *vtx = geometry.vtx.Data + cmd.vtxOffset;
+    const ImDrawIdx  *idx = geometry.idx.Data + cmd.idxOffset;
+
+    if ((delta.x == 0) && (delta.y == 0))
+      memcpy(drawList->_VtxWritePtr, vtx, cmd.vtxCount * sizeof(ImDrawVert));
+    else
+      for (int i = 0; i < cmd.vtxCount; ++i) {
+        drawList->_VtxWritePtr[i]     = vtx[i];
+        drawList->_VtxWritePtr[i].pos += delta;
+      }
+
+    for (int i = 0; i < cmd.idxCount; ++i)
+      drawList->_IdxWritePtr[i] = (ImDrawIdx)(base + idx[i]);
+
+    drawList->_VtxWritePtr   += cmd.vtxCount;
+    drawList->_IdxWritePtr   += cmd.idxCount;
+    drawList->_VtxCurrentIdx += cmd.vtxCount;
+    drawList->PopTextureID();
+
+    if (cmd.clip)
+      drawList->PopClipRect();
+  }
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+bool StatefulCanvas::groupsSnapped(const Geometry &geometry) const { // groups moved whole pixels since geometry was built -- text stays pixel aligned
+  for (int c = 0; c < geometry.cmds.size(); ++c) {
+    const CachedCmd &cmd = geometry.cmds[c];
+
+    if ((cmd.group >= 0) && !snapped(groupOffsets_[cmd.group] * view_.zoom - cmd.offset))
+      return false;
+  }
+
+  return true;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+static void PrepareView(StatefulCanvas::Primitive *primitive, const ImDrawList *drawList, const StatefulCanvas::View &view) { // caches drawView() fills
+  switch (primitive->type) {
+    case StatefulCanvas::PrimitiveType_Text:             static_cast<StatefulCanvas::Text *>(primitive)->prepareView(drawList, view); break;
+    case StatefulCanvas::PrimitiveType_Text2:            static_cast<StatefulCanvas::Text2 *>(primitive)->prepareView(drawList, view); break;
+    case StatefulCanvas::PrimitiveType_Polyline:         static_cast<StatefulCanvas::Polyline *>(primitive)->prepareView(view); break;
+    case StatefulCanvas::PrimitiveType_ConvexPolyFilled: static_cast<StatefulCanvas::ConvexPolyFilled *>(primitive)->prepareView(view); break;
+    default:                                             break;
+  }
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+static int CirclePoints(int segments) { // 0 -- ImGui picks the count from the radius
+  return ((segments > 0) ? segments : CircleSegmentMax) + 1;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+static int TessellationBound(const StatefulCanvas::Primitive *primitive, const StatefulCanvas::View &view) { // most path points (or glyphs) drawn
+  switch (primitive->type) {
+    case StatefulCanvas::PrimitiveType_Rect:
+    case StatefulCanvas::PrimitiveType_RectFilled:
+    case StatefulCanvas::PrimitiveType_ImageRounded:
+      return RoundedPointsMax;
+    case StatefulCanvas::PrimitiveType_Circle:
+      return CirclePoints(view.circleSegments(static_cast<const StatefulCanvas::Circle *>(primitive)->segments));
+    case StatefulCanvas::PrimitiveType_CircleFilled:
+      return CirclePoints(view.circleSegments(static_cast<const StatefulCanvas::CircleFilled *>(primitive)->segments));
+    case StatefulCanvas::PrimitiveType_Ngon:
+      return ImMax(static_cast<const StatefulCanvas::Ngon *>(primitive)->segments, 3) + 1;
+    case StatefulCanvas::PrimitiveType_NgonFilled:
+      return ImMax(static_cast<const StatefulCanvas::NgonFilled *>(primitive)->segments, 3) + 1;
+    case StatefulCanvas::PrimitiveType_Text:
+      return static_cast<const StatefulCanvas::Text *>(primitive)->glyphs.size(); // laid out by PrepareView()
+    case StatefulCanvas::PrimitiveType_Text2: {
+      const StatefulCanvas::Text2 *text = static_cast<const StatefulCanvas::Text2 *>(primitive);
+      return text->cpuFineClipRect ? (int)(text->textEnd() - text->text()) : text->glyphs.size();
+    }
+    case StatefulCanvas::PrimitiveType_Polyline:
+      return static_cast<const StatefulCanvas::Polyline *>(primitive)->points.size() + 1; // level of detail only drops points
+    case StatefulCanvas::PrimitiveType_ConvexPolyFilled:
+      return static_cast<const StatefulCanvas::ConvexPolyFilled *>(primitive)->points.size() + 1;
+    case StatefulCanvas::PrimitiveType_BezierCurve: {
+      int segments = static_cast<const StatefulCanvas::BezierCurve *>(primitive)->segments;
+      return (segments > 0) ? segments + 2 : BezierPointsMax;
+    }
+    case StatefulCanvas::PrimitiveType_StreamingPolyline:
+      return static_cast<const StatefulCanvas::StreamingPolyline *>(primitive)->count + 1;
+    default:
+      return 4;
+  }
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+static bool Fits(const ImDrawList *drawList, int points) { // drawing a path of points can't grow drawList -- bounds of a thick antialiased stroke
+  return (drawList->VtxBuffer.Capacity - drawList->VtxBuffer.Size >= points * 4) && (drawList->IdxBuffer.Capacity - drawList->IdxBuffer.Size >= points * 18) &&
+         (drawList->CmdBuffer.Capacity - drawList->CmdBuffer.Size >= 6) && (drawList->_Path.Capacity - drawList->_Path.Size >= points) && // clip, texture
+         (drawList->_ClipRectStack.Capacity - drawList->_ClipRectStack.Size >= 1) && (drawList->_TextureIdStack.Capacity - drawList->_TextureIdStack.Size >= 1);
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+void StatefulCanvas::flushDeferred(ImDrawList *drawList, const ImVec2 &loc) const { // tessellate deferred_ in chunks across workers, spliced in order
+  int nChunks = ImMin(threads_ * 4, deferred_.size() / ParallelChunkMin); // more chunks than threads balances uneven primitive costs
+
+  if (nChunks < 2) {
+    for (int i = 0; i < deferred_.size(); ++i)
+      drawClipped(drawList, deferred_[i], loc);
+
+    deferred_.resize(0);
+    return;
+  }
+
+  if (!workers_) {
+    workers_           = IM_NEW(Workers)();
+    workers_->canvas   = this;
+    workers_->job      = 0;
+    workers_->busy     = 0;
+    workers_->quit     = false;
+    workers_->vertices = 0;
+    workers_->indices  = 0;
+    workers_->cmds     = 0;
+    workers_->points   = 0;
+
+    for (int t = 1; t < threads_; ++t)
+      workers_->threads.push_back(std::thread(workerMain, workers_));
+  }
+
+  while (chunks_.size() < nChunks) {
+    Chunk chunk;
+    chunk.drawList = IM_NEW(ImDrawList)(drawList->_Data);
+    chunk.geometry = IM_NEW(Geometry)();
+    chunks_.push_back(chunk);
+  }
+
+  Workers &workers = *workers_;
+  workers.nChunks  = nChunks;
+  workers.loc      = loc;
+  workers.clipRect = ImVec4(drawList->GetClipRectMin().x, drawList->GetClipRectMin().y, drawList->GetClipRectMax().x, drawList->GetClipRectMax().y);
+  workers.next     = 0;
+
+  for (int i = 0; i < deferred_.size(); ++i) { // text layouts and level of detail built here, as workers must not allocate
+    PrepareView(deferred_[i], drawList, view_);
+    workers.points = ImMax(workers.points, TessellationBound(deferred_[i], view_));
+  }
+
+  for (int c = 0; c < nChunks; ++c) { // presized here from earlier flushes -- a worker leaves primitives that may not fit to finishChunk()
+    Chunk      &chunk = chunks_[c];
+    ImDrawList *list  = chunk.drawList;
+    chunk.begin       = (int)((ImS64)deferred_.size() * c / nChunks);
+    chunk.end         = (int)((ImS64)deferred_.size() * (c + 1) / nChunks);
+    STATS_ONLY(chunk.stats.reset());
+    list->_ResetForNewFrame();
+    list->Flags = drawList->Flags;
+    list->PushTextureID(drawList->_TextureIdStack.size() > 0 ? drawList->_TextureIdStack.back() : nullptr);
+    list->PushClipRect(ImVec2(workers.clipRect.x, workers.clipRect.y), ImVec2(workers.clipRect.z, workers.clipRect.w));
+    list->VtxBuffer.reserve(workers.vertices + workers.vertices / 4 + workers.points * 4);
+    list->IdxBuffer.reserve(workers.indices + workers.indices / 4 + workers.points * 18);
+    list->CmdBuffer.reserve(workers.cmds + workers.cmds / 4 + 8);
+    list->_Path.reserve(workers.points);
+    list->_ClipRectStack.reserve(list->_ClipRectStack.size() + 2);
+    list->_TextureIdStack.reserve(list->_TextureIdStack.size() + 2);
+    chunk.geometry->vtx.reserve(list->VtxBuffer.Capacity);
+    chunk.geometry->idx.reserve(list->IdxBuffer.Capacity);
+    chunk.geometry->cmds.reserve(list->CmdBuffer.Capacity);
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(workers.mutex);
+    ++workers.job;
+    workers.busy = (int)workers.threads.size();
+  }
+
+  workers.start.notify_all();
+  tessellateChunks(workers);
+
+  {
+    std::unique_lock<std::mutex> lock(workers.mutex);
+
+    while (workers.busy > 0)
+      workers.finish.wait(lock);
+  }
+
+  for (int c = 0; c < nChunks; ++c) { // splice -- chunk order is draw order, whichever thread tessellated it
+    Chunk &chunk = chunks_[c];
+    finishChunk(chunk, loc, workers.clipRect);
+    workers.vertices = ImMax(workers.vertices, chunk.drawList->VtxBuffer.Size);
+    workers.indices  = ImMax(workers.indices, chunk.drawList->IdxBuffer.Size);
+    workers.cmds     = ImMax(workers.cmds, chunk.drawList->CmdBuffer.Size);
+    drawGeometry(drawList, *chunk.geometry, loc);
+    STATS_ONLY(stats_.add(chunk.stats));
+  }
+
+  deferred_.resize(0);
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+void StatefulCanvas::tessellateChunks(Workers &workers) const { // runs on pool threads too -- fills presized chunk draw lists, never growing them
+  STATS_ONLY(Stats *statsTarget = StatsTarget);
+
+  for (int c; (c = workers.next++) < workers.nChunks; ) {
+    Chunk      &chunk    = chunks_[c];
+    ImDrawList *drawList = chunk.drawList;
+    STATS_ONLY(StatsTarget = &chunk.stats);
+
+    for (chunk.resume = chunk.begin; chunk.resume < chunk.end; ++chunk.resume) {
+      if (!Fits(drawList, TessellationBound(deferred_[chunk.resume], view_)))
+        break;
+
+      drawClipped(drawList, deferred_[chunk.resume], workers.loc);
+    }
+
+    Geometry *geometry = chunk.geometry;
+    chunk.captured     = (chunk.resume == chunk.end) && (geometry->vtx.Capacity >= drawList->VtxBuffer.Size) &&
+                         (geometry->idx.Capacity >= drawList->IdxBuffer.Size) && (geometry->cmds.Capacity >= drawList->CmdBuffer.Size);
+
+    if (chunk.captured) {
+      geometry->loc = workers.loc;
+      captureGeometry(drawList, workers.clipRect, geometry);
+    }
+  }
+
+  STATS_ONLY(StatsTarget = statsTarget);
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+void StatefulCanvas::finishChunk(Chunk &chunk, const ImVec2 &loc, const ImVec4 &clipRect) const { // drawing thread -- serially, as the rest may grow
+  if (chunk.captured)
+    return;
+
+  STATS_ONLY(Stats *statsTarget = StatsTarget; StatsTarget = &chunk.stats);
+
+  for (; chunk.resume < chunk.end; ++chunk.resume)
+    drawClipped(chunk.drawList, deferred_[chunk.resume], loc);
+
+  chunk.geometry->loc = loc;
+  captureGeometry(chunk.drawList, clipRect, chunk.geometry);
+  chunk.captured = true;
+  STATS_ONLY(StatsTarget = statsTarget);
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+void StatefulCanvas::workerMain(Workers *workers) {
+  unsigned int job = 0;
+
+  for (;;) {
+    {
+      std::unique_lock<std::mutex> lock(workers->mutex);
+
+      while (!workers->quit && (workers->job == job))
+        workers->start.wait(lock);
+
+      if (workers->quit)
+        return;
+
+      job = workers->job;
+    }
+
+    workers->canvas->tessellateChunks(*workers);
+    std::lock_guard<std::mutex> lock(workers->mutex);
+
+    if (--workers->busy == 0)
+      workers->finish.notify_one();
+  }
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+void StatefulCanvas::stopWorkers() const { // and release chunks' draw lists
+  if (workers_) {
+    {
+      std::lock_guard<std::mutex> lock(workers_->mutex);
+      workers_->quit = true;
+    }
+
+    workers_->start.notify_all();
+
+    for (size_t t = 0; t < workers_->threads.size(); ++t)
+      workers_->threads[t].join();
+
+    IM_DELETE(workers_);
+    workers_ = nullptr;
+  }
+
+  for (int c = 0; c < chunks_.size(); ++c) {
+    IM_DELETE(chunks_[c].drawList);
+    IM_DELETE(chunks_[c].geometry);
+  }
+
+  chunks_.clear();
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+bool StatefulCanvas::drawCulled(ImDrawList *drawList, const ImVec2 &loc) const { // draw primitives found in visible_ grid cells, sorted into z order
+  ImS64 cells   = 0,
+        entries = 0;
+  int   x0, y0, x1, y1;
+
+  for (int g = 0; g < (int)groups_.size(); ++g) { // groups displaced by a z offset are drawn from displaced_
+    const Group &group = groups_[g];
+
+    if (!group.live || !group.composedVisible || (group.composedZ != 0))
+      continue;
+
+    int n = groupRange(g, visible_, &x0, &y0, &x1, &y1);
+
+    if (n < 0)
+      return false;
+
+    cells   += n;
+    entries += grids_[g].size();
+  }
+
+  if (cells > entries)
+    return false; // visiting view's cells would cost more than walking the z index
+
+  ++mark_;
+  candidates_.resize(0);
+
+  for (int g = 0; g < (int)groups_.size(); ++g) {
+    const Group &group = groups_[g];
+
+    if (!group.live || !group.composedVisible || (group.composedZ != 0)) {
+#ifdef STATEFUL_CANVAS_STATS
+      for (int i = 0; group.live && (i < group.members.size()); ++i)
+        countSkipped(drawList_[group.members[i]]);
+#endif
+      continue;
+    }
+
+    if (groupRange(g, visible_, &x0, &y0, &x1, &y1) > 0)
+      for (int y = y0; y <= y1; ++y)
+        for (int x = x0; x <= x1; ++x) {
+          Grid::const_iterator cell = grids_[g].find(gridKey(x, y));
+
+          if (cell == grids_[g].end())
+            continue;
+
+          for (int i = 0; i < cell->second.size(); ++i) {
+            int        s     = cell->second[i];
+            const Slot &slot = drawList_[s];
+
+            if (slot.mark == mark_)
+              continue;
+
+            slot.mark = mark_;
+
+            if (walked(slot) && inView(slot, loc))
+              candidates_.push_back({slot.z, slot.order, s});
+            STATS_ONLY(else countSkipped(slot));
+          }
+        }
+
+    for (int i = 0; i < group.unbounded.size(); ++i) {
+      const Slot &slot = drawList_[group.unbounded[i]];
+
+      if (walked(slot) && inView(slot, loc))
+        candidates_.push_back({slot.z, slot.order, group.unbounded[i]});
+      STATS_ONLY(else countSkipped(slot));
+    }
+  }
+
+  for (int i = 0; i < displaced_.size(); ++i)
+    if (inView(drawList_[displaced_[i].slot], loc))
+      candidates_.push_back(displaced_[i]);
+    STATS_ONLY(else ++stats_.culled);
+
+  std::sort(candidates_.begin(), candidates_.end(), drawnBefore);
+
+  STATS_ONLY(double layerStart = 0; int layerDrawn = 0;)
+
+  for (int i = 0; i < candidates_.size(); ++i) {
+    const Slot &slot = drawList_[candidates_[i].slot];
+    STATS_ONLY(if ((i == 0) || (candidates_[i - 1].z != candidates_[i].z)) { layerStart = StatsNow(); layerDrawn = stats_.drawn; })
+
+    if (!slot.dragged && slot.primitive->offsetZ) { // z offset set directly through Primitive -- drawn in place this frame
+      slot.dragged = true;
+      dragged_.push_back(candidates_[i].slot);
+    }
+
+    if (!batchByType_ && !sortByState_)
+      drawPrimitive(drawList, slot.primitive, loc);
+    else {
+      countState(slot.primitive);
+      batch_.push_back(slot.primitive);
+
+      if ((i + 1 == candidates_.size()) || (candidates_[i + 1].z != candidates_[i].z))
+        drawBatches(drawList, loc);
+    }
+
+    STATS_ONLY(if ((i + 1 == candidates_.size()) || (candidates_[i + 1].z != candidates_[i].z)) StatsLayer(stats_, candidates_[i].z, layerDrawn, layerStart));
+  }
+
+  return true;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+bool StatefulCanvas::inView(const Slot &slot, const ImVec2 &loc) const {
+  if ((slot.spatial == Spatial_None) || (slot.spatial == Spatial_Unbounded))
+    return true;
+
+  const Primitive *primitive = slot.primitive;
+  ImRect          bounds    = slot.bounds;
+  bounds.Translate(groupOffsets_[primitive->group]);
+
+  if (!bounds.Overlaps(visible_))
+    return false;
+
+  if (primitive->clip) { // screen space
+    const ImVec4 &clipRect = primitive->clipRect;
+    return bounds.Overlaps(ImRect((ImVec2(clipRect.x, clipRect.y) - loc) / view_.zoom, (ImVec2(clipRect.z, clipRect.w) - loc) / view_.zoom));
+  }
+
+  return true;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+int StatefulCanvas::groupRange(int g, const ImRect &area, int *x0, int *y0, int *x1, int *y1) const { // cells of group's grid under area -- -1 when too many
+  const Group &group = groups_[g];
+  ImRect      local  = area;
+  local.Translate(ImVec2(-groupOffsets_[g].x, -groupOffsets_[g].y));
+
+  if ((group.indexed == 0) || (grids_[g].size() == 0) || !touches(local, group.bounds))
+    return 0;
+
+  local.ClipWith(group.bounds); // overlaps, so no inversion
+
+  if (!gridRange(local, x0, y0, x1, y1))
+    return -1;
+
+  return (*x1 - *x0 + 1) * (*y1 - *y0 + 1);
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+bool StatefulCanvas::gridRange(const ImRect &rect, int *x0, int *y0, int *x1, int *y1) const {
+  const float maxCells = 1 << 20;
+  float       fx0      = floorf(rect.Min.x / cellSize_),
+              fy0      = floorf(rect.Min.y / cellSize_),
+              fx1      = floorf(rect.Max.x / cellSize_),
+              fy1      = floorf(rect.Max.y / cellSize_);
+
+  if (!((fx1 - fx0 + 1) * (fy1 - fy0 + 1) <= maxCells) || (fx0 < INT_MIN) || (fy0 < INT_MIN) || (fx1 > INT_MAX) || (fy1 > INT_MAX))
+    return false; // also rejects NaN
+
+  *x0 = (int)fx0;
+  *y0 = (int)fy0;
+  *x1 = (int)fx1;
+  *y1 = (int)fy1;
+  return true;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+void StatefulCanvas::indexBounds(int s) const { // in its group's grid, in group space
+  const int   maxCells  = 64; // larger primitives are tested individually on every query
+  const Slot  &slot     = drawList_[s];
+  Primitive   *primitive = slot.primitive;
+  const Group &group    = groups_[primitive->group];
+  int         x0, y0, x1, y1;
+
+  if (!primitive->bounds(&slot.bounds)) {
+    slot.spatial = Spatial_Unbounded;
+    group.unbounded.push_back(s);
+    return;
+  }
+
+  slot.bounds.Translate(ImVec2(primitive->offsetX, primitive->offsetY));
+
+  if (group.indexed++ == 0)
+    group.bounds = slot.bounds;
+  else
+    group.bounds.Add(slot.bounds);
+
+  if (!gridRange(slot.bounds, &x0, &y0, &x1, &y1) || ((x1 - x0 + 1) * (y1 - y0 + 1) > maxCells)) {
+    slot.spatial = Spatial_Oversized;
+    group.unbounded.push_back(s);
+    return;
+  }
+
+  slot.spatial = Spatial_Grid;
+  Grid &grid   = grids_[primitive->group];
+
+  for (int y = y0; y <= y1; ++y)
+    for (int x = x0; x <= x1; ++x)
+      grid[gridKey(x, y)].push_back(s);
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+void StatefulCanvas::unindexBounds(int s) const { // before the slot leaves its group
+  const Slot  &slot  = drawList_[s];
+  const Group &group = groups_[slot.primitive->group];
+
+  if (slot.spatial == Spatial_Grid) {
+    Grid &grid = grids_[slot.primitive->group];
+    int  x0, y0, x1, y1;
+    gridRange(slot.bounds, &x0, &y0, &x1, &y1);
+
+    for (int y = y0; y <= y1; ++y)
+      for (int x = x0; x <= x1; ++x) {
+        Grid::iterator cell = grid.find(gridKey(x, y));
+        cell->second.find_erase_unsorted(s);
+
+        if (cell->second.size() == 0)
+          grid.erase(cell);
+      }
+  }
+  else if (slot.spatial != Spatial_None)
+    group.unbounded.find_erase_unsorted(s);
+
+  if ((slot.spatial == Spatial_Grid) || (slot.spatial == Spatial_Oversized))
+    --group.indexed;
+
+  slot.spatial = Spatial_None;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+void StatefulCanvas::updateBounds() const { // reindex touched primitives
+  for (int i = 0; i < touched_.size(); ++i) {
+    const Slot &slot = drawList_[touched_[i]];
+    slot.touched     = false;
+    unindexBounds(touched_[i]);
+    indexBounds(touched_[i]);
+  }
+
+  touched_.resize(0);
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+StatefulCanvas::draw_idx_t StatefulCanvas::pick(const ImVec2 &point, float tolerance) const {
+  return pickHits(&point, tolerance, ImRect(point - ImVec2(tolerance, tolerance), point + ImVec2(tolerance, tolerance)), nullptr);
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+int StatefulCanvas::pick(const ImVec2 &point, float tolerance, ImVector<draw_idx_t> *hits) const {
+  hits->resize(0);
+  pickHits(&point, tolerance, ImRect(point - ImVec2(tolerance, tolerance), point + ImVec2(tolerance, tolerance)), hits);
+  return hits->size();
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+StatefulCanvas::draw_idx_t StatefulCanvas::pickRect(const ImVec2 &min, const ImVec2 &max) const {
+  return pickHits(nullptr, 0.0f, ImRect(ImMin(min, max), ImMax(min, max)), nullptr);
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+int StatefulCanvas::pickRect(const ImVec2 &min, const ImVec2 &max, ImVector<draw_idx_t> *hits) const {
+  hits->resize(0);
+  pickHits(nullptr, 0.0f, ImRect(ImMin(min, max), ImMax(min, max)), hits);
+  return hits->size();
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+void StatefulCanvas::pickCandidates(const ImRect &area) const { // visible primitives which may overlap area, from group grids when it's cheaper
+  int x0, y0, x1, y1;
+
+  candidates_.resize(0);
+  resolveGroups();
+
+  if (!spatialIndex_) {
+    for (int s = 0; s < slotsUsed_; ++s)
+      if (drawList_[s].primitive && mayOverlap(drawList_[s], area))
+        candidates_.push_back({drawnZ(drawList_[s]), drawList_[s].order, s});
+
+    return;
+  }
+
+  updateBounds();
+  ++mark_;
+
+  for (int g = 0; g < (int)groups_.size(); ++g) {
+    const Group &group = groups_[g];
+
+    if (!group.live || !group.composedVisible)
+      continue;
+
+    int n = groupRange(g, area, &x0, &y0, &x1, &y1);
+
+    if ((n < 0) || (n > (int)grids_[g].size())) { // visiting cells would cost more than testing members
+      for (int i = 0; i < group.members.size(); ++i) {
+        const Slot &slot = drawList_[group.members[i]];
+
+        if (mayOverlap(slot, area))
+          candidates_.push_back({drawnZ(slot), slot.order, group.members[i]});
+      }
+
+      continue;
+    }
+
+    for (int y = y0; (n > 0) && (y <= y1); ++y)
+      for (int x = x0; x <= x1; ++x) {
+        Grid::const_iterator cell = grids_[g].find(gridKey(x, y));
+
+        if (cell == grids_[g].end())
+          continue;
+
+        for (int i = 0; i < cell->second.size(); ++i) {
+          int        s     = cell->second[i];
+          const Slot &slot = drawList_[s];
+
+          if (slot.mark == mark_)
+            continue;
+
+          slot.mark = mark_;
+
+          if (mayOverlap(slot, area))
+            candidates_.push_back({drawnZ(slot), slot.order, s});
+        }
+      }
+
+    for (int i = 0; i < group.unbounded.size(); ++i) {
+      const Slot &slot = drawList_[group.unbounded[i]];
+
+      if (mayOverlap(slot, area))
+        candidates_.push_back({drawnZ(slot), slot.order, group.unbounded[i]});
+    }
+  }
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+StatefulCanvas::draw_idx_t StatefulCanvas::pickHits(const ImVec2 *point, float tolerance, const ImRect &area, ImVector<draw_idx_t> *hits) const {
+  pickCandidates(area);
+
+  std::sort(candidates_.begin(), candidates_.end(), drawnAfter); // topmost first
+
+  draw_idx_t topmost = DRAW_IDX_NONE;
+
+  for (int i = 0; i < candidates_.size(); ++i) {
+    const Slot      &slot     = drawList_[candidates_[i].slot];
+    const Primitive *primitive = slot.primitive;
+    ImVec2          offset   = ImVec2(primitive->offsetX, primitive->offsetY) + groupOffsets_[primitive->group];
+    ImRect          rect(area.Min - offset, area.Max - offset);
+
+    if (point ? !primitive->hitPoint(*point - offset, tolerance) : !primitive->hitRect(rect))
+      continue;
+
+    draw_idx_t idx = handle(candidates_[i].slot, slot.generation);
+
+    if (topmost == DRAW_IDX_NONE)
+      topmost = idx;
+
+    if (!hits)
+      break;
+
+    hits->push_back(idx);
+  }
+
+  return topmost;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+void StatefulCanvas::zoom(float factor, const ImVec2 &pivot) {
+  assert(factor > 0.0f);
+  ImVec2 point = toCanvas(pivot);
+  view_.zoom  *= factor;
+  view_.pan    = pivot - drawLocation_ - point * view_.zoom;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+void StatefulCanvas::invalidate() {
+  for (int i = 0; i < (int)zIndex_.size(); ++i)
+    zIndex_[i].dirty = true;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+void StatefulCanvas::cacheGeometry(bool state) {
+  cacheGeometry_ = state;
+
+  for (int i = 0; (i < (int)zIndex_.size()) && !state; ++i) {
+    IM_DELETE(zIndex_[i].geometry);
+    zIndex_[i].geometry = nullptr;
+  }
+
+  if (!state && cacheDrawList_) {
+    IM_DELETE(cacheDrawList_);
+    cacheDrawList_ = nullptr;
+  }
+
+  invalidate();
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+void StatefulCanvas::parallelDraw(int threads) {
+  assert(threads >= 1);
+
+  if (threads != threads_)
+    stopWorkers();
+
+  threads_ = threads;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+void StatefulCanvas::dirtyZ(int z) const {
+  int l = findZLayer(z);
+
+  if ((l < (int)zIndex_.size()) && (zIndex_[l].z == z))
+    zIndex_[l].dirty = true;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+void StatefulCanvas::erase(draw_idx_t idx) { // stale handles are ignored
+  eraseSlot(idx);
+
+  if (compactDue())
+    compact();
+  else if (packStringsDue())
+    packStrings();
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+void StatefulCanvas::eraseSlot(draw_idx_t idx) {
+  Slot *slot = findSlot(idx);
+
+  if (!slot)
+    return;
+
+  int z = slot->z;
+
+  if (slot->dragged) {
+    dragged_.find_erase_unsorted(slotIndex(idx));
+    slot->dragged = false;
+  }
+
+  if (slot->touched) {
+    touched_.find_erase_unsorted(slotIndex(idx));
+    slot->touched = false;
+  }
+
+  if (slot->spatial != Spatial_None)
+    unindexBounds(slotIndex(idx));
+
+  leaveGroup(slotIndex(idx));
+  destroy(slot->primitive);
+  slot->primitive  = nullptr; // invalidates z layer entry
+  slot->generation = (slot->generation + 1) & 0x7FFFFFFF; // invalidates outstanding handles
+  slot->nextFree   = freeSlot_;
+  freeSlot_        = slotIndex(idx);
+  unindexZ(z);
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+void StatefulCanvas::clear() { // handles from before clear() stay stale -- see addToDrawList()
+  for (int i = 0; (i < slotsUsed_) && (ownsMemory_ > 0); ++i) { // primitives without strings or point arrays are released with their pool blocks
+    Primitive *primitive = drawList_[i].primitive;
+
+    if (primitive && poolOwnsMemory(primitive->type)) {
+      if (primitive->type == PrimitiveType_Custom)
+        delete primitive;
+      else
+        primitive->~Primitive();
+
+      --ownsMemory_;
+    }
+  }
+
+  for (int i = 0; i < PrimitiveType_MAX; ++i) {
+    Pool &pool    = pools_[i];
+    pool.block    = 0;
+    pool.used     = 0;
+    pool.freeList = nullptr;
+  }
+
+  strings_.block = 0;
+  strings_.used  = 0;
+  strings_.bytes = 0;
+  strings_.dead  = 0;
+
+  for (int i = 0; i < (int)zIndex_.size(); ++i) // entries go with the layers
+    IM_DELETE(zIndex_[i].geometry);
+
+  for (int i = 0; i < (int)groups_.size(); ++i) { // groups outlive clear() -- only their members go
+    groups_[i].members.clear();
+    groups_[i].unbounded.clear();
+    groups_[i].indexed = 0;
+    grids_[i].clear();
+  }
+
+  ClipRects stacked; // clip rects outlive clear() only while pushed
+
+  for (int i = 0; i < clipRectStack_.size(); ++i)
+    stacked.push_back(clipRects_[clipRectStack_[i]]);
+
+  clipRects_.clear();
+  clipRectTable_.clear();
+
+  for (int i = 0; i < stacked.size(); ++i)
+    clipRectStack_[i] = internClipRect(stacked[i]);
+
+  freeSlot_  = -1;
+  slotsUsed_ = 0;
+
+  ImU64 epoch = (queue_->state.load() >> 32) + 1; // reserved handles went with their slots
+  queue_->windows[epoch & 1].count.store(0, std::memory_order_relaxed);
+  queue_->state.store(epoch << 32, std::memory_order_release);
+  zIndex_.clear();
+  dragged_.clear();
+  displacedStale_ = true;
+  ingests_.clear();
+  ingestItems_ = 0;
+  ingestDone_  = 0;
+  touched_.clear();
+  compactedHoles_ = 0;
+  refillReserve(); // a fresh window for queued adds
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+template<typename T>
+static void ShrinkToFit(ImVector<T> &vector) { // ImVector keeps its capacity otherwise
+  if (vector.Capacity == vector.Size)
+    return;
+
+  ImVector<T> fitted;
+  fitted.reserve(vector.Size);
+  fitted.resize(vector.Size);
+
+  if (vector.Size > 0)
+    memcpy((void *)fitted.Data, (const void *)vector.Data, vector.size_in_bytes());
+
+  vector.swap(fitted);
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+void StatefulCanvas::compact() { // handles index slots, which stay put -- what they point to is packed behind them
+  int live[PrimitiveType_MAX] = {},
+      liveSlots               = 0;
+
+  for (int i = 0; i < slotsUsed_; ++i)
+    if (Primitive *primitive = drawList_[i].primitive) {
+      ++live[primitive->type];
+      ++liveSlots;
+    }
+
+  void         *blocks[PrimitiveType_MAX]    = {}; // replacing a pool's, sized to its live primitives
+  int          carved[PrimitiveType_MAX]     = {};
+  RelocateFunc relocators[PrimitiveType_MAX] = {};
+
+  for (int t = 0; t < PrimitiveType_MAX; ++t) // custom primitives, and registered types without a move constructor, are left in place
+    if ((live[t] > 0) && (relocators[t] = relocateFunc(t)))
+      blocks[t] = allocFunc_((size_t)pools_[t].objectSize * live[t], allocUserData_);
+
+  for (int l = 0; l < (int)zIndex_.size(); ++l) { // refilled in draw order
+    ZLayer &layer = zIndex_[l];
+    compactZLayer(layer);
+    ShrinkToFit(layer.lowered);
+    ShrinkToFit(layer.raised);
+
+    for (int e = -layer.lowered.size(); e < layer.raised.size(); ++e) { // lowered in reverse, then raised
+      Slot      &slot      = drawList_[(e < 0) ? layer.lowered[-1 - e].slot : layer.raised[e].slot];
+      Primitive *primitive = slot.primitive;
+      int       type       = primitive->type;
+
+      if (blocks[type])
+        slot.primitive = primitive = relocators[type](primitive, (char *)blocks[type] + (size_t)pools_[type].objectSize * carved[type]++);
+    }
+  }
+
+  for (int t = 0; t < PrimitiveType_MAX; ++t) {
+    Pool &pool = pools_[t];
+    assert(carved[t] == (blocks[t] ? live[t] : 0));
+
+    if (!blocks[t] && (live[t] > 0))
+      continue;
+
+    for (int b = 0; b < pool.blocks.size(); ++b)
+      freeFunc_(pool.blocks[b], allocUserData_);
+
+    pool.blocks.clear();
+    pool.capacities.clear();
+    pool.block    = 0;
+    pool.used     = 0;
+    pool.freeList = nullptr;
+
+    if (blocks[t]) { // full, so the next add opens a new block
+      pool.blocks.push_back(blocks[t]);
+      pool.capacities.push_back(live[t]);
+      pool.used = live[t];
+    }
+  }
+
+  packStrings();
+
+  ImVector<char> freed; // slots on the free list -- others without a primitive are reserved for queued adds
+  freed.resize(slotsUsed_, 0);
+
+  for (int i = freeSlot_; i >= 0; i = drawList_[i].nextFree)
+    freed[i] = 1;
+
+  int used = slotsUsed_;
+
+  while ((used > 0) && freed[used - 1])
+    --used;
+
+  for (int i = used; i < drawList_.size(); ++i) // dropped, including those released by clear()
+    slotGeneration_ = ImMax(slotGeneration_, (drawList_[i].generation + 1) & 0x7FFFFFFF);
+
+  drawList_.resize(used);
+  ShrinkToFit(drawList_);
+  slotsUsed_ = used;
+  freeSlot_  = -1;
+
+  for (int i = used - 1; i >= 0; --i) // lowest first, so adds fill from the front
+    if (freed[i]) {
+      drawList_[i].nextFree = freeSlot_;
+      freeSlot_             = i;
+    }
+
+  compactedHoles_ = slotsUsed_ - liveSlots;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+bool StatefulCanvas::packStringsDue() const {
+  return (strings_.dead >= StringsPackMin) && (strings_.dead >= strings_.bytes / 2);
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+void StatefulCanvas::packStrings() { // in slot order -- primitives stay put
+  int bytes = strings_.bytes - strings_.dead;
+  assert(bytes >= 0);
+  char *strings = bytes ? (char *)allocFunc_(bytes, allocUserData_) : nullptr;
+  int  used     = 0;
+
+  for (int i = 0; i < slotsUsed_; ++i)
+    if (String *string = drawList_[i].primitive ? findString(drawList_[i].primitive) : nullptr) {
+      int length = (int)(string->stringEnd - string->string);
+      assert(used + length + 1 <= bytes);
+      memcpy(strings + used, string->string, length + 1);
+      string->string     = strings + used;
+      string->stringEnd  = string->string + length;
+      used              += length + 1;
+    }
+
+  assert(used == bytes);
+
+  for (int b = 0; b < strings_.blocks.size(); ++b)
+    freeFunc_(strings_.blocks[b], allocUserData_);
+
+  strings_.blocks.clear();
+  strings_.capacities.clear();
+  strings_.block = 0;
+  strings_.used  = 0;
+  strings_.bytes = used;
+  strings_.dead  = 0;
+
+  if (strings) { // full, so the next string opens a new block
+    strings_.blocks.push_back(strings);
+    strings_.capacities.push_back(bytes);
+    strings_.used = bytes;
+  }
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+bool StatefulCanvas::compactDue() const { // holes made since the last compact() exceed the autoCompact() share of slots in use
+  if ((compactRatio_ <= 0.0f) || (slotsUsed_ < CompactMinSlots))
+    return false;
+
+  int live = 0;
+
+  for (int l = 0; l < (int)zIndex_.size(); ++l)
+    live += zIndex_[l].live;
+
+  return (slotsUsed_ - live - compactedHoles_) > (int)(compactRatio_ * slotsUsed_);
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+StatefulCanvas::MemoryUsage StatefulCanvas::memoryUsage() const {
+  MemoryUsage usage;
+  memset(&usage, 0, sizeof(usage));
+
+  for (int t = 0; t < PrimitiveType_MAX; ++t)
+    for (int b = 0; b < pools_[t].blocks.size(); ++b)
+      usage.primitives[t] += (size_t)pools_[t].objectSize * pools_[t].capacities[b];
+
+  for (int b = 0; b < strings_.blocks.size(); ++b)
+    usage.strings += strings_.capacities[b];
+
+  for (int i = freeSlot_; i >= 0; i = drawList_[i].nextFree)
+    ++usage.freeSlots;
+
+  for (int i = 0; i < slotsUsed_; ++i) {
+    Primitive *primitive = drawList_[i].primitive;
+
+    if (!primitive)
+      continue;
+
+    ++usage.live[primitive->type];
+
+    if (Points *points = findPoints(primitive))
+      usage.points += points->points.Capacity * sizeof(ImVec2);
+
+    if (Lod *lod = findLod(primitive))
+      usage.points += lod->lodCache.Capacity * sizeof(ImVec2);
+
+    if (primitive->type == PrimitiveType_StreamingPolyline)
+      usage.points += static_cast<StreamingPolyline *>(primitive)->ring.Capacity * sizeof(ImVec2);
+
+    if (TextLayout *layout = findTextLayout(primitive))
+      usage.layouts += layout->glyphs.Capacity * sizeof(TextLayout::Glyph);
+  }
+
+  int live = 0;
+
+  for (int t = 0; t < PrimitiveType_MAX; ++t)
+    live += usage.live[t];
+
+  usage.reservedSlots = slotsUsed_ - live - usage.freeSlots;
+  usage.slots         = drawList_.Capacity * sizeof(Slot);
+  usage.index         = zIndex_.capacity() * sizeof(ZLayer) + groups_.capacity() * sizeof(Group) + clipRects_.Capacity * sizeof(ImVec4) +
+                        (dragged_.Capacity + touched_.Capacity) * sizeof(int) + displaced_.Capacity * sizeof(Displaced);
+  usage.geometry     += groupRuns_.Capacity * sizeof(GroupRun);
+
+  for (int l = 0; l < (int)zIndex_.size(); ++l) {
+    const ZLayer &layer = zIndex_[l];
+    usage.index += (layer.lowered.Capacity + layer.raised.Capacity) * sizeof(ZEntry);
+
+    if (const Geometry *geometry = layer.geometry)
+      usage.geometry += sizeof(Geometry) + geometry->vtx.Capacity * sizeof(ImDrawVert) + geometry->idx.Capacity * sizeof(ImDrawIdx) +
+                        geometry->cmds.Capacity * sizeof(CachedCmd);
+  }
+
+  usage.index += grids_.capacity() * sizeof(Grid) + clipRectTable_.bucket_count() * sizeof(void *) + // hash tables -- nodes estimated as entry and two pointers
+                 clipRectTable_.size() * (sizeof(ClipRectTable::value_type) + 2 * sizeof(void *));
+
+  for (int g = 0; g < (int)groups_.size(); ++g) {
+    const Grid &grid = grids_[g];
+    usage.index += (groups_[g].members.Capacity + groups_[g].unbounded.Capacity) * sizeof(int) + grid.bucket_count() * sizeof(void *) +
+                   grid.size() * (sizeof(Grid::value_type) + 2 * sizeof(void *));
+
+    for (const auto &cell : grid)
+      usage.index += cell.second.Capacity * sizeof(int);
+  }
+
+  for (const auto &bucket : clipRectTable_)
+    usage.index += bucket.second.Capacity * sizeof(int);
+
+  usage.total = usage.points + usage.strings + usage.layouts + usage.slots + usage.index + usage.geometry;
+
+  for (int t = 0; t < PrimitiveType_MAX; ++t)
+    usage.total += usage.primitives[t];
+
+  return usage;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+// Snapshot file, little-endian: header, records in draw order, then the tables the header locates -- written in one pass, so tables come last.
+// Each record is a SnapshotRecord followed by its primitive's fields (see SnapshotFields()) and padded to 8 bytes. load() maps the file and
+// copies each record's fields into a pooled primitive -- fields are fixed size, with counts ahead of the point arrays and strings it copies out.
+// Custom and registered primitives carry SaveCustomFunc's payload instead -- registered types as PrimitiveType_COUNT, keyed by registerPrimitiveType()'s
+// typeId rather than by their PrimitiveType, which is numbered in each process's order of first use.
+
+static const char  SnapshotMagic[8] = {'I', 'm', 'C', 'a', 'n', 'v', 'a', 's'};
+static const ImU32 SnapshotVersion  = 1,
+                   SnapshotByteOrder = 0x01020304; // reads back differently on other byte orders
+static const int   SnapshotFlushSize = 1024 * 1024; // bytes buffered between writes
+
+struct SnapshotHeader {
+  char  magic[8];
+  ImU32 version,
+        byteOrder,
+        types, // entries in primitive counts table -- PrimitiveType_COUNT + 1 when written, registered types counted together last
+        clipRects,
+        layers,
+        reserved;
+  ImU64 primitives,
+        recordsOffset,
+        recordsSize,
+        typesOffset,     // ImU32 primitives of each PrimitiveType
+        clipRectsOffset, // ImVec4 each -- records index them
+        layersOffset;    // SnapshotLayer each, in z order
+};
+
+struct SnapshotLayer {
+  ImS32 z;
+  ImU32 count; // records
+};
+
+struct SnapshotRecord {
+  ImU8  type,
+        flags; // SnapshotFlags
+  ImU16 reserved;
+  ImU32 size; // bytes, this header included
+  ImS32 clipRect;
+  ImU32 customType; // from SaveCustomFunc
+};
+
+enum SnapshotFlags {
+  SnapshotFlags_Visible = 1,
+  SnapshotFlags_Clip    = 2
+};
+
+static_assert(sizeof(SnapshotHeader) == 80);
+static_assert(sizeof(SnapshotRecord) == 16);
+
+static bool InFile(size_t size, ImU64 offset, ImU64 bytes) { // bytes at offset lie within a file of size
+  return (offset <= size) && (bytes <= size - offset);
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+static bool LittleEndian() {
+  ImU32 one = 1;
+  return *(unsigned char *)&one == 1;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+struct StatefulCanvas::SnapshotWriter { // appends fields to a record
+  // methods
+  template<typename T>
+  void operator()(const T &value) { append(&value, sizeof(value)); }
+  void append(const void *data, size_t size) {
+    int at = buffer->size();
+    buffer->resize(at + (int)size);
+
+    if (size > 0) // data may be null
+      memcpy(buffer->Data + at, data, size);
+  }
+  void string(const String *string) {
+    ImU32 length = (ImU32)(string->stringEnd - string->string);
+    (*this)(length);
+    append(string->string, length);
+  }
+  void points(const ImVector<ImVec2> &points) {
+    (*this)((ImU32)points.size());
+    append(points.Data, points.size() * sizeof(ImVec2));
+  }
+  void flag(bool value) { (*this)((ImU8)value); }
+  template<typename T>
+  void unsaved(T *) { } // client memory
+  void texture(ImTextureID texture) { (*this)((ImU64)(intptr_t)texture); } // as is -- textures must keep their ids between runs
+  void font(const ImFont *font) { // index in font atlas -- -1 for the current font
+    const ImVector<ImFont *> &fonts = ImGui::GetIO().Fonts->Fonts;
+    (*this)(font ? (int)(fonts.find(const_cast<ImFont *>(font)) - fonts.begin()) : -1);
+  }
+  void stream(const StreamingPolyline *stream) { // points oldest first -- a client span is saved, and loaded, as an owned ring
+    (*this)(stream->count + ImMin(stream->capacity - stream->count, StreamSlackMax)); // capacity -- what a load accepts
+    (*this)(stream->count);
+
+    for (int i = 0; i < stream->count; ++i)
+      (*this)(stream->sample(i));
+  }
+  template<typename T>
+  static void save(SnapshotWriter &writer, Primitive *primitive);
+
+  // data members
+  ImVector<unsigned char> *buffer;
+};
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+struct StatefulCanvas::SnapshotReader { // takes fields from a mapped record -- reading past its end fails the load, leaving zeroes
+  // methods
+  bool take(size_t size) {
+    failed = failed || ((size_t)(end - at) < size);
+    return !failed;
+  }
+  template<typename T>
+  void operator()(T &value) {
+    if (take(sizeof(value))) {
+      memcpy(&value, at, sizeof(value));
+      at += sizeof(value);
+    }
+    else
+      value = T();
+  }
+  void string(String *string) {
+    ImU32 length = 0;
+    (*this)(length);
+    const char *text = take(length) ? (const char *)at : "";
+    length           = failed ? 0 : length;
+    string->string    = canvas->storeString(text, text + length);
+    string->stringEnd = string->string + length;
+    at               += length;
+  }
+  void points(ImVector<ImVec2> &points) {
+    ImU32 n = 0;
+    (*this)(n);
+
+    if (take((size_t)n * sizeof(ImVec2)) && (n > 0)) {
+      points.resize((int)n);
+      memcpy(points.Data, at, (size_t)n * sizeof(ImVec2));
+      at += (size_t)n * sizeof(ImVec2);
+    }
+  }
+  void flag(bool &value) {
+    ImU8 byte = 0;
+    (*this)(byte);
+    value = byte != 0;
+  }
+  template<typename T>
+  void unsaved(T *&pointer) { pointer = nullptr; }
+  void texture(ImTextureID &texture) {
+    ImU64 id = 0;
+    (*this)(id);
+    texture = (ImTextureID)(intptr_t)id;
+  }
+  void font(const ImFont *&font) {
+    int index = -1;
+    (*this)(index);
+    const ImVector<ImFont *> &fonts = ImGui::GetIO().Fonts->Fonts;
+    font = ((index >= 0) && (index < fonts.size())) ? fonts[index] : nullptr;
+  }
+  void stream(StreamingPolyline *stream) {
+    int capacity = 0,
+        count    = 0;
+    (*this)(capacity);
+    (*this)(count);
+    failed = failed || (capacity <= 0) || (count < 0) || (count > capacity) || (capacity - count > StreamSlackMax) || !take((size_t)count * sizeof(ImVec2));
+    stream->ring.resize(failed ? 1 : capacity);
+    stream->span(stream->ring.Data, stream->ring.size(), 0, 0);
+
+    for (int i = 0; (i < count) && !failed; ++i) {
+      ImVec2 point;
+      (*this)(point);
+      stream->append(&point, 1);
+    }
+  }
+  template<typename T>
+  static Primitive *load(SnapshotReader &reader, PrimitiveType type);
+
+  // data members
+  StatefulCanvas      *canvas;
+  const unsigned char *at,
+                      *end;
+  bool                failed;
+};
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+// Fields of each built-in type, in record order -- shared by SnapshotWriter (which only reads them) and SnapshotReader.
+
+template<typename Io> static void SnapshotFields(Io &io, StatefulCanvas::Line *p) { io(p->p0); io(p->p1); io(p->color); io(p->thickness); }
+template<typename Io> static void SnapshotFields(Io &io, StatefulCanvas::Rect *p) {
+  io(p->p0); io(p->p1); io(p->color); io(p->rounding); io(p->cornerFlags); io(p->thickness);
+}
+template<typename Io> static void SnapshotFields(Io &io, StatefulCanvas::RectFilled *p) {
+  io(p->p0); io(p->p1); io(p->color); io(p->rounding); io(p->cornerFlags);
+}
+template<typename Io> static void SnapshotFields(Io &io, StatefulCanvas::RectFilledMultiColor *p) {
+  io(p->p0); io(p->p1); io(p->color0); io(p->color1); io(p->color2); io(p->color3);
+}
+template<typename Io> static void SnapshotFields(Io &io, StatefulCanvas::Quad *p) {
+  io(p->p0); io(p->p1); io(p->p2); io(p->p3); io(p->color); io(p->thickness);
+}
+template<typename Io> static void SnapshotFields(Io &io, StatefulCanvas::QuadFilled *p) { io(p->p0); io(p->p1); io(p->p2); io(p->p3); io(p->color); }
+template<typename Io> static void SnapshotFields(Io &io, StatefulCanvas::Triangle *p) { io(p->p0); io(p->p1); io(p->p2); io(p->color); io(p->thickness); }
+template<typename Io> static void SnapshotFields(Io &io, StatefulCanvas::TriangleFilled *p) { io(p->p0); io(p->p1); io(p->p2); io(p->color); }
+template<typename Io> static void SnapshotFields(Io &io, StatefulCanvas::Circle *p) {
+  io(p->center); io(p->radius); io(p->color); io(p->segments); io(p->thickness);
+}
+template<typename Io> static void SnapshotFields(Io &io, StatefulCanvas::CircleFilled *p) { io(p->center); io(p->radius); io(p->color); io(p->segments); }
+template<typename Io> static void SnapshotFields(Io &io, StatefulCanvas::Ngon *p) {
+  io(p->center); io(p->radius); io(p->color); io(p->segments); io(p->thickness);
+}
+template<typename Io> static void SnapshotFields(Io &io, StatefulCanvas::NgonFilled *p) { io(p->center); io(p->radius); io(p->color); io(p->segments); }
+template<typename Io> static void SnapshotFields(Io &io, StatefulCanvas::Text *p) { io(p->p); io(p->color); io.string(p); }
+template<typename Io> static void SnapshotFields(Io &io, StatefulCanvas::Text2 *p) {
+  io(p->p); io(p->color); io.font(p->font); io(p->fontSize); io(p->wrapWidth); io.unsaved(p->cpuFineClipRect); io.string(p);
+}
+template<typename Io> static void SnapshotFields(Io &io, StatefulCanvas::Polyline *p) {
+  io(p->color); io(p->thickness); io.flag(p->closed); io(p->lodMode); io(p->lodTolerance); io.points(p->points);
+}
+template<typename Io> static void SnapshotFields(Io &io, StatefulCanvas::ConvexPolyFilled *p) {
+  io(p->color); io(p->lodMode); io(p->lodTolerance); io.points(p->points);
+}
+template<typename Io> static void SnapshotFields(Io &io, StatefulCanvas::BezierCurve *p) {
+  io(p->p0); io(p->p1); io(p->p2); io(p->p3); io(p->color); io(p->thickness); io(p->segments);
+}
+template<typename Io> static void SnapshotFields(Io &io, StatefulCanvas::Image *p) {
+  io.texture(p->textureId); io(p->p0); io(p->p1); io(p->uv0); io(p->uv1); io(p->color);
+}
+template<typename Io> static void SnapshotFields(Io &io, StatefulCanvas::ImageQuad *p) {
+  io.texture(p->textureId); io(p->p0); io(p->p1); io(p->p2); io(p->p3); io(p->uv0); io(p->uv1); io(p->uv2); io(p->uv3); io(p->color);
+}
+template<typename Io> static void SnapshotFields(Io &io, StatefulCanvas::ImageRounded *p) {
+  io.texture(p->textureId); io(p->p0); io(p->p1); io(p->uv0); io(p->uv1); io(p->color); io(p->rounding); io(p->cornerFlags);
+}
+template<typename Io> static void SnapshotFields(Io &io, StatefulCanvas::StreamingPolyline *p) {
+  io(p->color); io(p->thickness); io(p->origin); io.stream(p);
+}
+
+template<typename T>
+void StatefulCanvas::SnapshotWriter::save(SnapshotWriter &writer, Primitive *primitive) {
+  SnapshotFields(writer, static_cast<T *>(primitive));
+}
+
+template<typename T>
+StatefulCanvas::Primitive *StatefulCanvas::SnapshotReader::load(SnapshotReader &reader, PrimitiveType type) {
+  T *primitive = reader.canvas->allocate<T>(type);
+  SnapshotFields(reader, primitive);
+  return primitive;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+struct MappedFile { // read only view of a whole file
+  const unsigned char *data;
+  size_t              size;
+};
+
+static bool MapFile(const char *path, MappedFile *file) {
+  file->data = nullptr;
+  file->size = 0;
+#ifdef _WIN32
+  HANDLE handle = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+  LARGE_INTEGER size;
+
+  if (handle == INVALID_HANDLE_VALUE)
+    return false;
+
+  if (GetFileSizeEx(handle, &size) && (size.QuadPart > 0)) {
+    HANDLE mapping = CreateFileMappingA(handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+
+    if (mapping) {
+      file->data = (const unsigned char *)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+      file->size = file->data ? (size_t)size.QuadPart : 0;
+      CloseHandle(mapping); // the view keeps it open
+    }
+  }
+
+  CloseHandle(handle);
+#else
+  int         fd = open(path, O_RDONLY);
+  struct stat status;
+
+  if (fd < 0)
+    return false;
+
+  if ((fstat(fd, &status) == 0) && (status.st_size > 0)) {
+    void *data = mmap(nullptr, (size_t)status.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+    if (data != MAP_FAILED) {
+      madvise(data, (size_t)status.st_size, MADV_SEQUENTIAL);
+      file->data = (const unsigned char *)data;
+      file->size = (size_t)status.st_size;
+    }
+  }
+
+  close(fd);
+#endif
+  return file->data != nullptr;
+}
+
+static void UnmapFile(MappedFile *file) {
+#ifdef _WIN32
+  UnmapViewOfFile(file->data);
+#else
+  munmap((void *)file->data, file->size);
+#endif
+  file->data = nullptr;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+void StatefulCanvas::snapshotCustom(SaveCustomFunc saveFunc, LoadCustomFunc loadFunc, void *userData) {
+  saveCustom_       = saveFunc;
+  loadCustom_       = loadFunc;
+  snapshotUserData_ = userData;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+bool StatefulCanvas::save(const char *path) const {
+  static void (*const saveFuncs[])(SnapshotWriter &writer, Primitive *primitive) = { // indexed by PrimitiveType
+    SnapshotWriter::save<Line>, SnapshotWriter::save<Rect>, SnapshotWriter::save<RectFilled>, SnapshotWriter::save<RectFilledMultiColor>,
+    SnapshotWriter::save<Quad>, SnapshotWriter::save<QuadFilled>, SnapshotWriter::save<Triangle>, SnapshotWriter::save<TriangleFilled>,
+    SnapshotWriter::save<Circle>, SnapshotWriter::save<CircleFilled>, SnapshotWriter::save<Ngon>, SnapshotWriter::save<NgonFilled>,
+    SnapshotWriter::save<Text>, SnapshotWriter::save<Text2>, SnapshotWriter::save<Polyline>, SnapshotWriter::save<ConvexPolyFilled>,
+    SnapshotWriter::save<BezierCurve>, SnapshotWriter::save<Image>, SnapshotWriter::save<ImageQuad>, SnapshotWriter::save<ImageRounded>,
+    SnapshotWriter::save<StreamingPolyline>
+  };
+  static_assert(IM_ARRAYSIZE(saveFuncs) == PrimitiveType_Custom);
+
+  if (!LittleEndian()) // byte swapping isn't implemented
+    return false;
+
+  FILE *file = fopen(path, "wb");
+
+  if (!file)
+    return false;
+
+  SnapshotHeader          header = {};
+  ImU32                   counts[PrimitiveType_COUNT + 1] = {};
+  ImVector<SnapshotLayer> layers;
+  ImVector<unsigned char> buffer,
+                          custom;
+  SnapshotWriter          writer = {&buffer};
+  memcpy(header.magic, SnapshotMagic, sizeof(header.magic));
+  header.version       = SnapshotVersion;
+  header.byteOrder     = SnapshotByteOrder;
+  header.types         = IM_ARRAYSIZE(counts);
+  header.clipRects     = clipRects_.size();
+  header.recordsOffset = sizeof(header);
+  bool  ok             = fwrite(&header, sizeof(header), 1, file) == 1; // placeholder -- rewritten once tables are placed
+  ImU64 offset         = sizeof(header);
+
+  for (int l = 0; l < (int)zIndex_.size(); ++l) {
+    const ZLayer  &layer = zIndex_[l];
+    SnapshotLayer saved  = {layer.z, 0};
+
+    for (int pass = 0; pass < 2; ++pass) { // as drawZLayer() walks it
+      const ImVector<ZEntry> &entries = pass ? layer.raised : layer.lowered;
+
+      for (int e = 0; e < entries.size(); ++e) {
+        const ZEntry &entry = pass ? entries[e] : entries[entries.size() - 1 - e];
+
+        if (!validZEntry(entry))
+          continue;
+
+        Primitive      *primitive = drawList_[entry.slot].primitive;
+        int            type       = ImMin((int)primitive->type, (int)PrimitiveType_COUNT);
+        SnapshotRecord record     = {(ImU8)type, 0, 0, 0, stateClipRect(primitive), 0};
+        record.flags              = (primitive->visible ? SnapshotFlags_Visible : 0) | (primitive->clip ? SnapshotFlags_Clip : 0);
+
+        if (type >= PrimitiveType_Custom) { // registered types too -- their fields are client code's
+          ImU32 typeId = (type == PrimitiveType_COUNT) ? typeIds_[primitive->type - PrimitiveType_COUNT] : 0;
+          custom.resize(0);
+
+          if ((type == PrimitiveType_COUNT) && !typeId)
+            continue;
+
+          record.customType = typeId;
+
+          if (!saveCustom_ || !saveCustom_(primitive, &record.customType, &custom, snapshotUserData_))
+            continue;
+
+          assert(!typeId || (record.customType == typeId)); // registered types are saved under registerPrimitiveType()'s typeId
+        }
+
+        int start = buffer.size();
+        writer(record);
+
+        if (type >= PrimitiveType_Custom)
+          writer.append(custom.Data, custom.size());
+        else
+          saveFuncs[type](writer, primitive);
+
+        buffer.resize((buffer.size() + 7) & ~7, 0);
+        record.size = (ImU32)(buffer.size() - start);
+        memcpy(buffer.Data + start, &record, sizeof(record));
+        ++saved.count;
+        ++counts[type];
+        ++header.primitives;
+
+        if (buffer.size() >= SnapshotFlushSize) {
+          ok      = ok && (fwrite(buffer.Data, 1, buffer.size(), file) == (size_t)buffer.size());
+          offset += buffer.size();
+          buffer.resize(0);
+        }
+      }
+    }
+
+    if (saved.count > 0)
+      layers.push_back(saved);
+  }
+
+  header.recordsSize     = offset + buffer.size() - header.recordsOffset;
+  header.typesOffset     = header.recordsOffset + header.recordsSize;
+  header.clipRectsOffset = header.typesOffset + sizeof(counts);
+  header.layersOffset    = header.clipRectsOffset + clipRects_.size() * sizeof(ImVec4);
+  header.layers          = layers.size();
+  writer.append(counts, sizeof(counts));
+  writer.append(clipRects_.Data, clipRects_.size() * sizeof(ImVec4));
+  writer.append(layers.Data, layers.size() * sizeof(SnapshotLayer));
+  ok = ok && (fwrite(buffer.Data, 1, buffer.size(), file) == (size_t)buffer.size());
+  ok = ok && (fseek(file, 0, SEEK_SET) == 0) && (fwrite(&header, sizeof(header), 1, file) == 1);
+  return (fclose(file) == 0) && ok;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+bool StatefulCanvas::load(const char *path, DrawIdxRange *range) {
+  MappedFile file;
+
+  if (range)
+    *range = {DRAW_IDX_NONE, 0};
+
+  if (!LittleEndian() || !MapFile(path, &file))
+    return false;
+
+  bool ok = loadSnapshot(file.data, file.size, range);
+  UnmapFile(&file);
+  return ok;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+bool StatefulCanvas::loadSnapshot(const unsigned char *data, size_t size, DrawIdxRange *range) { // all or nothing -- a bad record clears the canvas
+  static Primitive *(*const loadFuncs[])(SnapshotReader &reader, PrimitiveType type) = { // indexed by PrimitiveType
+    SnapshotReader::load<Line>, SnapshotReader::load<Rect>, SnapshotReader::load<RectFilled>, SnapshotReader::load<RectFilledMultiColor>,
+    SnapshotReader::load<Quad>, SnapshotReader::load<QuadFilled>, SnapshotReader::load<Triangle>, SnapshotReader::load<TriangleFilled>,
+    SnapshotReader::load<Circle>, SnapshotReader::load<CircleFilled>, SnapshotReader::load<Ngon>, SnapshotReader::load<NgonFilled>,
+    SnapshotReader::load<Text>, SnapshotReader::load<Text2>, SnapshotReader::load<Polyline>, SnapshotReader::load<ConvexPolyFilled>,
+    SnapshotReader::load<BezierCurve>, SnapshotReader::load<Image>, SnapshotReader::load<ImageQuad>, SnapshotReader::load<ImageRounded>,
+    SnapshotReader::load<StreamingPolyline>
+  };
+  static_assert(IM_ARRAYSIZE(loadFuncs) == PrimitiveType_Custom);
+  SnapshotHeader header;
+
+  if (size < sizeof(header))
+    return false;
+
+  memcpy(&header, data, sizeof(header));
+
+  if (memcmp(header.magic, SnapshotMagic, sizeof(header.magic)) || (header.version != SnapshotVersion) || (header.byteOrder != SnapshotByteOrder) ||
+      !InFile(size, header.recordsOffset, header.recordsSize) || !InFile(size, header.typesOffset, (ImU64)header.types * sizeof(ImU32)) ||
+      !InFile(size, header.clipRectsOffset, (ImU64)header.clipRects * sizeof(ImVec4)) ||
+      !InFile(size, header.layersOffset, (ImU64)header.layers * sizeof(SnapshotLayer)) ||
+      (header.primitives > header.recordsSize / sizeof(SnapshotRecord)) || (header.primitives > (ImU64)(INT_MAX - drawList_.size())))
+    return false;
+
+  clear();
+  ImVector<int> clipRectMap; // file's clip rects to interned ones
+  clipRectMap.resize(header.clipRects);
+
+  for (ImU32 i = 0; i < header.clipRects; ++i) {
+    ImVec4 rect;
+    memcpy(&rect, data + header.clipRectsOffset + i * sizeof(ImVec4), sizeof(rect));
+    clipRectMap[i] = internClipRect(rect);
+  }
+
+  for (ImU32 t = 0; t < ImMin(header.types, (ImU32)PrimitiveType_Custom); ++t) { // registered types' pools grow as their records load
+    ImU32 count;
+    memcpy(&count, data + header.typesOffset + t * sizeof(ImU32), sizeof(count));
+    poolReserve((PrimitiveType)t, PrimitiveSizes[t], (int)ImMin((ImU64)count, header.primitives));
+  }
+
+  DrawIdxRange        handles = claimSlots((int)header.primitives);
+  int                 first   = slotIndex(handles.first),
+                      n       = 0; // records taken
+  const unsigned char *at     = data + header.recordsOffset,
+                      *end    = at + header.recordsSize;
+  SnapshotReader      reader  = {this, nullptr, nullptr, false};
+
+  for (ImU32 l = 0; (l < header.layers) && !reader.failed; ++l) {
+    SnapshotLayer saved;
+    memcpy(&saved, data + header.layersOffset + l * sizeof(SnapshotLayer), sizeof(saved));
+
+    if (saved.count > header.primitives - n) {
+      reader.failed = true;
+      break;
+    }
+
+    ZLayer &layer = zLayer(saved.z);
+    layer.raised.reserve(layer.raised.size() + saved.count);
+
+    for (ImU32 c = 0; (c < saved.count) && !reader.failed; ++c) {
+      SnapshotRecord record;
+      reader.failed = (size_t)(end - at) < sizeof(record);
+
+      if (!reader.failed)
+        memcpy(&record, at, sizeof(record));
+
+      if (reader.failed || (record.size < sizeof(record)) || (record.size > (size_t)(end - at)) || (record.type > PrimitiveType_COUNT) ||
+          (record.size - sizeof(record) > INT_MAX) || // LoadCustomFunc takes an int size
+          ((record.flags & SnapshotFlags_Clip) && ((record.clipRect < 0) || ((ImU32)record.clipRect >= header.clipRects)))) {
+        reader.failed = true;
+        break;
+      }
+
+      reader.at      = at + sizeof(record);
+      reader.end     = at + record.size;
+      at            += record.size;
+      int       idx  = first + n++;
+      Primitive *primitive;
+
+      if (record.type == PrimitiveType_Custom)
+        primitive = loadCustom_ ? loadCustom_(record.customType, reader.at, (int)(reader.end - reader.at), snapshotUserData_) : nullptr;
+      else if (record.type == PrimitiveType_COUNT)
+        primitive = loadRegistered(record.customType, reader.at, (int)(reader.end - reader.at));
+      else
+        primitive = loadFuncs[record.type](reader, (PrimitiveType)record.type);
+
+      if (!primitive) { // custom or registered type the client didn't load -- its handle stays invalid
+        Slot &slot      = drawList_[idx];
+        slot.primitive  = nullptr;
+        slot.generation = (slot.generation + 1) & 0x7FFFFFFF;
+        slot.nextFree   = freeSlot_;
+        freeSlot_       = idx;
+        continue;
+      }
+
+      assert(primitive->type == ((record.type == PrimitiveType_COUNT) ? findTypeId(record.customType) : record.type));
+      primitive->z           = saved.z;
+      primitive->visible     = (record.flags & SnapshotFlags_Visible) != 0;
+      primitive->clip        = (record.flags & SnapshotFlags_Clip) != 0;
+      primitive->clipRectIdx = primitive->clip ? clipRectMap[record.clipRect] : -1;
+
+      if (primitive->clip)
+        primitive->clipRect = clipRects_[primitive->clipRectIdx];
+
+      attach(idx, primitive, layer); // even when reading failed, so clear() releases it
+    }
+  }
+
+  if (reader.failed || (n != (int)header.primitives)) {
+    for (int i = first + n; i < first + (int)header.primitives; ++i) // claimed, never filled
+      drawList_[i].primitive = nullptr;
+
+    clear();
+    return false;
+  }
+
+  if (range)
+    *range = handles;
+
+  return true;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+StatefulCanvas::Primitive *StatefulCanvas::loadRegistered(ImU32 typeId, const unsigned char *data, int size) {
+  int type = findTypeId(typeId);
+
+  if ((type < 0) || !relocators_[type - PrimitiveType_COUNT] || !loadCustom_) // no type registered as typeId on this canvas, or it can't be moved
+    return nullptr;
+
+  Primitive *loaded = loadCustom_(typeId, data, size, snapshotUserData_); // a T, for the type registered as typeId
+
+  if (!loaded)
+    return nullptr;
+
+  Primitive *primitive = relocators_[type - PrimitiveType_COUNT](loaded, poolAlloc((PrimitiveType)type, (size_t)pools_[type].objectSize));
+  primitive->type      = (unsigned char)type;
+  ::operator delete(loaded); // relocator destroyed it -- loadFunc allocated it with new, as custom() primitives are
+  return primitive;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+int StatefulCanvas::findTypeId(ImU32 typeId) const {
+  for (int i = 0; typeId && (i < PrimitiveType_MAX - PrimitiveType_COUNT); ++i)
+    if (registered_[i] && (typeIds_[i] == typeId))
+      return PrimitiveType_COUNT + i;
+
+  return -1;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+StatefulCanvas::draw_idx_t StatefulCanvas::addToDrawList(Primitive *primitive) {
+  addClipRect(primitive);
+  int idx = freeSlot_;
+
+  if (idx >= 0)
+    freeSlot_ = drawList_[idx].nextFree;
+  else if (slotsUsed_ < drawList_.size()) { // released by clear()
+    idx                       = slotsUsed_++;
+    drawList_[idx].generation = (drawList_[idx].generation + 1) & 0x7FFFFFFF;
+  }
+  else {
+    assert(drawList_.size() < INT_MAX);
+    idx = slotsUsed_++;
+    drawList_.push_back(Slot());
+    drawList_[idx].generation = slotGeneration_;
+  }
+
+  attach(idx, primitive, zLayer(primitive->z));
+  return handle(idx, drawList_[idx].generation);
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+StatefulCanvas::DrawIdxRange StatefulCanvas::claimSlots(int n) { // n slots past those in use, sharing a generation so their handles are consecutive
+  assert(drawList_.size() <= INT_MAX - n);
+  int first      = slotsUsed_,
+      generation = slotGeneration_;
+
+  for (int i = first; (i < drawList_.size()) && (i < first + n); ++i) // released by clear() -- newer than any of their handles
+    generation = ImMax(generation, (drawList_[i].generation + 1) & 0x7FFFFFFF);
+
+  if (drawList_.size() < first + n)
+    drawList_.resize(first + n);
+
+  for (int i = first; i < first + n; ++i)
+    drawList_[i].generation = generation;
+
+  slotsUsed_ += n;
+  return {handle(first, generation), n};
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+void StatefulCanvas::attach(int idx, Primitive *primitive, ZLayer &layer) { // primitive in claimed slot idx joins its z layer
+  if (poolOwnsMemory(primitive->type))
+    ++ownsMemory_;
+
+  Slot &slot     = drawList_[idx];
+  slot.primitive = primitive;
+  slot.z         = layer.z;
+  slot.order     = ++orderMax_;
+  slot.dragged   = false;
+  slot.touched   = false;
+  slot.spatial   = Spatial_None;
+  slot.mark      = 0;
+  slot.nextFree  = -1;
+  layer.dirty    = true;
+  layer.raised.push_back({idx, slot.order});
+  ++layer.live;
+  joinGroup(idx, currentGroup());
+
+  if (spatialIndex_)
+    indexBounds(idx);
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+void *StatefulCanvas::poolAlloc(PrimitiveType type, size_t size) {
+  Pool &pool = pools_[type];
+
+  if (pool.freeList) {
+    void *ptr     = pool.freeList;
+    pool.freeList = *(void **)ptr;
+    return ptr;
+  }
+
+  if (pool.objectSize == 0)
+    pool.objectSize = (int)((size + 7) & ~(size_t)7);
+
+  assert((size_t)pool.objectSize >= size);
+
+  if ((pool.block < pool.blocks.size()) && (pool.used == pool.capacities[pool.block])) {
+    ++pool.block;
+    pool.used = 0;
+  }
+
+  if (pool.block == pool.blocks.size()) {
+    pool.capacities.push_back(poolBlockCapacity(pool.block));
+    pool.blocks.push_back(allocFunc_((size_t)pool.objectSize * pool.capacities.back(), allocUserData_));
+  }
+
+  return (char *)pool.blocks[pool.block] + (size_t)pool.objectSize * pool.used++;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+void StatefulCanvas::poolReserve(PrimitiveType type, size_t size, int n) { // ensure n objects can be carved -- any shortfall becomes one block
+  Pool  &pool     = pools_[type];
+  ImS64 available = 0;
+
+  if (pool.objectSize == 0)
+    pool.objectSize = (int)((size + 7) & ~(size_t)7);
+
+  for (int b = pool.block; b < pool.blocks.size(); ++b)
+    available += pool.capacities[b] - ((b == pool.block) ? pool.used : 0);
+
+  if (available < n) {
+    pool.capacities.push_back(ImMax(poolBlockCapacity(pool.blocks.size()), (int)(n - available)));
+    pool.blocks.push_back(allocFunc_((size_t)pool.objectSize * pool.capacities.back(), allocUserData_));
+  }
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+void StatefulCanvas::destroy(Primitive *primitive) {
+  if (poolOwnsMemory(primitive->type))
+    --ownsMemory_;
+
+  if (primitive->type == PrimitiveType_Custom) {
+    delete primitive;
+    return;
+  }
+
+  if (String *string = findString(primitive))
+    strings_.dead += (int)(string->stringEnd - string->string) + 1;
+
+  Pool &pool = pools_[primitive->type];
+  primitive->~Primitive();
+  *(void **)primitive = pool.freeList;
+  pool.freeList       = primitive;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+int StatefulCanvas::findZLayer(int z) const { // binary search for first z layer >= z
+  int lo = 0,
+      hi = (int)zIndex_.size();
+
+  while (lo < hi) {
+    int mid = (lo + hi) / 2;
+
+    if (zIndex_[mid].z < z)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+
+  return lo;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+StatefulCanvas::ZLayer &StatefulCanvas::zLayer(int z) { // find or create
+  int l = findZLayer(z);
+
+  if ((l == (int)zIndex_.size()) || (zIndex_[l].z != z)) {
+    ZLayer layer;
+    layer.z        = z;
+    layer.live     = 0;
+    layer.dirty    = true;
+    layer.geometry = nullptr;
+    layer.ingested = 0;
+    zIndex_.insert(zIndex_.begin() + l, std::move(layer));
+  }
+
+  return zIndex_[l];
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+void StatefulCanvas::unindexZ(int z) { // called after a primitive's z layer entry is invalidated
+  int l = findZLayer(z);
+  assert((l < (int)zIndex_.size()) && (zIndex_[l].z == z));
+  ZLayer &layer = zIndex_[l];
+
+  layer.dirty = true;
+
+  if (--layer.live == 0) {
+    IM_DELETE(layer.geometry);
+    zIndex_.erase(zIndex_.begin() + l);
+  }
+  else if ((layer.lowered.size() + layer.raised.size()) > (layer.live * 2))
+    compactZLayer(layer);
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+void StatefulCanvas::compactZLayer(ZLayer &layer) { // drop stale entries
+  for (int pass = 0; pass < 2; ++pass) {
+    ImVector<ZEntry> &entries = pass ? layer.raised : layer.lowered;
+    int n = 0;
+
+    for (int e = 0; e < entries.size(); ++e)
+      if (validZEntry(entries[e]))
+        entries[n++] = entries[e];
+
+    entries.resize(n);
+  }
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+StatefulCanvas::DrawBatchFunc StatefulCanvas::batchFunc(int type) const {
+  static const DrawBatchFunc builtIn[] = { // indexed by PrimitiveType
+    drawBatch<Line>, drawBatch<Rect>, drawBatch<RectFilled>, drawBatch<RectFilledMultiColor>, drawBatch<Quad>, drawBatch<QuadFilled>,
+    drawBatch<Triangle>, drawBatch<TriangleFilled>, drawBatch<Circle>, drawBatch<CircleFilled>, drawBatch<Ngon>, drawBatch<NgonFilled>,
+    drawBatch<Text>, drawBatch<Text2>, drawBatch<Polyline>, drawBatch<ConvexPolyFilled>, drawBatch<BezierCurve>, drawBatch<Image>, drawBatch<ImageQuad>,
+    drawBatch<ImageRounded>, drawBatch<StreamingPolyline>, drawBatch<Primitive>
+  };
+  static_assert(IM_ARRAYSIZE(builtIn) == PrimitiveType_COUNT);
+  return (type < PrimitiveType_COUNT) ? builtIn[type] : registered_[type - PrimitiveType_COUNT];
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+StatefulCanvas::RelocateFunc StatefulCanvas::relocateFunc(int type) const {
+  static const RelocateFunc builtIn[] = { // indexed by PrimitiveType -- custom primitives are client allocated
+    relocate<Line>, relocate<Rect>, relocate<RectFilled>, relocate<RectFilledMultiColor>, relocate<Quad>, relocate<QuadFilled>,
+    relocate<Triangle>, relocate<TriangleFilled>, relocate<Circle>, relocate<CircleFilled>, relocate<Ngon>, relocate<NgonFilled>,
+    relocate<Text>, relocate<Text2>, relocate<Polyline>, relocate<ConvexPolyFilled>, relocate<BezierCurve>, relocate<Image>, relocate<ImageQuad>,
+    relocate<ImageRounded>, relocate<StreamingPolyline>, nullptr
+  };
+  static_assert(IM_ARRAYSIZE(builtIn) == PrimitiveType_COUNT);
+  return (type < PrimitiveType_COUNT) ? builtIn[type] : relocators_[type - PrimitiveType_COUNT];
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+StatefulCanvas::MoveBatchFunc StatefulCanvas::moveFunc(int type) const {
+  static const MoveBatchFunc builtIn[] = { // indexed by PrimitiveType
+    moveBatch<Line>, moveBatch<Rect>, moveBatch<RectFilled>, moveBatch<RectFilledMultiColor>, moveBatch<Quad>, moveBatch<QuadFilled>,
+    moveBatch<Triangle>, moveBatch<TriangleFilled>, moveBatch<Circle>, moveBatch<CircleFilled>, moveBatch<Ngon>, moveBatch<NgonFilled>,
+    moveBatch<Text>, moveBatch<Text2>, moveBatch<Polyline>, moveBatch<ConvexPolyFilled>, moveBatch<BezierCurve>, moveBatch<Image>, moveBatch<ImageQuad>,
+    moveBatch<ImageRounded>, moveBatch<StreamingPolyline>, moveBatch<Primitive>
+  };
+  static_assert(IM_ARRAYSIZE(builtIn) == PrimitiveType_COUNT);
+  return (type < PrimitiveType_COUNT) ? builtIn[type] : movers_[type - PrimitiveType_COUNT];
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+void StatefulCanvas::moveBatches(float x, float y) { // move moved_ by type runs, as drawBatches() draws batch_
+  int start[PrimitiveType_MAX + 1] = {};
+
+  for (int i = 0; i < moved_.size(); ++i)
+    ++start[moved_[i]->type + 1];
+
+  for (int t = 0; t < PrimitiveType_MAX; ++t)
+    start[t + 1] += start[t];
+
+  int next[PrimitiveType_MAX];
+  memcpy(next, start, sizeof(next));
+  movedSorted_.resize(moved_.size());
+
+  for (int i = 0; i < moved_.size(); ++i)
+    movedSorted_[next[moved_[i]->type]++] = moved_[i];
+
+  for (int t = 0; t < PrimitiveType_MAX; ++t)
+    if (start[t + 1] > start[t])
+      moveFunc(t)(movedSorted_.Data + start[t], start[t + 1] - start[t], x, y);
+
+  moved_.resize(0);
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+int StatefulCanvas::nextRegisteredType() {
+  static std::atomic<int> registered(0);
+  int                     type = registered++;
+  assert(type < PrimitiveType_MAX - PrimitiveType_COUNT); // raise PrimitiveType_MAX
+  return type;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+template<typename T, typename Less>
+static void StableSort(T *data, int n, T *scratch, Less less) { // merge sort through caller's scratch (n elements) -- std::stable_sort allocates per call
+  const int run = 16; // insertion sorted first
+
+  for (int i = 0; i < n; i += run)
+    for (int j = i + 1; j < ImMin(i + run, n); ++j) {
+      T   value = data[j];
+      int k     = j;
+
+      for (; (k > i) && less(value, data[k - 1]); --k)
+        data[k] = data[k - 1];
+
+      data[k] = value;
+    }
+
+  T *from = data,
+    *to   = scratch;
+
+  for (int width = run; width < n; width *= 2) {
+    for (int lo = 0; lo < n; lo += 2 * width) {
+      int mid = ImMin(lo + width, n),
+          hi  = ImMin(lo + 2 * width, n),
+          a   = lo,
+          b   = mid,
+          o   = lo;
+
+      while ((a < mid) && (b < hi))
+        to[o++] = less(from[b], from[a]) ? from[b++] : from[a++]; // ties taken from the left run
+
+      while (a < mid)
+        to[o++] = from[a++];
+
+      while (b < hi)
+        to[o++] = from[b++];
+    }
+
+    ImSwap(from, to);
+  }
+
+  if (from != data)
+    memcpy(data, from, n * sizeof(T));
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+void StatefulCanvas::drawBatches(ImDrawList *drawList, const ImVec2 &loc) const { // draw batch_ grouped by state and/or type
+  BatchContext context = {loc, &view_, groupOffsets_.Data, false};
+
+  if (drawList == deferTarget_)
+    flushDeferred(drawList, loc); // batches are drawn serially
+
+  if (sortByState_) { // runs sharing clip rect and texture -- each run one draw command
+    batchSorted_.resize(batch_.size());
+    StableSort(batch_.Data, batch_.size(), batchSorted_.Data, batchByType_ ? stateTypeBefore : stateBefore);
+
+    int pushed      = -1;
+    context.clipped = true;
+
+    for (int i = 0, j; i < batch_.size(); i = j) {
+      const Primitive *primitive = batch_[i];
+
+      for (j = i + 1; j < batch_.size(); ++j)
+        if ((stateClipRect(batch_[j]) != stateClipRect(primitive)) || (batchByType_ && (batch_[j]->type != primitive->type)))
+          break;
+
+      if (stateClipRect(primitive) != pushed) {
+        if (pushed >= 0)
+          drawList->PopClipRect();
+
+        if ((pushed = stateClipRect(primitive)) >= 0) {
+          drawList->PushClipRect(ImVec2(clipRects_[pushed].x, clipRects_[pushed].y), ImVec2(clipRects_[pushed].z, clipRects_[pushed].w));
+          STATS_ONLY(++stats_.clipPushes);
+        }
+      }
+
+      batchFunc(batchByType_ ? (int)primitive->type : (int)PrimitiveType_Custom)(drawList, batch_.Data + i, j - i, context); // Custom: virtual dispatch
+    }
+
+    if (pushed >= 0)
+      drawList->PopClipRect();
+
+    batch_.resize(0);
+    return;
+  }
+
+  int start[PrimitiveType_MAX + 1] = {}; // counting sort batch_ by type (stable), then draw each type's run
+
+  for (int i = 0; i < batch_.size(); ++i)
+    ++start[batch_[i]->type + 1];
+
+  for (int t = 0; t < PrimitiveType_MAX; ++t)
+    start[t + 1] += start[t];
+
+  int next[PrimitiveType_MAX];
+  memcpy(next, start, sizeof(next));
+  batchSorted_.resize(batch_.size());
+
+  for (int i = 0; i < batch_.size(); ++i)
+    batchSorted_[next[batch_[i]->type]++] = batch_[i];
+
+  for (int t = 0; t < PrimitiveType_MAX; ++t)
+    if (start[t + 1] > start[t])
+      batchFunc(t)(drawList, batchSorted_.Data + start[t], start[t + 1] - start[t], context);
+
+  batch_.resize(0);
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+void StatefulCanvas::drawPrimitive(ImDrawList *drawList, Primitive *primitive, const ImVec2 &loc) const {
+  if (!primitive->visible || !groups_[primitive->group].composedVisible) {
+    STATS_ONLY(++stats_.hidden);
+    return;
+  }
+
+  countState(primitive);
+
+  if (drawList == deferTarget_) {
+    if (primitive->type < PrimitiveType_Custom) {
+      deferred_.push_back(primitive);
+      return;
+    }
+
+    flushDeferred(drawList, loc); // client code (custom or registered) may not be thread safe -- drawn here, after primitives before it
+  }
+
+  drawClipped(drawList, primitive, loc);
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+void StatefulCanvas::drawClipped(ImDrawList *drawList, Primitive *primitive, const ImVec2 &loc) const {
+  STATS_ONLY(int vtxStart = drawList->VtxBuffer.Size, idxStart = drawList->IdxBuffer.Size; double start = StatsNow();)
+
+  if (primitive->clip) {
+    const ImVec4 &rect = primitive->clipRect;
+    drawList->PushClipRect(ImVec2(rect.x, rect.y), ImVec2(rect.z, rect.w));
+    STATS_ONLY(++StatsTarget->clipPushes);
+  }
+
+  primitive->drawView(drawList, loc + groupOffsets_[primitive->group] * view_.zoom, view_);
+
+  if (primitive->clip)
+    drawList->PopClipRect();
+
+  STATS_ONLY(StatsDrawn(*StatsTarget, primitive->type, drawList, vtxStart, idxStart, start));
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+#ifdef STATEFUL_CANVAS_STATS
+static const char *const PrimitiveTypeNames[] = { // indexed by PrimitiveType
+  "Line", "Rect", "RectFilled", "RectFilledMultiColor", "Quad", "QuadFilled", "Triangle", "TriangleFilled", "Circle", "CircleFilled", "Ngon", "NgonFilled",
+  "Text", "Text2", "Polyline", "ConvexPolyFilled", "BezierCurve", "Image", "ImageQuad", "ImageRounded", "StreamingPolyline", "Custom"
+};
+
+static_assert(IM_ARRAYSIZE(PrimitiveTypeNames) == StatefulCanvas::PrimitiveType_COUNT);
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+void StatefulCanvas::Stats::reset() {
+  visited        = 0;
+  drawn          = 0;
+  hidden         = 0;
+  culled         = 0;
+  zLayers        = 0;
+  clipPushes     = 0;
+  copiedVertices = 0;
+  copiedIndices  = 0;
+  ms             = 0;
+  memset(types, 0, sizeof(types));
+  layers.resize(0);
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+void StatefulCanvas::Stats::add(const Stats &stats) {
+  visited        += stats.visited;
+  drawn          += stats.drawn;
+  hidden         += stats.hidden;
+  culled         += stats.culled;
+  zLayers        += stats.zLayers;
+  clipPushes     += stats.clipPushes;
+  copiedVertices += stats.copiedVertices;
+  copiedIndices  += stats.copiedIndices;
+
+  for (int t = 0; t < PrimitiveType_COUNT; ++t) {
+    types[t].drawn    += stats.types[t].drawn;
+    types[t].vertices += stats.types[t].vertices;
+    types[t].indices  += stats.types[t].indices;
+    types[t].ms       += stats.types[t].ms;
+  }
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+void StatefulCanvas::drawStatsWindow(const char *title, bool *open) const { // stats of last draw()
+  if (!ImGui::Begin(title, open)) {
+    ImGui::End();
+    return;
+  }
+
+  const Stats &stats = stats_;
+  ImGui::Text("%.3f ms, %d draw commands, %d z layers, %d clip pushes", stats.ms, drawCmds_, stats.zLayers, stats.clipPushes);
+  ImGui::Text("%d visited: %d drawn, %d hidden, %d culled", stats.visited, stats.drawn, stats.hidden, stats.culled);
+
+  if (stats.copiedVertices)
+    ImGui::Text("%d vertices, %d indices copied from geometry cache", stats.copiedVertices, stats.copiedIndices);
+
+  if (stats.layers.size() > 0) {
+    ImGui::PlotHistogram("ms per z layer", StatsLayerMs, (void *)&stats.layers, stats.layers.size(), 0, nullptr, 0.0f, FLT_MAX, ImVec2(0, 80));
+  }
+
+  ImGui::Separator();
+  ImGui::Columns(5, "types");
+  ImGui::Text("type");
+  ImGui::NextColumn();
+  ImGui::Text("drawn");
+  ImGui::NextColumn();
+  ImGui::Text("vertices");
+  ImGui::NextColumn();
+  ImGui::Text("indices");
+  ImGui::NextColumn();
+  ImGui::Text("ms");
+  ImGui::NextColumn();
+  ImGui::Separator();
+
+  for (int t = 0; t < PrimitiveType_COUNT; ++t) {
+    const Stats::Type &type = stats.types[t];
+
+    if (type.drawn == 0)
+      continue;
+
+    ImGui::Text("%s", PrimitiveTypeNames[t]);
+    ImGui::NextColumn();
+    ImGui::Text("%d", type.drawn);
+    ImGui::NextColumn();
+    ImGui::Text("%d", type.vertices);
+    ImGui::NextColumn();
+    ImGui::Text("%d", type.indices);
+    ImGui::NextColumn();
+    ImGui::Text("%.3f", type.ms);
+    ImGui::NextColumn();
+  }
+
+  ImGui::Columns(1);
+  ImGui::End();
+}
+#endif
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+void StatefulCanvas::pushClipRect(const ImVec2 &min, const ImVec2 &max) { // intersected with enclosing clip rect once, here
+  ImVec4 rect(min.x, min.y, max.x, max.y);
+
+  if (clipRectStack_.size() > 0) {
+    const ImVec4 &enclosing = clipRects_[clipRectStack_.back()];
+    rect = ImVec4(ImMax(rect.x, enclosing.x), ImMax(rect.y, enclosing.y), ImMin(rect.z, enclosing.z), ImMin(rect.w, enclosing.w));
+  }
+
+  clipRectStack_.push_back(internClipRect(rect));
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+void StatefulCanvas::popClipRect() {
+  assert(clipRectStack_.size() > 0);
+  clipRectStack_.pop_back();
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+int StatefulCanvas::internClipRect(const ImVec4 &rect) { // primitives sharing a clip rect share its index, so runs of them are found cheaply
+  ImVector<int> &bucket = clipRectTable_[ImHashData(&rect, sizeof(rect))];
+
+  for (int i = 0; i < bucket.size(); ++i)
+    if (memcmp(&clipRects_[bucket[i]], &rect, sizeof(rect)) == 0)
+      return bucket[i];
+
+  bucket.push_back(clipRects_.size());
+  clipRects_.push_back(rect);
+  return clipRects_.size() - 1;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+ImTextureID StatefulCanvas::texture(const Primitive *primitive) {
+  if (primitive->type == PrimitiveType_Image)
+    return static_cast<const Image *>(primitive)->textureId;
+
+  if (primitive->type == PrimitiveType_ImageQuad)
+    return static_cast<const ImageQuad *>(primitive)->textureId;
+
+  if (primitive->type == PrimitiveType_ImageRounded)
+    return static_cast<const ImageRounded *>(primitive)->textureId;
+
+  return nullptr;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+bool StatefulCanvas::stateBefore(const Primitive *a, const Primitive *b) {
+  if (stateClipRect(a) != stateClipRect(b))
+    return stateClipRect(a) < stateClipRect(b);
+
+  return (size_t)texture(a) < (size_t)texture(b);
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+void StatefulCanvas::countState(const Primitive *primitive) const { // clip rect or texture change a z order draw would split a draw command on
+  if (!primitive->visible)
+    return;
+
+  int         clipRect = stateClipRect(primitive);
+  ImTextureID texture  = StatefulCanvas::texture(primitive);
+
+  if ((clipRect != lastClipRect_) || (texture != lastTexture_)) {
+    ++stateChanges_;
+    lastClipRect_ = clipRect;
+    lastTexture_  = texture;
+  }
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+void StatefulCanvas::Line::drawView(ImDrawList *drawList, const ImVec2 &loc, const View &view) {
+  ImVec2 offs;
+  viewOffset(loc, view, &offs);
+  drawList->AddLine(p0 * view.zoom + offs, p1 * view.zoom + offs, color, view.stroke(thickness));
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+void StatefulCanvas::Rect::drawView(ImDrawList *drawList, const ImVec2 &loc, const View &view) {
+  ImVec2 offs;
+  viewOffset(loc, view, &offs);
+  drawList->AddRect(p0 * view.zoom + offs, p1 * view.zoom + offs, color, rounding * view.zoom, cornerFlags, view.stroke(thickness));
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+void StatefulCanvas::RectFilled::drawView(ImDrawList *drawList, const ImVec2 &loc, const View &view) {
+  ImVec2 offs;
+  viewOffset(loc, view, &offs);
+  drawList->AddRectFilled(p0 * view.zoom + offs, p1 * view.zoom + offs, color, rounding * view.zoom, cornerFlags);
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+void StatefulCanvas::RectFilledMultiColor::drawView(ImDrawList *drawList, const ImVec2 &loc, const View &view) {
+  ImVec2 offs;
+  viewOffset(loc, view, &offs);
+  drawList->AddRectFilledMultiColor(p0 * view.zoom + offs, p1 * view.zoom + offs, color0, color1, color2, color3);
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+void StatefulCanvas::Quad::drawView(ImDrawList *drawList, const ImVec2 &loc, const View &view) {
+  ImVec2 offs;
+  viewOffset(loc, view, &offs);
+  drawList->AddQuad(p0 * view.zoom + offs, p1 * view.zoom + offs, p2 * view.zoom + offs, p3 * view.zoom + offs, color, view.stroke(thickness));
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+void StatefulCanvas::QuadFilled::drawView(ImDrawList *drawList, const ImVec2 &loc, const View &view) {
+  ImVec2 offs;
+  viewOffset(loc, view, &offs);
+  drawList->AddQuadFilled(p0 * view.zoom + offs, p1 * view.zoom + offs, p2 * view.zoom + offs, p3 * view.zoom + offs, color);
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+void StatefulCanvas::Triangle::drawView(ImDrawList *drawList, const ImVec2 &loc, const View &view) {
+  ImVec2 offs;
+  viewOffset(loc, view, &offs);
+  drawList->AddTriangle(p0 * view.zoom + offs, p1 * view.zoom + offs, p2 * view.zoom + offs, color, view.stroke(thickness));
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+void StatefulCanvas::TriangleFilled::drawView(ImDrawList *drawList, const ImVec2 &loc, const View &view) {
+  ImVec2 offs;
+  viewOffset(loc, view, &offs);
+  drawList->AddTriangleFilled(p0 * view.zoom + offs, p1 * view.zoom + offs, p2 * view.zoom + offs, color);
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+void StatefulCanvas::Circle::drawView(ImDrawList *drawList, const ImVec2 &loc, const View &view) {
+  ImVec2 offs;
+  viewOffset(loc, view, &offs);
+  drawList->AddCircle(center * view.zoom + offs, radius * view.zoom, color, view.circleSegments(segments), view.stroke(thickness));
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+void StatefulCanvas::CircleFilled::drawView(ImDrawList *drawList, const ImVec2 &loc, const View &view) {
+  ImVec2 offs;
+  viewOffset(loc, view, &offs);
+  drawList->AddCircleFilled(center * view.zoom + offs, radius * view.zoom, color, view.circleSegments(segments));
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+void StatefulCanvas::Ngon::drawView(ImDrawList *drawList, const ImVec2 &loc, const View &view) {
+  ImVec2 offs;
+  viewOffset(loc, view, &offs);
+  drawList->AddNgon(center * view.zoom + offs, radius * view.zoom, color, segments, view.stroke(thickness));
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+void StatefulCanvas::NgonFilled::drawView(ImDrawList *drawList, const ImVec2 &loc, const View &view) {
+  ImVec2 offs;
+  viewOffset(loc, view, &offs);
+  drawList->AddNgonFilled(center * view.zoom + offs, radius * view.zoom, color, segments);
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+void StatefulCanvas::TextLayout::layout(const ImFont *font, float size, float wrapWidth, const char *text, const char *textEnd) { // as ImFont::RenderText()
+  if ((font == layoutFont) && (size == layoutSize) && (wrapWidth == layoutWrap) && (font->ContainerAtlas->TexID == layoutTexture))
+    return;
+
+  layoutFont    = font;
+  layoutTexture = font->ContainerAtlas->TexID;
+  layoutSize    = size;
+  layoutWrap    = wrapWidth;
+  glyphs.resize(0);
+
+  const float scale      = size / font->FontSize;
+  const float lineHeight = font->FontSize * scale;
+  const char  *wrapEol   = nullptr;
+  float       x          = 0.0f,
+              y          = 0.0f;
+
+  for (const char *s = text; s < textEnd; ) {
+    if (wrapWidth > 0.0f) {
+      if (!wrapEol) {
+        wrapEol = font->CalcWordWrapPositionA(scale, s, textEnd, wrapWidth - x);
+
+        if (wrapEol == s) // at least one character per line
+          ++wrapEol;
+      }
+
+      if (s >= wrapEol) {
+        x       = 0.0f;
+        y      += lineHeight;
+        wrapEol = nullptr;
+
+        for (; s < textEnd; ++s) // wrapping skips upcoming blanks
+          if (*s == '\n') {
+            ++s;
+            break;
+          }
+          else if (!ImCharIsBlankA(*s))
+            break;
+
+        continue;
+      }
+    }
+
+    unsigned int c = (unsigned int)*s;
+
+    if (c < 0x80)
+      ++s;
+    else {
+      s += ImTextCharFromUtf8(&c, s, textEnd);
+
+      if (c == 0) // malformed UTF-8
+        break;
+    }
+
+    if (c == '\n') {
+      x  = 0.0f;
+      y += lineHeight;
+      continue;
+    }
+
+    if (c == '\r')
+      continue;
+
+    const ImFontGlyph *glyph = font->FindGlyph((ImWchar)c);
+
+    if (!glyph)
+      continue;
+
+    if (glyph->Visible)
+      glyphs.push_back({ImVec2(x + glyph->X0 * scale, y + glyph->Y0 * scale), ImVec2(x + glyph->X1 * scale, y + glyph->Y1 * scale),
+                        ImVec2(glyph->U0, glyph->V0), ImVec2(glyph->U1, glyph->V1)});
+
+    x += glyph->AdvanceX * scale;
+  }
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+void StatefulCanvas::TextLayout::render(ImDrawList *drawList, const ImVec2 &pos, ImU32 color) const { // glyph lookup, decoding and wrapping skipped
+  if (((color & IM_COL32_A_MASK) == 0) || (glyphs.size() == 0))
+    return;
+
+  ImVec2 origin(ImFloor(pos.x), ImFloor(pos.y));
+  drawList->PrimReserve(glyphs.size() * 6, glyphs.size() * 4);
+
+  for (int i = 0; i < glyphs.size(); ++i) {
+    const Glyph &glyph = glyphs[i];
+    drawList->PrimRectUV(origin + glyph.p0, origin + glyph.p1, glyph.uv0, glyph.uv1, color);
+  }
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+ImVec2 StatefulCanvas::TextLayout::measure(const ImFont *font, float size, float wrapWidth, const char *text, const char *textEnd) const {
+  if ((font != measureFont) || (size != measureSize) || (wrapWidth != measureWrap)) {
+    measureFont = font;
+    measureSize = size;
+    measureWrap = wrapWidth;
+    measured    = font->CalcTextSizeA(size, FLT_MAX, wrapWidth, text, textEnd);
+  }
+
+  return measured;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+void StatefulCanvas::Text::drawView(ImDrawList *drawList, const ImVec2 &loc, const View &view) {
+  ImVec2 offs;
+  viewOffset(loc, view, &offs);
+  prepareView(drawList, view);
+  render(drawList, p * view.zoom + offs, color);
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+void StatefulCanvas::Text::prepareView(const ImDrawList *drawList, const View &view) {
+  layout(drawList->_Data->Font, drawList->_Data->FontSize * view.zoom, 0.0f, string, stringEnd);
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+bool StatefulCanvas::Text::bounds(ImRect *rect) const { // measured with current font
+  ImGuiContext *g = GImGui;
+
+  if (!g || !g->Font)
+    return false;
+
+  *rect = ImRect(p, p + measure(g->Font, g->FontSize, 0.0f, string, stringEnd));
+  return true;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+void StatefulCanvas::Text2::drawView(ImDrawList *drawList, const ImVec2 &loc, const View &view) {
+  ImVec2 offs;
+  viewOffset(loc, view, &offs);
+  float size = (fontSize > 0.0f) ? fontSize : drawList->_Data->FontSize;
+
+  if (cpuFineClipRect) // clipped per glyph, in screen space
+    drawList->AddText(font, size * view.zoom, p * view.zoom + offs, color, string, stringEnd, wrapWidth * view.zoom, cpuFineClipRect);
+  else {
+    prepareView(drawList, view);
+    render(drawList, p * view.zoom + offs, color);
+  }
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+void StatefulCanvas::Text2::prepareView(const ImDrawList *drawList, const View &view) { // AddText() lays out cpuFineClipRect text itself
+  float size = (fontSize > 0.0f) ? fontSize : drawList->_Data->FontSize;
+
+  if (!cpuFineClipRect)
+    layout(font ? font : drawList->_Data->Font, size * view.zoom, wrapWidth * view.zoom, string, stringEnd);
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+bool StatefulCanvas::Text2::bounds(ImRect *rect) const {
+  ImGuiContext *g         = GImGui;
+  const ImFont *textFont  = font ? font : (g ? g->Font : nullptr);
+  float        textSize   = (fontSize > 0.0f) ? fontSize : (g ? g->FontSize : 0.0f);
+
+  if (!textFont)
+    return false;
+
+  *rect = ImRect(p, p + measure(textFont, textSize, wrapWidth, string, stringEnd));
+  return true;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+static void DecimateMinMax(const ImVector<ImVec2> &points, float columnWidth, ImVector<ImVec2> *out) { // M4 aggregation per column
+  float x0 = points[0].x;
+  int   i  = 0;
+
+  while (i < points.Size) {
+    int column = (int)((points[i].x - x0) / columnWidth),
+        first  = i,
+        lo     = i,
+        hi     = i;
+
+    for (++i; (i < points.Size) && ((int)((points[i].x - x0) / columnWidth) == column); ++i) {
+      if (points[i].y < points[lo].y)
+        lo = i;
+
+      if (points[i].y > points[hi].y)
+        hi = i;
+    }
+
+    int keep[4] = {first, ImMin(lo, hi), ImMax(lo, hi), i - 1}; // in path order
+
+    for (int k = 0; k < 4; ++k)
+      if ((k == 0) || (keep[k] != keep[k - 1]))
+        out->push_back(points[keep[k]]);
+  }
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+static void DecimateSimplify(const ImVector<ImVec2> &points, float tolerance, ImVector<ImVec2> *out) { // Douglas-Peucker without recursion
+  const int      chunk = 1024; // points simplified independently -- bounds worst case to O(points * chunk)
+  ImVector<int>  stack;
+  ImVector<bool> keep;
+  float          toleranceSqr = tolerance * tolerance;
+  keep.resize(points.Size, false);
+  keep[0] = true;
+
+  for (int first = 0; first < points.Size - 1; first += chunk) {
+    int last   = ImMin(first + chunk, points.Size - 1);
+    keep[last] = true;
+    stack.push_back(first);
+    stack.push_back(last);
+  }
+
+  while (stack.Size > 0) {
+    int   first    = stack[stack.Size - 2],
+          last     = stack[stack.Size - 1],
+          farthest = -1;
+    float distSqr  = toleranceSqr;
+    stack.resize(stack.Size - 2);
+
+    for (int i = first + 1; i < last; ++i) {
+      float d = ImLengthSqr(points[i] - ImLineClosestPoint(points[first], points[last], points[i]));
+
+      if (d > distSqr) {
+        distSqr  = d;
+        farthest = i;
+      }
+    }
+
+    if (farthest >= 0) {
+      keep[farthest] = true;
+      stack.push_back(first);
+      stack.push_back(farthest);
+      stack.push_back(farthest);
+      stack.push_back(last);
+    }
+  }
+
+  for (int i = 0; i < points.Size; ++i)
+    if (keep[i])
+      out->push_back(points[i]);
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+static float LodScale(float zoom) { // zoom rounded up to a quarter octave, so decimation is reused while zooming
+  return exp2f(ceilf(log2f(zoom) * 4.0f) / 4.0f);
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+const ImVector<ImVec2> &StatefulCanvas::Lod::lodPoints(const ImVector<ImVec2> &points) {
+  const int minPoints = 64; // decimating fewer isn't worth a copy
+
+  if ((lodMode == LevelOfDetail_Off) || (points.Size < minPoints))
+    return points;
+
+  if (lodDirty || (lodScale != lodCachedScale)) {
+    int mode = lodMode;
+
+    for (int i = 1; (i < points.Size) && (mode == LevelOfDetail_Auto); ++i)
+      if (points[i].x < points[i - 1].x)
+        mode = LevelOfDetail_Simplify;
+
+    lodCache.resize(0);
+
+    if (mode == LevelOfDetail_Simplify)
+      DecimateSimplify(points, lodTolerance / lodScale, &lodCache);
+    else
+      DecimateMinMax(points, 1.0f / lodScale, &lodCache);
+
+    lodCachedScale = lodScale;
+    lodDirty       = false;
+  }
+
+  return lodCache;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+void StatefulCanvas::Polyline::drawView(ImDrawList *drawList, const ImVec2 &loc, const View &view) {
+  const ImVector<ImVec2> &path = prepareView(view);
+  ImVec2                 offs;
+  viewOffset(loc, view, &offs);
+  drawList->_Path.resize(path.Size); // draw list's path doubles as scratch for offset points
+  transformPoints(drawList->_Path.Data, path.Data, path.Size, view.zoom, offs);
+  drawList->PathStroke(color, closed, view.stroke(thickness));
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+void StatefulCanvas::ConvexPolyFilled::drawView(ImDrawList *drawList, const ImVec2 &loc, const View &view) {
+  const ImVector<ImVec2> &path = prepareView(view);
+  ImVec2                 offs;
+  viewOffset(loc, view, &offs);
+  drawList->_Path.resize(path.Size); // draw list's path doubles as scratch for offset points
+  transformPoints(drawList->_Path.Data, path.Data, path.Size, view.zoom, offs);
+  drawList->PathFillConvex(color);
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+const ImVector<ImVec2> &StatefulCanvas::Polyline::prepareView(const View &view) {
+  lodScale = LodScale(view.zoom);
+  return lodPoints(points);
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+const ImVector<ImVec2> &StatefulCanvas::ConvexPolyFilled::prepareView(const View &view) {
+  lodScale = LodScale(view.zoom);
+  return lodPoints(points);
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+void StatefulCanvas::BezierCurve::drawView(ImDrawList *drawList, const ImVec2 &loc, const View &view) {
+  ImVec2 offs;
+  viewOffset(loc, view, &offs);
+  drawList->AddBezierCurve(p0 * view.zoom + offs, p1 * view.zoom + offs, p2 * view.zoom + offs, p3 * view.zoom + offs, color, view.stroke(thickness),
+                           segments);
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+void StatefulCanvas::StreamingPolyline::drawView(ImDrawList *drawList, const ImVec2 &loc, const View &view) {
   ImVec2 offs;
-  offset(loc, &offs);
-  drawList->AddImageRounded(textureId, p0 + offs, p1 + offs, uv0, uv1, color, rounding, cornerFlags);
+  viewOffset(loc, view, &offs);
+  offs += origin * view.zoom;
+  int wrap = ImMin(count, capacity - head); // points before ring wraps
+  drawList->_Path.resize(count);
+  transformPoints(drawList->_Path.Data, buffer + head, wrap, view.zoom, offs);
+  transformPoints(drawList->_Path.Data + wrap, buffer, count - wrap, view.zoom, offs);
+
+  drawList->PathStroke(color, false, view.stroke(thickness));
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+bool StatefulCanvas::StreamingPolyline::bounds(ImRect *rect) const { // unknown for client spans, which change without notice
+  if ((ring.Size == 0) || (count == 0))
+    return false;
+
+  *rect = extent;
+  rect->Translate(origin);
+  rect->Expand(thickness + 1.0f);
+  return true;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+void StatefulCanvas::StreamingPolyline::append(const ImVec2 *points, int n) {
+  assert((ring.Size > 0) && (buffer == ring.Data));
+
+  if (n > capacity) { // only the newest capacity points would survive
+    points += n - capacity;
+    n       = capacity;
+  }
+
+  if (count == 0)
+    extent = ImRect(ImVec2(FLT_MAX, FLT_MAX), ImVec2(-FLT_MAX, -FLT_MAX));
+
+  for (int i = 0; i < n; ++i) {
+    int tail = head + count;
+    ring[tail < capacity ? tail : tail - capacity] = points[i];
+    extent.Add(points[i]); // evicted points aren't subtracted -- stays conservative
+
+    if (count < capacity)
+      ++count;
+    else if (++head == capacity)
+      head = 0;
+  }
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+void StatefulCanvas::StreamingPolyline::evict(int n) {
+  n     = ImClamp(n, 0, count);
+  head  = (head + n) % capacity;
+  count -= n;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+void StatefulCanvas::StreamingPolyline::span(const ImVec2 *points, int capacity, int head, int count) {
+  assert((capacity > 0) && (head >= 0) && (head < capacity) && (count >= 0) && (count <= capacity));
+
+  if (points != ring.Data)
+    ring.clear();
+
+  buffer         = points;
+  this->capacity = capacity;
+  this->head     = head;
+  this->count    = count;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+void StatefulCanvas::Image::drawView(ImDrawList *drawList, const ImVec2 &loc, const View &view) {
+  ImVec2 offs;
+  viewOffset(loc, view, &offs);
+  drawList->AddImage(textureId, p0 * view.zoom + offs, p1 * view.zoom + offs, uv0, uv1, color);
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+void StatefulCanvas::ImageQuad::drawView(ImDrawList *drawList, const ImVec2 &loc, const View &view) {
+  ImVec2 offs;
+  viewOffset(loc, view, &offs);
+  drawList->AddImageQuad(textureId, p0 * view.zoom + offs, p1 * view.zoom + offs, p2 * view.zoom + offs, p3 * view.zoom + offs, uv0, uv1, uv2, uv3, color);
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+void StatefulCanvas::ImageRounded::drawView(ImDrawList *drawList, const ImVec2 &loc, const View &view) {
+  ImVec2 offs;
+  viewOffset(loc, view, &offs);
+  drawList->AddImageRounded(textureId, p0 * view.zoom + offs, p1 * view.zoom + offs, uv0, uv1, color, rounding * view.zoom, cornerFlags);
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+static bool SegmentOverlapsRect(const ImVec2 &a, const ImVec2 &b, const ImRect &rect) { // Liang-Barsky clip
+  ImVec2 d  = b - a;
+  float  p[4] = {-d.x, d.x, -d.y, d.y},
+         q[4] = {a.x - rect.Min.x, rect.Max.x - a.x, a.y - rect.Min.y, rect.Max.y - a.y},
+         t0   = 0.0f,
+         t1   = 1.0f;
+
+  for (int i = 0; i < 4; ++i) {
+    if (p[i] == 0.0f) {
+      if (q[i] < 0.0f)
+        return false;
+    }
+    else if (p[i] < 0.0f)
+      t0 = ImMax(t0, q[i] / p[i]);
+    else
+      t1 = ImMin(t1, q[i] / p[i]);
+
+    if (t0 > t1)
+      return false;
+  }
+
+  return true;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+struct PathVertices { // Vertex for the path helpers below -- vertex(i) returns path's ith point
+  ImVec2 operator()(int i) const { return points[i]; }
+
+  const ImVec2 *points;
+};
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+struct BezierVertices { // curve flattened to n points
+  ImVec2 operator()(int i) const { return ImBezierCalc(curve->p0, curve->p1, curve->p2, curve->p3, (float)i / (n - 1)); }
+
+  const StatefulCanvas::BezierCurve *curve;
+  int                               n;
+};
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+struct StreamingVertices { // ring buffer, oldest first
+  ImVec2 operator()(int i) const { return polyline->sample(i); }
+
+  const StatefulCanvas::StreamingPolyline *polyline;
+};
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+template<typename Vertex>
+static bool NearPath(const ImVec2 &point, int n, bool closed, float distance, Vertex vertex) { // point within distance of path's segments
+  float distanceSqr = distance * distance;
+
+  for (int i = 0, last = closed ? n : n - 1; i < last; ++i)
+    if (ImLengthSqr(point - ImLineClosestPoint(vertex(i), vertex((i + 1) % n), point)) <= distanceSqr)
+      return true;
+
+  return (n == 1) && (ImLengthSqr(point - vertex(0)) <= distanceSqr);
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+template<typename Vertex>
+static bool InsidePath(const ImVec2 &point, int n, Vertex vertex) { // even-odd rule
+  bool inside = false;
+
+  for (int i = 0, j = n - 1; i < n; j = i++) {
+    ImVec2 a = vertex(i),
+           b = vertex(j);
+
+    if (((a.y > point.y) != (b.y > point.y)) && (point.x < (b.x - a.x) * (point.y - a.y) / (b.y - a.y) + a.x))
+      inside = !inside;
+  }
+
+  return inside;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+template<typename Vertex>
+static bool PathOverlapsRect(const ImRect &rect, int n, bool closed, Vertex vertex) { // any segment of path overlaps rect
+  for (int i = 0, last = closed ? n : n - 1; i < last; ++i)
+    if (SegmentOverlapsRect(vertex(i), vertex((i + 1) % n), rect))
+      return true;
+
+  return (n == 1) && rect.Contains(vertex(0));
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+template<typename Vertex>
+static bool HitFilledPath(const ImVec2 &point, float tolerance, int n, Vertex vertex) {
+  return InsidePath(point, n, vertex) || ((tolerance > 0.0f) && NearPath(point, n, true, tolerance, vertex));
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+template<typename Vertex>
+static bool FilledPathOverlapsRect(const ImRect &rect, int n, Vertex vertex) {
+  return PathOverlapsRect(rect, n, true, vertex) || InsidePath(rect.Min, n, vertex); // crosses rect or encloses it
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+static bool InsideRoundedRect(const ImVec2 &point, const ImRect &rect, float rounding, ImDrawCornerFlags cornerFlags) {
+  if ((point.x < rect.Min.x) || (point.y < rect.Min.y) || (point.x > rect.Max.x) || (point.y > rect.Max.y))
+    return false;
+
+  rounding = ImMin(rounding, ImMin(rect.GetWidth(), rect.GetHeight()) * 0.5f);
+
+  bool left   = point.x < rect.Min.x + rounding,
+       right  = point.x > rect.Max.x - rounding,
+       top    = point.y < rect.Min.y + rounding,
+       bottom = point.y > rect.Max.y - rounding;
+  int  corner = top ? (left ? ImDrawCornerFlags_TopLeft : (right ? ImDrawCornerFlags_TopRight : 0)) :
+                (bottom ? (left ? ImDrawCornerFlags_BotLeft : (right ? ImDrawCornerFlags_BotRight : 0)) : 0);
+
+  if ((rounding <= 0.0f) || !(cornerFlags & corner))
+    return true;
+
+  ImVec2 center(left ? rect.Min.x + rounding : rect.Max.x - rounding, top ? rect.Min.y + rounding : rect.Max.y - rounding);
+  return ImLengthSqr(point - center) <= rounding * rounding;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+void StatefulCanvas::Primitive::drawView(ImDrawList *drawList, const ImVec2 &loc, const View &view) {
+  int vtx = drawList->VtxBuffer.Size;
+  draw(drawList, loc);
+
+  if (view.zoom != 1.0f)
+    for (int i = vtx; i < drawList->VtxBuffer.Size; ++i)
+      drawList->VtxBuffer[i].pos = loc + (drawList->VtxBuffer[i].pos - loc) * view.zoom;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+bool StatefulCanvas::Primitive::hitPoint(const ImVec2 &point, float tolerance) const {
+  ImRect rect;
+
+  if (!bounds(&rect))
+    return false;
+
+  rect.Expand(tolerance);
+  return (point.x >= rect.Min.x) && (point.y >= rect.Min.y) && (point.x <= rect.Max.x) && (point.y <= rect.Max.y);
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+bool StatefulCanvas::Primitive::hitRect(const ImRect &rect) const {
+  ImRect b;
+  return bounds(&b) && b.Overlaps(rect);
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+bool StatefulCanvas::Line::hitPoint(const ImVec2 &point, float tolerance) const {
+  float distance = thickness * 0.5f + tolerance;
+  return ImLengthSqr(point - ImLineClosestPoint(p0, p1, point)) <= distance * distance;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+bool StatefulCanvas::Line::hitRect(const ImRect &rect) const {
+  ImRect r(rect);
+  r.Expand(thickness * 0.5f);
+  return SegmentOverlapsRect(p0, p1, r);
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+bool StatefulCanvas::Rect::hitPoint(const ImVec2 &point, float tolerance) const { // inside outer edge of stroke but not inside its inner edge
+  float  h = thickness * 0.5f + tolerance;
+  ImRect outer(ImMin(p0, p1), ImMax(p0, p1)),
+         inner(outer);
+  outer.Expand(h);
+  inner.Expand(-h);
+  return InsideRoundedRect(point, outer, rounding + h, cornerFlags) &&
+         ((inner.Min.x > inner.Max.x) || (inner.Min.y > inner.Max.y) || !InsideRoundedRect(point, inner, rounding - h, cornerFlags));
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+bool StatefulCanvas::Rect::hitRect(const ImRect &rect) const {
+  float  h = thickness * 0.5f;
+  ImRect outer(ImMin(p0, p1), ImMax(p0, p1)),
+         inner(outer);
+  outer.Expand(h);
+  inner.Expand(-h);
+  return outer.Overlaps(rect) && !inner.Contains(rect);
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+bool StatefulCanvas::RectFilled::hitPoint(const ImVec2 &point, float tolerance) const {
+  ImRect rect(ImMin(p0, p1), ImMax(p0, p1));
+  rect.Expand(tolerance);
+  return InsideRoundedRect(point, rect, rounding + tolerance, cornerFlags);
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+bool StatefulCanvas::Quad::hitPoint(const ImVec2 &point, float tolerance) const {
+  const ImVec2 p[4] = {p0, p1, p2, p3};
+  return NearPath(point, 4, true, thickness * 0.5f + tolerance, PathVertices{p});
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+bool StatefulCanvas::Quad::hitRect(const ImRect &rect) const {
+  const ImVec2 p[4] = {p0, p1, p2, p3};
+  ImRect       r(rect);
+  r.Expand(thickness * 0.5f);
+  return PathOverlapsRect(r, 4, true, PathVertices{p});
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+bool StatefulCanvas::QuadFilled::hitPoint(const ImVec2 &point, float tolerance) const {
+  const ImVec2 p[4] = {p0, p1, p2, p3};
+  return HitFilledPath(point, tolerance, 4, PathVertices{p});
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+bool StatefulCanvas::QuadFilled::hitRect(const ImRect &rect) const {
+  const ImVec2 p[4] = {p0, p1, p2, p3};
+  return FilledPathOverlapsRect(rect, 4, PathVertices{p});
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+bool StatefulCanvas::Triangle::hitPoint(const ImVec2 &point, float tolerance) const {
+  const ImVec2 p[3] = {p0, p1, p2};
+  return NearPath(point, 3, true, thickness * 0.5f + tolerance, PathVertices{p});
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+bool StatefulCanvas::Triangle::hitRect(const ImRect &rect) const {
+  const ImVec2 p[3] = {p0, p1, p2};
+  ImRect       r(rect);
+  r.Expand(thickness * 0.5f);
+  return PathOverlapsRect(r, 3, true, PathVertices{p});
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+bool StatefulCanvas::TriangleFilled::hitPoint(const ImVec2 &point, float tolerance) const {
+  const ImVec2 p[3] = {p0, p1, p2};
+  return HitFilledPath(point, tolerance, 3, PathVertices{p});
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+bool StatefulCanvas::TriangleFilled::hitRect(const ImRect &rect) const {
+  const ImVec2 p[3] = {p0, p1, p2};
+  return FilledPathOverlapsRect(rect, 3, PathVertices{p});
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+bool StatefulCanvas::Circle::hitPoint(const ImVec2 &point, float tolerance) const {
+  float distance = sqrtf(ImLengthSqr(point - center)) - radius;
+  return ImFabs(distance) <= thickness * 0.5f + tolerance;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+bool StatefulCanvas::Circle::hitRect(const ImRect &rect) const { // rect reaches stroke but doesn't fit inside it
+  float  h = thickness * 0.5f;
+  ImVec2 farthest(ImMax(ImFabs(rect.Min.x - center.x), ImFabs(rect.Max.x - center.x)), ImMax(ImFabs(rect.Min.y - center.y), ImFabs(rect.Max.y - center.y)));
+  return (ImLengthSqr(center - ImClamp(center, rect.Min, rect.Max)) <= (radius + h) * (radius + h)) &&
+         ((radius <= h) || (ImLengthSqr(farthest) >= (radius - h) * (radius - h)));
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+bool StatefulCanvas::CircleFilled::hitPoint(const ImVec2 &point, float tolerance) const {
+  return ImLengthSqr(point - center) <= (radius + tolerance) * (radius + tolerance);
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+bool StatefulCanvas::CircleFilled::hitRect(const ImRect &rect) const {
+  return ImLengthSqr(center - ImClamp(center, rect.Min, rect.Max)) <= radius * radius;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+struct NgonVertices { // as ImDrawList::AddNgon() paths them
+  ImVec2 operator()(int i) const {
+    float a = (IM_PI * 2.0f) * (float)i / (float)segments;
+    return ImVec2(center.x + ImCos(a) * radius, center.y + ImSin(a) * radius);
+  }
+
+  ImVec2 center;
+  float  radius;
+  int    segments;
+};
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+bool StatefulCanvas::Ngon::hitPoint(const ImVec2 &point, float tolerance) const {
+  return NearPath(point, segments, true, thickness * 0.5f + tolerance, NgonVertices{center, radius, segments});
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+bool StatefulCanvas::Ngon::hitRect(const ImRect &rect) const {
+  ImRect r(rect);
+  r.Expand(thickness * 0.5f);
+  return PathOverlapsRect(r, segments, true, NgonVertices{center, radius, segments});
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+bool StatefulCanvas::NgonFilled::hitPoint(const ImVec2 &point, float tolerance) const {
+  return HitFilledPath(point, tolerance, segments, NgonVertices{center, radius, segments});
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+bool StatefulCanvas::NgonFilled::hitRect(const ImRect &rect) const {
+  return FilledPathOverlapsRect(rect, segments, NgonVertices{center, radius, segments});
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+bool StatefulCanvas::Polyline::hitPoint(const ImVec2 &point, float tolerance) const {
+  return NearPath(point, points.size(), closed, thickness * 0.5f + tolerance, PathVertices{points.Data});
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+bool StatefulCanvas::Polyline::hitRect(const ImRect &rect) const {
+  ImRect r(rect);
+  r.Expand(thickness * 0.5f);
+  return PathOverlapsRect(r, points.size(), closed, PathVertices{points.Data});
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+bool StatefulCanvas::ConvexPolyFilled::hitPoint(const ImVec2 &point, float tolerance) const {
+  return HitFilledPath(point, tolerance, points.size(), PathVertices{points.Data});
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+bool StatefulCanvas::ConvexPolyFilled::hitRect(const ImRect &rect) const {
+  return FilledPathOverlapsRect(rect, points.size(), PathVertices{points.Data});
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+bool StatefulCanvas::BezierCurve::hitPoint(const ImVec2 &point, float tolerance) const { // against curve flattened to its segment count
+  int n = (segments > 0 ? segments : 32) + 1;
+  return NearPath(point, n, false, thickness * 0.5f + tolerance, BezierVertices{this, n});
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+bool StatefulCanvas::BezierCurve::hitRect(const ImRect &rect) const {
+  int    n = (segments > 0 ? segments : 32) + 1;
+  ImRect r(rect);
+  r.Expand(thickness * 0.5f);
+  return PathOverlapsRect(r, n, false, BezierVertices{this, n});
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+bool StatefulCanvas::ImageQuad::hitPoint(const ImVec2 &point, float tolerance) const {
+  const ImVec2 p[4] = {p0, p1, p2, p3};
+  return HitFilledPath(point, tolerance, 4, PathVertices{p});
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+bool StatefulCanvas::ImageQuad::hitRect(const ImRect &rect) const {
+  const ImVec2 p[4] = {p0, p1, p2, p3};
+  return FilledPathOverlapsRect(rect, 4, PathVertices{p});
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+bool StatefulCanvas::ImageRounded::hitPoint(const ImVec2 &point, float tolerance) const {
+  ImRect rect(ImMin(p0, p1), ImMax(p0, p1));
+  rect.Expand(tolerance);
+  return InsideRoundedRect(point, rect, rounding + tolerance, cornerFlags);
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+bool StatefulCanvas::StreamingPolyline::hitPoint(const ImVec2 &point, float tolerance) const {
+  return NearPath(point - origin, count, false, thickness * 0.5f + tolerance, StreamingVertices{this});
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+bool StatefulCanvas::StreamingPolyline::hitRect(const ImRect &rect) const {
+  ImRect r(rect.Min - origin, rect.Max - origin);
+  r.Expand(thickness * 0.5f);
+  return PathOverlapsRect(r, count, false, StreamingVertices{this});
 }
 
 //--------------------------------------------------------------------------------------------------------------------------------------------------------------
@@ -30,8 +30,14 @@
 #define IMGUI_DEFINE_MATH_OPERATORS
 #endif
 #include "imgui/imgui_internal.h"
-#include <string>
 #include <type_traits>
+#include <algorithm>
+#include <new>
+#include <unordered_map>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <math.h>
 #include <assert.h>
 
 //--------------------------------------------------------------------------------------------------------------------------------------------------------------
@@ -41,20 +47,78 @@ namespace ImGui {
 class StatefulCanvas {
   public: // data types
     enum { DRAW_IDX_NONE = -1 };
-    typedef int draw_idx_t;
+    typedef ImS64 draw_idx_t; // generation in upper 32 bits, slot in lower 32 bits -- stale once its primitive is erased
+    enum { GROUP_ROOT = 0 };
+    typedef int group_idx_t; // invalid once its group is erased
+    enum PrimitiveType {
+      PrimitiveType_Line,
+      PrimitiveType_Rect,
+      PrimitiveType_RectFilled,
+      PrimitiveType_RectFilledMultiColor,
+      PrimitiveType_Quad,
+      PrimitiveType_QuadFilled,
+      PrimitiveType_Triangle,
+      PrimitiveType_TriangleFilled,
+      PrimitiveType_Circle,
+      PrimitiveType_CircleFilled,
+      PrimitiveType_Ngon,
+      PrimitiveType_NgonFilled,
+      PrimitiveType_Text,
+      PrimitiveType_Text2,
+      PrimitiveType_Polyline,
+      PrimitiveType_ConvexPolyFilled,
+      PrimitiveType_BezierCurve,
+      PrimitiveType_Image,
+      PrimitiveType_ImageQuad,
+      PrimitiveType_ImageRounded,
+      PrimitiveType_StreamingPolyline,
+      PrimitiveType_Custom, // heap allocated by client, deleted by canvas
+      PrimitiveType_COUNT,  // types from registerPrimitiveType() follow
+      PrimitiveType_MAX = PrimitiveType_COUNT + 32
+    };
+    enum LevelOfDetail {
+      LevelOfDetail_Off,
+      LevelOfDetail_MinMax,   // first, lowest, highest and last point per pixel column -- for series with increasing x
+      LevelOfDetail_Simplify, // Douglas-Peucker within a pixel tolerance -- for general paths
+      LevelOfDetail_Auto      // MinMax when x never decreases, otherwise Simplify
+    };
+    typedef void *(*AllocFunc)(size_t size, void *userData);
+    typedef void (*FreeFunc)(void *ptr, void *userData);
     struct Primitive;
+    typedef bool (*SaveCustomFunc)(const Primitive *primitive, ImU32 *typeId, ImVector<unsigned char> *data, void *userData); // false skips it
+    typedef Primitive *(*LoadCustomFunc)(ImU32 typeId, const unsigned char *data, int size, void *userData); // new T, or nullptr to skip
+    typedef int (*IngestFunc)(StatefulCanvas *canvas, int first, int n, void *userData); // adds items [first, first + n) -- returns items taken (< n when done)
+    struct View;
+    struct DrawIdxRange { // handles of primitives added by one bulk call -- consecutive values
+      draw_idx_t first;
+      int        count;
+      draw_idx_t operator[](int i) const { assert((i >= 0) && (i < count)); return first + i; }
+    };
+    struct Command;
+    struct MemoryUsage;
+#ifdef STATEFUL_CANVAS_STATS
+    struct Stats;
+#endif
 
   public:
     StatefulCanvas() = delete;
     StatefulCanvas(float width, float height);
     StatefulCanvas(float x, float y, float width, float height);
-    ~StatefulCanvas() { clear(); }
+    ~StatefulCanvas();
+    void setAllocatorFunctions(AllocFunc allocFunc, FreeFunc freeFunc, void *userData = nullptr); // built-in primitive pools -- call before adding any
+    static void countAllocations(AllocFunc allocFunc = nullptr, FreeFunc freeFunc = nullptr, void *userData = nullptr); // count ImGui::MemAlloc() calls, from 0
+    static ImU64 allocations(); // since last countAllocations() -- a warmed up draw() of an unchanged canvas adds none
+    static void transformPoints(ImVec2 *out, const ImVec2 *in, int n, float scale, const ImVec2 &offset); // out = in * scale + offset -- AVX or SSE2 if built
+    static void translatePoints(ImVec2 *out, const ImVec2 *in, int n, const ImVec2 &offset);             // out = in + offset -- all three may write in place
+    static void scalePoints(ImVec2 *out, const ImVec2 *in, int n, float scale);                           // out = in * scale
     void canvasSize(float width, float height) { assert((width > 0) && (height > 0)); size_ = {width, height}; }
     void canvasLocation(float x, float y) { useCursorPosition_ = false; location_ = {x, y}; }
     void pushZ(int z) { zStack_.push_back(z); } // push/pop draw order (low z draws first) for following primitive add calls
     void popZ() { assert(zStack_.size() > 0); zStack_.pop_back(); }
-    void pushClipRect(const ImVec2 &min, const ImVec2 &max); // push/pop a clip rect for following primitive add calls
+    void pushClipRect(const ImVec2 &min, const ImVec2 &max); // push/pop a clip rect (screen space) for following primitive add calls
     void popClipRect();
+    void pushGroup(group_idx_t group) { assert(groups_[group].live); groupStack_.push_back(group); } // push/pop group for following primitive add calls
+    void popGroup() { assert(groupStack_.size() > 0); groupStack_.pop_back(); }
     draw_idx_t line(const ImVec2 &p0, const ImVec2 &p1, ImU32 color, float thickness = 1.0f);
     draw_idx_t rect(const ImVec2 &min, const ImVec2 &max, ImU32 color, float rounding = 0.0f,
                     ImDrawCornerFlags roundingCorners = ImDrawCornerFlags_All, float thickness = 1.0f);
@@ -72,8 +136,11 @@ class StatefulCanvas {
     draw_idx_t text(const ImVec2 &pos, ImU32 color, const char *textBegin, const char *textEnd = nullptr);
     draw_idx_t text(const ImFont *font, float fontSize, const ImVec2 &pos, ImU32 color,
                     const char *textBegin, const char *textEnd = nullptr, float wrapWidth = 0.0f, const ImVec4 *cpuFineClipRect = nullptr);
+    draw_idx_t text(const ImVec2 &pos, ImU32 color, std::string_view string); // need not be nul terminated
     draw_idx_t polyline(const ImVec2 *points, int nPoints, ImU32 color, bool closed, float thickness = 1.0f);
+    draw_idx_t polyline(ImVector<ImVec2> &&points, ImU32 color, bool closed, float thickness = 1.0f); // adopts points' buffer -- points is left empty
     draw_idx_t convexPolyFilled(const ImVec2 *points, int nPoints, ImU32 color);
+    draw_idx_t convexPolyFilled(ImVector<ImVec2> &&points, ImU32 color);
     draw_idx_t bezierCurve(const ImVec2 &p0, const ImVec2 &p1, const ImVec2 &p2, const ImVec2 &p3, ImU32 color, float thickness = 1.0f, int nSegments = 0);
     draw_idx_t image(ImTextureID textureId, const ImVec2 &min, const ImVec2 &max, const ImVec2 &uvMin = ImVec2(0, 0), const ImVec2 &uvMax = ImVec2(1, 1),
                      ImU32 color = IM_COL32_WHITE);
@@ -81,45 +148,172 @@ class StatefulCanvas {
                          const ImVec2 &uv1 = ImVec2(1, 0), const ImVec2 &uv2 = ImVec2(1, 1), const ImVec2 &uv3 = ImVec2(0, 1), ImU32 color = IM_COL32_WHITE);
     draw_idx_t imageRounded(ImTextureID textureId, const ImVec2 &min, const ImVec2 &max, const ImVec2 &uvMin, const ImVec2 &uvMax, ImU32 color,
                             float rounding, ImDrawCornerFlags roundingCorners = ImDrawCornerFlags_All);
+    draw_idx_t streamingPolyline(int capacity, ImU32 color, float thickness = 1.0f); // empty ring buffer of capacity points
+    draw_idx_t streamingPolyline(const ImVec2 *points, int capacity, int head, int count, ImU32 color, float thickness = 1.0f); // client span, not copied
     draw_idx_t custom(Primitive *c); // add custom object to draw list
+    template<typename T>
+    PrimitiveType registerPrimitiveType(ImU32 typeId = 0); // pooled, drawn without virtual dispatch -- typeId: snapshot key, stable across builds (0: unsaved)
+    template<typename T, typename... Args>
+    draw_idx_t emplace(Args &&...args); // add T(args...), of a registered type
+    void reserve(int n, PrimitiveType type = PrimitiveType_Custom); // room for n more primitives (of a built-in or registered type) at current z
+    DrawIdxRange lines(const ImVec2 *p0s, const ImVec2 *p1s, const ImU32 *colors, int n, float thickness = 1.0f); // bulk adds sharing current z and clip rect
+    DrawIdxRange rectsFilled(const ImVec2 *mins, const ImVec2 *maxs, const ImU32 *colors, int n, float rounding = 0.0f,
+                             ImDrawCornerFlags roundingCorners = ImDrawCornerFlags_All);
+    DrawIdxRange circles(const ImVec2 *centers, const float *radii, const ImU32 *colors, int n, int nSegments = 12, float thickness = 1.0f);
+    DrawIdxRange texts(const ImVec2 *positions, const ImU32 *colors, const char *const *strings, int n);
+    bool valid(draw_idx_t idx) const; // false once primitive has been erased (or canvas cleared)
     bool visible(draw_idx_t idx) const;
     void visible(draw_idx_t idx, bool state);
-    void draw(const char *label, bool clip = true) const;
+    int z(draw_idx_t idx) const;
+    void setZ(draw_idx_t idx, int z); // move primitive to draw order z -- it draws on top of primitives already there
+    void raise(draw_idx_t idx);       // draw primitive on top of all others with the same z
+    void lower(draw_idx_t idx);       // draw primitive beneath all others with the same z
+    void dragAndDropStart(draw_idx_t idx, int z); // canvas-aware variants of Primitive drag and drop calls (keeps z offsets indexed)
+    void dragAndDropUpdate(draw_idx_t idx, float x, float y);
+    void dragAndDropEnd(draw_idx_t idx);
+    void dragAndDropEnd(draw_idx_t idx, float x, float y);
+    void moveTo(draw_idx_t idx, float x, float y); // canvas-aware Primitive::moveTo (keeps bounds indexed)
+    void translate(const draw_idx_t *handles, int n, float dx, float dy); // moveTo() for each, run by type without virtual calls
+    void translateAll(float dx, float dy); // every primitive's geometry -- a group offset moves them without rewriting points
+    group_idx_t newGroup(group_idx_t parent = GROUP_ROOT); // members draw at the group's offset, composed with its ancestors'
+    void eraseGroup(group_idx_t group);                     // erases its primitives too -- child groups must be erased first
+    group_idx_t group(draw_idx_t idx) const;
+    void setGroup(draw_idx_t idx, group_idx_t group);
+    void groupMove(group_idx_t group, float x, float y); // all members, without touching their coordinates
+    ImVec2 groupOffset(group_idx_t group) const { assert(groups_[group].live); return groups_[group].offset; }
+    bool groupVisible(group_idx_t group) const { assert(groups_[group].live); return groups_[group].visible; }
+    void groupVisible(group_idx_t group, bool state);
+    void groupDragAndDropStart(group_idx_t group, int z); // group variants of drag and drop calls -- members follow without per primitive updates
+    void groupDragAndDropUpdate(group_idx_t group, float x, float y);
+    void groupDragAndDropEnd(group_idx_t group);
+    void groupDragAndDropEnd(group_idx_t group, float x, float y); // drop is committed to the group offset
+    void setPoints(draw_idx_t idx, const ImVec2 *points, int nPoints); // Polyline or ConvexPolyFilled, reusing its capacity
+    void setPoints(draw_idx_t idx, ImVector<ImVec2> &&points);          // swapped -- points receives the previous points, to refill for the next update
+    void setText(draw_idx_t idx, std::string_view string);            // Text or Text2 -- longer strings are stored anew (see packStrings())
+    void levelOfDetail(draw_idx_t idx, LevelOfDetail mode, float tolerance = 0.5f); // Polyline or ConvexPolyFilled drawn decimated to pixel resolution
+    void streamAppend(draw_idx_t idx, const ImVec2 *points, int n); // canvas-aware StreamingPolyline calls -- streamSpan() also after changing span
+    void streamEvict(draw_idx_t idx, int n);
+    void streamSpan(draw_idx_t idx, const ImVec2 *points, int capacity, int head, int count);
+    void spatialIndex(bool state, float cellSize = 128.0f); // grid of primitive bounds for pick() and to cull uncached draws to the visible region
+    draw_idx_t pick(const ImVec2 &point, float tolerance = 0.0f) const; // topmost visible primitive at point (canvas space) or DRAW_IDX_NONE
+    int pick(const ImVec2 &point, float tolerance, ImVector<draw_idx_t> *hits) const; // all visible primitives at point, topmost first -- returns count
+    draw_idx_t pickRect(const ImVec2 &min, const ImVec2 &max) const;                  // topmost visible primitive overlapping rect or DRAW_IDX_NONE
+    int pickRect(const ImVec2 &min, const ImVec2 &max, ImVector<draw_idx_t> *hits) const;
+    void view(const View &view) { assert(view.zoom > 0.0f); view_ = view; } // pan and zoom applied by draw() -- stored geometry is untouched
+    const View &view() const { return view_; }
+    void pan(float dx, float dy) { view_.pan += ImVec2(dx, dy); }
+    void zoom(float factor, const ImVec2 &pivot); // zoom about a screen position (e.g. the mouse), which keeps showing the same canvas point
+    ImVec2 toCanvas(const ImVec2 &screen) const { return (screen - drawLocation_ - view_.pan) / view_.zoom; } // using location of last draw()
+    ImVec2 toScreen(const ImVec2 &point) const { return drawLocation_ + view_.pan + point * view_.zoom; }
+    void batchByType(bool state) { batchByType_ = state; } // draw z layers grouped by type without virtual calls (may reorder overlapping types)
+    void sortByState(bool state) { sortByState_ = state; invalidate(); } // draw z layers grouped by clip rect and texture (may reorder overlapping primitives)
+    int drawCmds() const { return drawCmds_; }         // draw commands emitted by last draw()
+    int stateChanges() const { return stateChanges_; } // clip rect or texture changes in z order during last draw() -- what sortByState() groups
+    void cacheGeometry(bool state); // keep each z layer's tessellated output, redrawn only after it changes -- unchanged layers are copied
+    void invalidate();              // mark cached geometry stale -- needed after changing a primitive through a pointer kept from item<T>()
+    void parallelDraw(int threads); // tessellate on threads (caller included) into presized draw lists spliced back in z order -- 1 draws serially
+    void queueReserve(int handles); // handles for queued adds between draw()s, topped up by each -- 64 by default, queued adds past it assert
+    draw_idx_t queueLine(const ImVec2 &p0, const ImVec2 &p1, ImU32 color, float thickness = 1.0f, int z = 0); // thread safe -- applied by next draw()
+    draw_idx_t queueRectFilled(const ImVec2 &min, const ImVec2 &max, ImU32 color, int z = 0); // DRAW_IDX_NONE: ran past queueReserve() -- still added
+    draw_idx_t queueCircle(const ImVec2 &center, float radius, ImU32 color, int nSegments = 12, float thickness = 1.0f, int z = 0);
+    draw_idx_t queueText(const ImVec2 &pos, ImU32 color, const char *textBegin, const char *textEnd = nullptr, int z = 0);
+    draw_idx_t queueText(const ImVec2 &pos, ImU32 color, std::string &&string, int z = 0); // moved into the queue rather than copied
+    draw_idx_t queuePolyline(const ImVec2 *points, int nPoints, ImU32 color, bool closed, float thickness = 1.0f, int z = 0);
+    draw_idx_t queuePolyline(std::vector<ImVec2> &&points, ImU32 color, bool closed, float thickness = 1.0f, int z = 0);
+    draw_idx_t queueCustom(Primitive *c, int z = 0);
+    template<typename T, typename Init>
+    draw_idx_t queueAdd(PrimitiveType type, int z, Init init); // init(T *primitive) runs when applied -- queued adds ignore clip rect and group stacks
+    void queueErase(draw_idx_t idx);
+    void queueVisible(draw_idx_t idx, bool state);
+    void queueSetZ(draw_idx_t idx, int z);
+    void queueMoveTo(draw_idx_t idx, float x, float y);
+    template<typename T, typename Update>
+    void queueUpdate(draw_idx_t idx, Update update); // update(T *primitive) through item<T>() when applied -- skipped for stale handles
+    void applyQueue();                               // apply queued changes now -- draw() calls it first
+    void ingest(IngestFunc func, int items, void *userData = nullptr); // add a large scene across frames -- draw() calls func within its ingest budget
+    void ingestBudget(float ms) { assert(ms > 0.0f); ingestBudget_ = ms; } // per draw() -- default 2 ms
+    void applyIngest(float ms); // ingest for about ms now -- func starts from empty z, clip rect and group stacks, and pushes any it needs
+    bool ingesting() const { return ingests_.size() > 0; }
+    float ingestProgress() const { return ingestItems_ ? (float)((double)ingestDone_ / ingestItems_) : 1.0f; } // of ingests since last idle
+    void draw(const char *label, bool clip = true);
+#ifdef STATEFUL_CANVAS_STATS
+    const Stats &stats() const { return stats_; } // of last draw()
+    void drawStatsWindow(const char *title = "Canvas Stats", bool *open = nullptr) const;
+#endif
     void erase(draw_idx_t idx);
-    void clear();
+    void clear(); // cancels ingests too
+    void compact(); // pack primitives, strings and slots left sparse by erase() -- handles stay valid, pointers from item<T>() do not
+    void autoCompact(float holeRatio) { assert((holeRatio >= 0.0f) && (holeRatio < 1.0f)); compactRatio_ = holeRatio; } // 0 (default) never -- see compactDue()
+    MemoryUsage memoryUsage() const;
+    bool save(const char *path) const; // snapshot of primitives in draw order -- queued changes not yet applied are left out
+    bool load(const char *path, DrawIdxRange *range = nullptr); // replace primitives with a snapshot's -- range gets their handles, in draw order
+    void snapshotCustom(SaveCustomFunc saveFunc, LoadCustomFunc loadFunc, void *userData = nullptr); // for custom() and registered primitives
     template<typename T>
-    T* item(draw_idx_t idx); // low-level mutator
+    T* item(draw_idx_t idx); // low-level mutator -- returns nullptr for stale handles
 
   public: // data types
+    struct View { // canvas to screen transform applied by draw() -- screen = canvas location + pan + point * zoom
+      // methods
+      View() { pan = ImVec2(0, 0); zoom = 1.0f; scaleThickness = true; autoSegments = false; }
+      float stroke(float thickness) const { return scaleThickness ? thickness * zoom : thickness; }
+      int circleSegments(int segments) const { return autoSegments ? 0 : segments; }
+
+      // data members
+      ImVec2 pan;
+      float  zoom;
+      bool   scaleThickness, // strokes zoom with geometry, otherwise they keep their pixel width
+             autoSegments;   // circles tessellate for their on screen radius rather than stored segment counts
+    };
     struct Primitive {
       // methods
       Primitive() {
-        z       = 0;
-        offsetX = 0;
-        offsetY = 0;
-        offsetZ = 0;
-        visible = true;
-        clip    = false;
+        z           = 0;
+        offsetX     = 0;
+        offsetY     = 0;
+        offsetZ     = 0;
+        visible     = true;
+        clip        = false;
+        type        = PrimitiveType_Custom;
+        clipRectIdx = -1;
+        group       = GROUP_ROOT;
       }
       virtual ~Primitive() { }
       virtual void draw(ImDrawList *drawList, const ImVec2 &loc) = 0;
+      virtual void drawView(ImDrawList *drawList, const ImVec2 &loc, const View &view); // draw() zoomed -- default scales the vertices draw() emits
       virtual void moveTo(float x, float y) = 0;
-      void dragAndDropStart(int z) { offsetZ = z; }
+      virtual bool bounds(ImRect *rect) const { (void)rect; return false; } // canvas space bounds, excluding offsets -- false when unknown
+      virtual bool hitPoint(const ImVec2 &point, float tolerance) const; // point (canvas space, excluding offsets) within tolerance of primitive
+      virtual bool hitRect(const ImRect &rect) const;                   // primitive overlaps rect -- both default to testing bounds()
+      void dragAndDropStart(int z) { offsetZ = z; } // on a canvas, draw() picks up the offset a frame late -- see StatefulCanvas::dragAndDropStart()
       void dragAndDropUpdate(float x, float y) { offsetX = x; offsetY = y; }
       void dragAndDropEnd() { offsetX = 0; offsetY = 0; offsetZ = 0; }
       void dragAndDropEnd(float x, float y) { offsetX = 0; offsetY = 0; offsetZ = 0; moveTo(x, y); }
       void offset(const ImVec2 &loc, ImVec2 *offset) const { *offset = loc; offset->x += offsetX; offset->y += offsetY; }
+      void viewOffset(const ImVec2 &loc, const View &view, ImVec2 *offset) const { *offset = loc + ImVec2(offsetX, offsetY) * view.zoom; }
 
       // data members
-      int    z,
-             offsetZ; // offsets for client drag and drop functionality
-      float  offsetX, offsetY;
-      bool   visible,
-             clip;
-      ImVec4 clipRect;
+      int           z, // maintained by canvas -- use StatefulCanvas::setZ() to change (asserted by item<T>() and draw())
+                    offsetZ; // offsets for client drag and drop functionality
+      float         offsetX, offsetY;
+      bool          visible,
+                    clip;
+      unsigned char type; // PrimitiveType -- set by canvas
+      ImVec4        clipRect; // set by canvas when clip is set
+      int           clipRectIdx; // canvas's interned clipRect -- identifies it for sortByState() and snapshots
+      group_idx_t   group; // maintained by canvas -- use StatefulCanvas::setGroup() to change
+    };
+    template<typename T>
+    struct OwnedVector : ImVector<T> { // moved by swapping buffers, so compact() relocates primitives without copying (or dangling) their arrays
+      using ImVector<T>::operator=;
+      OwnedVector() = default;
+      OwnedVector(const OwnedVector &) = default;
+      OwnedVector(OwnedVector &&other) noexcept { this->swap(other); }
+      OwnedVector &operator=(const OwnedVector &) = default;
+      OwnedVector &operator=(OwnedVector &&other) noexcept { this->swap(other); return *this; }
     };
     struct Center {
       void move(float x, float y) { center += ImVec2(x, y); }
+      void extent(ImRect *rect, float radius) const { *rect = ImRect(center - ImVec2(radius, radius), center + ImVec2(radius, radius)); }
       ImVec2 center;
     };
     struct Point {
@@ -128,25 +322,29 @@ class StatefulCanvas {
     };
     struct Points2 {
       void move(float x, float y) { ImVec2 m(x, y); p0 += m; p1 += m; }
+      void extent(ImRect *rect, float expand) const { *rect = ImRect(ImMin(p0, p1), ImMax(p0, p1)); rect->Expand(expand); }
       ImVec2 p0, p1;
     };
     struct Points3 {
       void move(float x, float y) { ImVec2 m(x, y); p0 += m; p1 += m; p2 += m; }
+      void extent(ImRect *rect, float expand) const { *rect = ImRect(ImMin(ImMin(p0, p1), p2), ImMax(ImMax(p0, p1), p2)); rect->Expand(expand); }
       ImVec2 p0, p1, p2;
     };
     struct Points4 {
       void move(float x, float y) { ImVec2 m(x, y); p0 += m; p1 += m; p2 += m; p3 += m; }
+      void extent(ImRect *rect, float expand) const {
+        *rect = ImRect(ImMin(ImMin(p0, p1), ImMin(p2, p3)), ImMax(ImMax(p0, p1), ImMax(p2, p3)));
+        rect->Expand(expand);
+      }
       ImVec2 p0, p1, p2, p3;
     };
     struct Points {
       // methods
-      Points(int size) { adjustedPoints = new ImVec2[size]; }
-      virtual ~Points() { delete [] adjustedPoints; }
       void move(float x, float y);
+      void extent(ImRect *rect, float expand) const;
 
       // data members
-      ImVector<ImVec2> points;
-      ImVec2           *adjustedPoints;
+      OwnedVector<ImVec2> points;
     };
     struct Color { ImU32 color; };
     struct Color4 { ImU32 color0, color1, color2, color3; };
@@ -154,67 +352,162 @@ class StatefulCanvas {
     struct Rounding { float rounding; };
     struct Radius { float radius; };
     struct Segments { int segments; };
-    struct String { std::string string; };
+    struct String { // stored in canvas's string arena (nul terminated) -- change through StatefulCanvas::setText()
+      // methods
+      const char *text() const { return string; } // valid until the next setText(), erase(), eraseGroup(), compact() or clear()
+      const char *textEnd() const { return stringEnd; }
+
+    protected:
+      friend class StatefulCanvas;
+
+      // data members
+      const char *string,
+                 *stringEnd;
+    };
     struct CornerFlags { ImDrawCornerFlags cornerFlags; };
+    struct Lod { // decimated copy of Points, rebuilt when points or pixel scale change
+      // methods
+      Lod() { lodMode = LevelOfDetail_Off; lodTolerance = 0.5f; lodScale = 1.0f; lodCachedScale = 0.0f; lodDirty = true; }
+      const ImVector<ImVec2> &lodPoints(const ImVector<ImVec2> &points);
+
+      // data members
+      OwnedVector<ImVec2> lodCache;
+      int                 lodMode; // LevelOfDetail
+      float               lodTolerance,   // pixels
+                          lodScale,       // pixels per canvas unit
+                          lodCachedScale; // lodCache was built for
+      bool                lodDirty;       // points changed
+    };
+    struct TextLayout { // glyph quads of a string laid out for one font, size and wrap width -- rebuilt when any of them change
+      // methods
+      struct Glyph { ImVec2 p0, p1, uv0, uv1; }; // p relative to floored text position
+      TextLayout() { layoutFont = nullptr; measureFont = nullptr; }
+      void layout(const ImFont *font, float size, float wrapWidth, const char *text, const char *textEnd);
+      void render(ImDrawList *drawList, const ImVec2 &pos, ImU32 color) const;
+      ImVec2 measure(const ImFont *font, float size, float wrapWidth, const char *text, const char *textEnd) const; // cached CalcTextSizeA()
+      void invalidateLayout() { layoutFont = nullptr; measureFont = nullptr; }
+
+      // data members
+      OwnedVector<Glyph>   glyphs;
+      const ImFont         *layoutFont;
+      ImTextureID          layoutTexture; // font atlas rebuilds change it
+      float                layoutSize,
+                           layoutWrap;
+      mutable const ImFont *measureFont;
+      mutable float        measureSize,
+                           measureWrap;
+      mutable ImVec2       measured;
+    };
     struct Texture { ImTextureID textureId; };
     struct UVs2 { ImVec2 uv0, uv1; };
     struct UVs4 { ImVec2 uv0, uv1, uv2, uv3; };
     struct Line : Primitive, Points2, Color, Thickness {
-      virtual void draw(ImDrawList *drawList, const ImVec2 &loc) override;
+      virtual void draw(ImDrawList *drawList, const ImVec2 &loc) override { drawView(drawList, loc, View()); }
+      virtual void drawView(ImDrawList *drawList, const ImVec2 &loc, const View &view) override;
       virtual void moveTo(float x, float y) override { move(x, y); }
+      virtual bool bounds(ImRect *rect) const override { Points2::extent(rect, thickness * 0.5f + 1.0f); return true; }
+      virtual bool hitPoint(const ImVec2 &point, float tolerance) const override;
+      virtual bool hitRect(const ImRect &rect) const override;
     };
     struct Rect : Primitive, Points2, Color, Rounding, CornerFlags, Thickness {
-      virtual void draw(ImDrawList *drawList, const ImVec2 &loc) override;
+      virtual void draw(ImDrawList *drawList, const ImVec2 &loc) override { drawView(drawList, loc, View()); }
+      virtual void drawView(ImDrawList *drawList, const ImVec2 &loc, const View &view) override;
       virtual void moveTo(float x, float y) override { move(x, y); }
+      virtual bool bounds(ImRect *rect) const override { Points2::extent(rect, thickness * 0.5f + 1.0f); return true; }
+      virtual bool hitPoint(const ImVec2 &point, float tolerance) const override;
+      virtual bool hitRect(const ImRect &rect) const override;
     };
     struct RectFilled : Primitive, Points2, Color, Rounding, CornerFlags {
-      virtual void draw(ImDrawList *drawList, const ImVec2 &loc) override;
+      virtual void draw(ImDrawList *drawList, const ImVec2 &loc) override { drawView(drawList, loc, View()); }
+      virtual void drawView(ImDrawList *drawList, const ImVec2 &loc, const View &view) override;
       virtual void moveTo(float x, float y) override { move(x, y); }
+      virtual bool bounds(ImRect *rect) const override { Points2::extent(rect, 1.0f); return true; }
+      virtual bool hitPoint(const ImVec2 &point, float tolerance) const override;
     };
     struct RectFilledMultiColor : Primitive, Points2, Color4 {
-      virtual void draw(ImDrawList *drawList, const ImVec2 &loc) override;
+      virtual void draw(ImDrawList *drawList, const ImVec2 &loc) override { drawView(drawList, loc, View()); }
+      virtual void drawView(ImDrawList *drawList, const ImVec2 &loc, const View &view) override;
       virtual void moveTo(float x, float y) override { move(x, y); }
+      virtual bool bounds(ImRect *rect) const override { Points2::extent(rect, 1.0f); return true; }
     };
     struct Quad : Primitive, Points4, Color, Thickness {
-      virtual void draw(ImDrawList *drawList, const ImVec2 &loc) override;
+      virtual void draw(ImDrawList *drawList, const ImVec2 &loc) override { drawView(drawList, loc, View()); }
+      virtual void drawView(ImDrawList *drawList, const ImVec2 &loc, const View &view) override;
       virtual void moveTo(float x, float y) override { move(x, y); }
+      virtual bool bounds(ImRect *rect) const override { Points4::extent(rect, thickness * 0.5f + 1.0f); return true; }
+      virtual bool hitPoint(const ImVec2 &point, float tolerance) const override;
+      virtual bool hitRect(const ImRect &rect) const override;
     };
     struct QuadFilled : Primitive, Points4, Color {
-      virtual void draw(ImDrawList *drawList, const ImVec2 &loc) override;
+      virtual void draw(ImDrawList *drawList, const ImVec2 &loc) override { drawView(drawList, loc, View()); }
+      virtual void drawView(ImDrawList *drawList, const ImVec2 &loc, const View &view) override;
       virtual void moveTo(float x, float y) override { move(x, y); }
+      virtual bool bounds(ImRect *rect) const override { Points4::extent(rect, 1.0f); return true; }
+      virtual bool hitPoint(const ImVec2 &point, float tolerance) const override;
+      virtual bool hitRect(const ImRect &rect) const override;
     };
     struct Triangle : Primitive, Points3, Color, Thickness {
-      virtual void draw(ImDrawList *drawList, const ImVec2 &loc) override;
+      virtual void draw(ImDrawList *drawList, const ImVec2 &loc) override { drawView(drawList, loc, View()); }
+      virtual void drawView(ImDrawList *drawList, const ImVec2 &loc, const View &view) override;
       virtual void moveTo(float x, float y) override { move(x, y); }
+      virtual bool bounds(ImRect *rect) const override { Points3::extent(rect, thickness * 0.5f + 1.0f); return true; }
+      virtual bool hitPoint(const ImVec2 &point, float tolerance) const override;
+      virtual bool hitRect(const ImRect &rect) const override;
     };
     struct TriangleFilled : Primitive, Points3, Color {
-      virtual void draw(ImDrawList *drawList, const ImVec2 &loc) override;
+      virtual void draw(ImDrawList *drawList, const ImVec2 &loc) override { drawView(drawList, loc, View()); }
+      virtual void drawView(ImDrawList *drawList, const ImVec2 &loc, const View &view) override;
       virtual void moveTo(float x, float y) override { move(x, y); }
+      virtual bool bounds(ImRect *rect) const override { Points3::extent(rect, 1.0f); return true; }
+      virtual bool hitPoint(const ImVec2 &point, float tolerance) const override;
+      virtual bool hitRect(const ImRect &rect) const override;
     };
     struct Circle : Primitive, Center, Radius, Color, Segments, Thickness {
-      virtual void draw(ImDrawList *drawList, const ImVec2 &loc) override;
+      virtual void draw(ImDrawList *drawList, const ImVec2 &loc) override { drawView(drawList, loc, View()); }
+      virtual void drawView(ImDrawList *drawList, const ImVec2 &loc, const View &view) override;
       virtual void moveTo(float x, float y) override { move(x, y); }
+      virtual bool bounds(ImRect *rect) const override { Center::extent(rect, radius + thickness * 0.5f + 1.0f); return true; }
+      virtual bool hitPoint(const ImVec2 &point, float tolerance) const override;
+      virtual bool hitRect(const ImRect &rect) const override;
     };
     struct CircleFilled : Primitive, Center, Radius, Color, Segments {
-      virtual void draw(ImDrawList *drawList, const ImVec2 &loc) override;
+      virtual void draw(ImDrawList *drawList, const ImVec2 &loc) override { drawView(drawList, loc, View()); }
+      virtual void drawView(ImDrawList *drawList, const ImVec2 &loc, const View &view) override;
       virtual void moveTo(float x, float y) override { move(x, y); }
+      virtual bool bounds(ImRect *rect) const override { Center::extent(rect, radius + 1.0f); return true; }
+      virtual bool hitPoint(const ImVec2 &point, float tolerance) const override;
+      virtual bool hitRect(const ImRect &rect) const override;
     };
     struct Ngon : Primitive, Center, Radius, Color, Segments, Thickness {
-      virtual void draw(ImDrawList *drawList, const ImVec2 &loc) override;
+      virtual void draw(ImDrawList *drawList, const ImVec2 &loc) override { drawView(drawList, loc, View()); }
+      virtual void drawView(ImDrawList *drawList, const ImVec2 &loc, const View &view) override;
       virtual void moveTo(float x, float y) override { move(x, y); }
+      virtual bool bounds(ImRect *rect) const override { Center::extent(rect, radius + thickness * 0.5f + 1.0f); return true; }
+      virtual bool hitPoint(const ImVec2 &point, float tolerance) const override;
+      virtual bool hitRect(const ImRect &rect) const override;
     };
     struct NgonFilled : Primitive, Center, Radius, Color, Segments {
-      virtual void draw(ImDrawList *drawList, const ImVec2 &loc) override;
+      virtual void draw(ImDrawList *drawList, const ImVec2 &loc) override { drawView(drawList, loc, View()); }
+      virtual void drawView(ImDrawList *drawList, const ImVec2 &loc, const View &view) override;
       virtual void moveTo(float x, float y) override { move(x, y); }
+      virtual bool bounds(ImRect *rect) const override { Center::extent(rect, radius + 1.0f); return true; }
+      virtual bool hitPoint(const ImVec2 &point, float tolerance) const override;
+      virtual bool hitRect(const ImRect &rect) const override;
     };
-    struct Text : Primitive, Point, Color, String {
-      virtual void draw(ImDrawList *drawList, const ImVec2 &loc) override;
+    struct Text : Primitive, Point, Color, String, TextLayout {
+      virtual void draw(ImDrawList *drawList, const ImVec2 &loc) override { drawView(drawList, loc, View()); }
+      virtual void drawView(ImDrawList *drawList, const ImVec2 &loc, const View &view) override;
       virtual void moveTo(float x, float y) override { move(x, y); }
+      virtual bool bounds(ImRect *rect) const override;
+      void prepareView(const ImDrawList *drawList, const View &view); // layout drawView() renders -- parallel draws run it on the drawing thread
     };
-    struct Text2 : Primitive, Point, Color, String {
+    struct Text2 : Primitive, Point, Color, String, TextLayout {
       // methods
-      virtual void draw(ImDrawList *drawList, const ImVec2 &loc) override;
+      virtual void draw(ImDrawList *drawList, const ImVec2 &loc) override { drawView(drawList, loc, View()); }
+      virtual void drawView(ImDrawList *drawList, const ImVec2 &loc, const View &view) override;
       virtual void moveTo(float x, float y) override { move(x, y); }
+      virtual bool bounds(ImRect *rect) const override;
+      void prepareView(const ImDrawList *drawList, const View &view); // as Text's
 
       // data members
       const ImFont *font;
@@ -222,62 +515,725 @@ class StatefulCanvas {
       float        wrapWidth;
       const ImVec4 *cpuFineClipRect;
     };
-    struct Polyline : Primitive, Points, Color, Thickness {
+    struct Polyline : Primitive, Points, Color, Thickness, Lod {
       // methods
-      Polyline(int size) : Points(size) { }
-      virtual void draw(ImDrawList *drawList, const ImVec2 &loc) override;
-      virtual void moveTo(float x, float y) override { move(x, y); }
+      virtual void draw(ImDrawList *drawList, const ImVec2 &loc) override { drawView(drawList, loc, View()); }
+      virtual void drawView(ImDrawList *drawList, const ImVec2 &loc, const View &view) override;
+      virtual void moveTo(float x, float y) override { move(x, y); lodDirty = true; }
+      virtual bool bounds(ImRect *rect) const override { Points::extent(rect, thickness + 1.0f); return true; }
+      virtual bool hitPoint(const ImVec2 &point, float tolerance) const override;
+      virtual bool hitRect(const ImRect &rect) const override;
+      const ImVector<ImVec2> &prepareView(const View &view); // level of detail drawView() strokes -- parallel draws run it on the drawing thread
 
       // data members
       bool closed;
     };
-    struct ConvexPolyFilled : Primitive, Points, Color {
-      ConvexPolyFilled(int size) : Points(size) { }
-      virtual void draw(ImDrawList *drawList, const ImVec2 &loc) override;
-      virtual void moveTo(float x, float y) override { move(x, y); }
+    struct ConvexPolyFilled : Primitive, Points, Color, Lod {
+      virtual void draw(ImDrawList *drawList, const ImVec2 &loc) override { drawView(drawList, loc, View()); }
+      virtual void drawView(ImDrawList *drawList, const ImVec2 &loc, const View &view) override;
+      virtual void moveTo(float x, float y) override { move(x, y); lodDirty = true; }
+      virtual bool bounds(ImRect *rect) const override { Points::extent(rect, 1.0f); return true; }
+      virtual bool hitPoint(const ImVec2 &point, float tolerance) const override;
+      virtual bool hitRect(const ImRect &rect) const override;
+      const ImVector<ImVec2> &prepareView(const View &view); // as Polyline's
     };
     struct BezierCurve : Primitive, Points4, Color, Thickness, Segments {
-      virtual void draw(ImDrawList *drawList, const ImVec2 &loc) override;
+      virtual void draw(ImDrawList *drawList, const ImVec2 &loc) override { drawView(drawList, loc, View()); }
+      virtual void drawView(ImDrawList *drawList, const ImVec2 &loc, const View &view) override;
       virtual void moveTo(float x, float y) override { move(x, y); }
+      virtual bool bounds(ImRect *rect) const override { Points4::extent(rect, thickness * 0.5f + 1.0f); return true; }
+      virtual bool hitPoint(const ImVec2 &point, float tolerance) const override;
+      virtual bool hitRect(const ImRect &rect) const override;
+    };
+    struct StreamingPolyline : Primitive, Color, Thickness { // ring buffer of points -- owned, or a client span drawn in place
+      // methods
+      virtual void draw(ImDrawList *drawList, const ImVec2 &loc) override { drawView(drawList, loc, View()); }
+      virtual void drawView(ImDrawList *drawList, const ImVec2 &loc, const View &view) override;
+      virtual void moveTo(float x, float y) override { origin += ImVec2(x, y); }
+      virtual bool bounds(ImRect *rect) const override;
+      virtual bool hitPoint(const ImVec2 &point, float tolerance) const override;
+      virtual bool hitRect(const ImRect &rect) const override;
+      void append(const ImVec2 *points, int n); // owned ring only -- evicts oldest points once full
+      void evict(int n);                         // drop oldest n points
+      void span(const ImVec2 *points, int capacity, int head, int count); // client points -- a ring when head + count exceeds capacity
+      const ImVec2 &sample(int i) const { int r = head + i; return buffer[r < capacity ? r : r - capacity]; } // i = 0 is oldest
+
+      // data members
+      OwnedVector<ImVec2> ring; // owned storage (empty for client spans) -- buffer points into it, so it mustn't be copied
+      const ImVec2        *buffer;
+      int                 capacity,
+                          head,  // oldest point
+                          count;
+      ImVec2              origin; // added to points, so moveTo() leaves them untouched
+      ImRect              extent; // of points appended since last empty (owned ring only)
+    };
+    struct MemoryUsage { // bytes allocated by the canvas, capacity included -- custom() primitives are the client's and not counted
+      size_t primitives[PrimitiveType_MAX], // pool blocks by type
+             points,   // point arrays, streaming rings and level of detail caches
+             strings,  // string arena
+             layouts,  // text glyph layouts
+             slots,    // handle slots, free and reserved ones included
+             index,    // z layers, groups, clip rects and spatial index
+             geometry, // cacheGeometry() output
+             total;
+      int    live[PrimitiveType_MAX], // primitives by type
+             freeSlots,     // erased, awaiting reuse
+             reservedSlots; // held for queued adds
+    };
+#ifdef STATEFUL_CANVAS_STATS
+    struct Stats { // collected by draw() in STATEFUL_CANVAS_STATS builds -- times in milliseconds
+      // methods
+      struct Type { int drawn, vertices, indices; float ms; };
+      struct Layer { int z, drawn; float ms; }; // parallel tessellation is timed by draw() as a whole, not by layer
+      Stats() { reset(); }
+      void reset();
+      void add(const Stats &stats); // counts and per type stats only
+
+      // data members
+      int             visited, // primitives examined
+                      drawn,
+                      hidden, // invisible or in a hidden group
+                      culled, // outside visible region
+                      zLayers,
+                      clipPushes,
+                      copiedVertices, // unchanged z layers copied from geometry cache
+                      copiedIndices;
+      float           ms;
+      Type            types[PrimitiveType_COUNT];
+      ImVector<Layer> layers;
+    };
+#endif
+    struct Command { // change queued by any thread, applied by applyQueue()
+      virtual ~Command() { } // freeCommand() destroys commands once applied
+
+      Command    *next;
+      void       (*apply)(StatefulCanvas *canvas, Command *command);
+      draw_idx_t idx;
+      int        z;
     };
     struct Image : Primitive, Texture, Points2, UVs2, Color {
-      virtual void draw(ImDrawList *drawList, const ImVec2 &loc) override;
+      virtual void draw(ImDrawList *drawList, const ImVec2 &loc) override { drawView(drawList, loc, View()); }
+      virtual void drawView(ImDrawList *drawList, const ImVec2 &loc, const View &view) override;
       virtual void moveTo(float x, float y) override { move(x, y); }
+      virtual bool bounds(ImRect *rect) const override { Points2::extent(rect, 0.0f); return true; }
     };
     struct ImageQuad : Primitive, Texture, Points4, UVs4, Color {
-      virtual void draw(ImDrawList *drawList, const ImVec2 &loc) override;
+      virtual void draw(ImDrawList *drawList, const ImVec2 &loc) override { drawView(drawList, loc, View()); }
+      virtual void drawView(ImDrawList *drawList, const ImVec2 &loc, const View &view) override;
       virtual void moveTo(float x, float y) override { move(x, y); }
+      virtual bool bounds(ImRect *rect) const override { Points4::extent(rect, 0.0f); return true; }
+      virtual bool hitPoint(const ImVec2 &point, float tolerance) const override;
+      virtual bool hitRect(const ImRect &rect) const override;
     };
     struct ImageRounded : Primitive, Texture, Points2, UVs2, Color, Rounding, CornerFlags {
-      virtual void draw(ImDrawList *drawList, const ImVec2 &loc) override;
+      virtual void draw(ImDrawList *drawList, const ImVec2 &loc) override { drawView(drawList, loc, View()); }
+      virtual void drawView(ImDrawList *drawList, const ImVec2 &loc, const View &view) override;
       virtual void moveTo(float x, float y) override { move(x, y); }
+      virtual bool bounds(ImRect *rect) const override { Points2::extent(rect, 0.0f); return true; }
+      virtual bool hitPoint(const ImVec2 &point, float tolerance) const override;
     };
 
   private: // data types
-    typedef ImVector<Primitive *> DrawList;
+    enum Spatial { Spatial_None, Spatial_Grid, Spatial_Oversized, Spatial_Unbounded }; // spatial index membership
+    struct Slot {
+      Primitive            *primitive; // nullptr when free
+      ImS64                order; // draw order within z layer (ascending)
+      int                  generation,
+                           nextFree, // free list link
+                           groupPos, // in group's members
+                           z;        // z layer indexed in -- Primitive::z must match it
+      mutable bool         dragged, // listed in dragged_ (has a drag and drop z offset)
+                           touched; // listed in touched_ (bounds may have changed)
+      mutable char         spatial; // Spatial
+      mutable ImRect       bounds;  // as indexed, in group space -- drag and drop offsets included, group offset not
+      mutable unsigned int mark;    // spatial query dedupe
+    };
+    struct ZEntry {
+      int   slot;
+      ImS64 order; // stale when it no longer matches slot's order
+    };
+    struct CachedCmd {
+      ImVec4      clipRect;
+      bool        clip; // clipRect was pushed by a primitive (otherwise the canvas clip rect applies)
+      int         group; // drawGeometry() moves vertices by group's offset change since offset was baked in -- -1 for none
+      ImVec2      offset; // group offset baked in, in pixels
+      ImTextureID textureId;
+      int         vtxOffset,
+                  vtxCount,
+                  idxOffset,
+                  idxCount; // indices are relative to vtxOffset
+    };
+    struct Geometry { // tessellated z layer
+      ImVec2               loc;
+      ImVector<ImDrawVert> vtx;
+      ImVector<ImDrawIdx>  idx;
+      ImVector<CachedCmd>  cmds;
+      float                zoom;
+      int                  stateChanges; // clip rect or texture changes between primitives in z order
+    };
+    struct ZLayer { // primitives sharing a z value -- draws lowered in reverse followed by raised, which keeps both in ascending order
+      int                 z,
+                          live;
+      OwnedVector<ZEntry> lowered,
+                          raised;
+      mutable bool        dirty;    // geometry is stale
+      mutable Geometry    *geometry; // cacheGeometry() only
+      int                 ingested; // raised entries before current applyIngest() batch
+    };
+    struct Arena { // strings, carved from blocks which clear() recycles in bulk -- erased and replaced strings are reclaimed by packStrings()
+      int              block, // block currently being carved
+                       used,  // bytes carved from current block
+                       bytes, // carved from all blocks, dead ones included
+                       dead;  // of erased and replaced strings
+      ImVector<void *> blocks;
+      ImVector<int>    capacities; // bytes per block
+    };
+    struct Pool { // fixed size objects of one built-in or registered primitive type, carved from blocks which clear() recycles in bulk
+      int              objectSize,
+                       block, // block currently being carved
+                       used;  // objects carved from current block
+      void             *freeList; // released objects, linked through their first word
+      ImVector<void *> blocks;
+      ImVector<int>    capacities; // objects per block
+    };
+    struct Group { // offsets, z offset and visibility shared by member primitives and child groups
+      int                      parent,   // -1 for root -- next free group once erased
+                               children, // live child groups
+                               offsetZ;  // drag and drop
+      ImVec2                   offset,
+                               dragOffset;
+      bool                     visible,
+                               live;
+      OwnedVector<int>         members;         // slots
+      mutable int              composedZ;       // composed with ancestors' -- as of last resolveGroups()
+      mutable bool             composedVisible;
+      mutable unsigned int     mark;            // resolveGroups() dedupe
+      mutable OwnedVector<int> unbounded;       // members without bounds or spanning too many cells -- see grids_
+      mutable ImRect           bounds;          // group space, covering members in grids_ or oversized (grows until none are left)
+      mutable int              indexed;         // members with bounds
+    };
+    struct BatchContext { // shared by a run of primitives drawn by drawBatch()
+      ImVec2       loc;
+      const View   *view;
+      const ImVec2 *groupOffsets;
+      bool         clipped; // caller pushed run's clip rect
+    };
+    typedef void (*DrawBatchFunc)(ImDrawList *drawList, Primitive *const *primitives, int n, const BatchContext &context);
+    typedef Primitive *(*RelocateFunc)(Primitive *primitive, void *to); // move constructs into to, then destroys primitive
+    typedef void (*MoveBatchFunc)(Primitive *const *primitives, int n, float x, float y);
+    struct Displaced { // primitive drawn at a z other than the one it's indexed by
+      int   z;
+      ImS64 order;
+      int   slot;
+    };
+    struct Ingest {
+      IngestFunc func;
+      void       *userData;
+      int        items,
+                 done;
+    };
+    struct Workers; // thread pool -- see StatefulCanvas.cpp
+    struct Queue;   // lock-free command list and reserved handles -- see StatefulCanvas.cpp
+    struct SnapshotWriter; // primitive fields to and from snapshot records -- see StatefulCanvas.cpp
+    struct SnapshotReader;
+    template<typename T, typename Init>
+    struct QueuedAdd : Command { // queueAdd()
+      QueuedAdd(PrimitiveType type, Init &&init) : type(type), init(std::move(init)) { }
+      static void apply(StatefulCanvas *canvas, Command *command);
+      PrimitiveType type;
+      Init          init;
+    };
+    template<typename T, typename Update>
+    struct QueuedUpdate : Command { // queueUpdate()
+      QueuedUpdate(Update &&update) : update(std::move(update)) { }
+      static void apply(StatefulCanvas *canvas, Command *command);
+      Update update;
+    };
+    struct QueuedChange;   // queueErase(), queueVisible(), queueSetZ(), queueMoveTo() and queueCustom() -- see StatefulCanvas.cpp
+    struct QueuedText;
+    struct QueuedPolyline;
+    struct LinesInit;      // addRangeToDrawList() and queueAdd() initializers for the built-in bulk and queued adds
+    struct RectsFilledInit;
+    struct CirclesInit;
+    struct TextsInit;
+    struct LineInit;
+    struct RectFilledInit;
+    struct CircleInit;
+    struct Chunk {  // run of deferred_ tessellated by one worker
+      int        begin,
+                 end,
+                 resume;   // first primitive left to the drawing thread -- end unless drawList lacked room for it
+      bool       captured; // geometry holds drawList's output
+      ImDrawList *drawList;
+      Geometry   *geometry; // drawList's output
+#ifdef STATEFUL_CANVAS_STATS
+      Stats      stats;
+#endif
+    };
+    typedef ImVector<Slot>        DrawList;
     typedef ImVector<int>         ZStack;
-    typedef ImVector<ImVec4>      ClipRectStack;
+    typedef ImVector<int>         ClipRectStack; // interned intersections
+    typedef ImVector<ImVec4>      ClipRects;
+    typedef std::unordered_map<ImGuiID, ImVector<int>> ClipRectTable; // hash -> interned clip rects
+    typedef std::vector<ZLayer>   ZIndex; // std::vector -- ZLayer and Group own arrays, so they're moved and destroyed rather than memcpy'd
+    typedef ImVector<int>         DraggedList;
+    typedef ImVector<Displaced>   DisplacedList;
+    typedef ImVector<Primitive *> Batch;
+    typedef std::vector<Group>    GroupList;
+    typedef ImVector<int>         GroupStack;
+    typedef ImVector<ImVec2>      GroupOffsets;
+    typedef ImVector<Chunk>       ChunkList;
+    typedef ImVector<Ingest>      IngestList;
+    typedef std::unordered_map<ImS64, ImVector<int>> Grid; // cell key -> slots
+    struct GroupRun { // members of one group drawn into cached geometry, from an index buffer offset
+      int         idxOffset;
+      group_idx_t group;
+      ImVec2      offset; // baked in, in pixels
+    };
+    typedef ImVector<GroupRun>    GroupRuns;
+    typedef std::vector<Grid>     GroupGrids; // std::vector -- Grid isn't trivially relocatable
 
   private: // methods
+    static int slotIndex(draw_idx_t idx) { return (int)(idx & 0xFFFFFFFF); }
+    static draw_idx_t handle(int slot, int generation) { return ((draw_idx_t)generation << 32) | slot; }
+    const Slot *findSlot(draw_idx_t idx) const;
+    Slot *findSlot(draw_idx_t idx) { return const_cast<Slot *>(static_cast<const StatefulCanvas *>(this)->findSlot(idx)); }
+    template<typename T>
+    T *allocate(PrimitiveType type);
+    void *poolAlloc(PrimitiveType type, size_t size);
+    void poolReserve(PrimitiveType type, size_t size, int n);
+    void destroy(Primitive *primitive);
+    void eraseSlot(draw_idx_t idx); // erase(), without autoCompact()
+    static int poolBlockCapacity(int block) { return 32 << (block < 7 ? block : 7); } // objects
+    static bool poolOwnsMemory(int type) { // destructor must run (owns glyph layouts or point arrays, or is client code)
+      return (type == PrimitiveType_Text) || (type == PrimitiveType_Text2) || (type == PrimitiveType_Polyline) || (type == PrimitiveType_ConvexPolyFilled) ||
+             (type == PrimitiveType_StreamingPolyline) || (type >= PrimitiveType_Custom);
+    }
+    static Lod *findLod(Primitive *primitive); // nullptr unless primitive has a level of detail cache
+    static TextLayout *findTextLayout(Primitive *primitive); // nullptr unless primitive is text
+    static String *findString(Primitive *primitive);         // nullptr unless primitive is text
+    static Points *findPoints(Primitive *primitive);         // nullptr unless primitive is a Polyline or ConvexPolyFilled
+    const char *storeString(const char *textBegin, const char *textEnd); // copy into string arena -- textEnd may be nullptr
+    bool packStringsDue() const; // erased and replaced strings are half the string arena
+    void packStrings(); // copy live strings into one block -- by erase(), eraseGroup() and setText() once packStringsDue(), and by compact()
     draw_idx_t addToDrawList(Primitive *primitive);
+    template<typename T, typename Init>
+    DrawIdxRange addRangeToDrawList(PrimitiveType type, int n, Init init);
+    DrawIdxRange claimSlots(int n);
+    bool loadSnapshot(const unsigned char *data, size_t size, DrawIdxRange *range);
+    Primitive *loadRegistered(ImU32 typeId, const unsigned char *data, int size); // loadCustom_'s T moved into the pool of the type registered as typeId
+    int findTypeId(ImU32 typeId) const; // registered type saved as typeId, or -1
+    void attach(int slot, Primitive *primitive, ZLayer &layer);
+    draw_idx_t reserveHandle(); // thread safe -- DRAW_IDX_NONE when reserve ran out, counted so refillReserve() grows the next window
+    void enqueue(Command *command, draw_idx_t idx, int z, void (*apply)(StatefulCanvas *canvas, Command *command)); // thread safe
+    void push(Command *command); // thread safe
+    template<typename C, typename... Args>
+    C *newCommand(Args &&...args);                  // thread safe -- C(args...) in a node of the calling thread's pool
+    void *allocCommand(size_t size, size_t align); // thread safe -- pooled up to 112 bytes, operator new beyond
+    void freeCommand(Command *command);            // destroy and return node to the pool it came from -- by applyQueue()
+    draw_idx_t adopt(draw_idx_t idx, Primitive *primitive); // add queued primitive, into its reserved slot when idx is one
+    void refillReserve();
     int z() const { return zStack_.size() > 0 ? zStack_.back() : 0; }
-    void addClipRect(Primitive *primitive) const;
+    group_idx_t currentGroup() const { return groupStack_.size() > 0 ? groupStack_.back() : GROUP_ROOT; }
+    void joinGroup(int slot, group_idx_t group);
+    void leaveGroup(int slot);
+    void resolveGroups() const;
+    void resolveGroup(int group) const;
+    void collectDisplaced() const;
+    int drawnZ(const Slot &slot) const { return slot.z + slot.primitive->offsetZ + groups_[slot.primitive->group].composedZ; }
+    static bool drawnBefore(const Displaced &a, const Displaced &b) { return (a.z < b.z) || ((a.z == b.z) && (a.order < b.order)); }
+    static bool drawnAfter(const Displaced &a, const Displaced &b) { return drawnBefore(b, a); }
+    bool walked(const Slot &slot) const { // drawn by z index walk -- not displaced by a z offset or hidden by its group
+      const Group &group = groups_[slot.primitive->group];
+      return !slot.dragged && (group.composedZ == 0) && group.composedVisible;
+    }
+    static bool touches(const ImRect &a, const ImRect &b) { // ImRect::Overlaps() with edges included -- areas may be points
+      return (a.Min.x <= b.Max.x) && (a.Min.y <= b.Max.y) && (a.Max.x >= b.Min.x) && (a.Max.y >= b.Min.y);
+    }
+    bool mayOverlap(const Slot &slot, const ImRect &area) const { // pick candidate -- bounds are in group space
+      const Primitive *primitive = slot.primitive;
+      ImRect          bounds    = slot.bounds;
+      bounds.Translate(groupOffsets_[primitive->group]);
+      return primitive->visible && groups_[primitive->group].composedVisible &&
+             (((slot.spatial != Spatial_Grid) && (slot.spatial != Spatial_Oversized)) || touches(bounds, area));
+    }
+#ifdef STATEFUL_CANVAS_STATS
+    void countSkipped(const Slot &slot) const { // not walked, or culled
+      if (walked(slot))
+        ++stats_.culled;
+      else if (!slot.dragged && !groups_[slot.primitive->group].composedVisible) // displaced primitives are counted where they're drawn
+        ++stats_.hidden;
+    }
+#endif
+    void addClipRect(Primitive *primitive) const {
+      primitive->clip        = clipRectStack_.size() > 0;
+      primitive->clipRectIdx = primitive->clip ? clipRectStack_.back() : -1;
+
+      if (primitive->clip)
+        primitive->clipRect = clipRects_[primitive->clipRectIdx];
+    }
+    int internClipRect(const ImVec4 &rect);
+    static ImTextureID texture(const Primitive *primitive); // nullptr for primitives drawn with the font atlas
+    static int stateClipRect(const Primitive *primitive) { return primitive->clip ? primitive->clipRectIdx : -1; } // -1 for the canvas clip rect
+    static bool stateBefore(const Primitive *a, const Primitive *b); // sortByState() order -- clip rect, then texture
+    static bool stateTypeBefore(const Primitive *a, const Primitive *b) { return stateBefore(a, b) || (!stateBefore(b, a) && (a->type < b->type)); }
+    void countState(const Primitive *primitive) const;
+    int findZLayer(int z) const;
+    ZLayer &zLayer(int z);
+    void unindexZ(int z);
+    void compactZLayer(ZLayer &layer);
+    bool compactDue() const; // holes since last compact() reach autoCompact()'s share -- checked by erase() and eraseGroup(), never queued erases or draw()
+    bool validZEntry(const ZEntry &entry) const { const Slot &slot = drawList_[entry.slot]; return slot.primitive && (slot.order == entry.order); }
+    void drawPrimitive(ImDrawList *drawList, Primitive *primitive, const ImVec2 &loc) const;
+    void drawClipped(ImDrawList *drawList, Primitive *primitive, const ImVec2 &loc) const; // within primitive's clip rect
+    void drawBatches(ImDrawList *drawList, const ImVec2 &loc) const;
+    template<typename T>
+    static void drawBatch(ImDrawList *drawList, Primitive *const *primitives, int n, const BatchContext &context); // type-homogeneous run
+    DrawBatchFunc batchFunc(int type) const;
+    template<typename T>
+    static Primitive *relocate(Primitive *primitive, void *to);
+    RelocateFunc relocateFunc(int type) const; // nullptr for types compact() leaves in place
+    template<typename T>
+    static void moveBatch(Primitive *const *primitives, int n, float x, float y); // type-homogeneous run
+    MoveBatchFunc moveFunc(int type) const;
+    void moveBatches(float x, float y); // moved_, by type
+    template<typename T>
+    static PrimitiveType registeredType();
+    static int nextRegisteredType(); // registered types in process so far
+#ifdef STATEFUL_CANVAS_STATS
+    static Stats *statsTarget(); // see drawBatch()
+    static double statsNow();
+    static void statsDrawn(int type, const ImDrawList *drawList, int vtxStart, int idxStart, double start);
+#endif
+    void drawZLayer(ImDrawList *drawList, const ZLayer &layer, const ImVec2 &loc, int *d) const;
+    void buildGeometry(const ZLayer &layer, const ImVec2 &loc) const;
+    void drawGeometry(ImDrawList *drawList, const Geometry &geometry, const ImVec2 &loc) const;
+    bool groupsSnapped(const Geometry &geometry) const;
+    static void captureGeometry(const ImDrawList *drawList, const ImVec4 &clipRect, Geometry *geometry, const GroupRuns *runs = nullptr); // clipRect was pushed
+    void flushDeferred(ImDrawList *drawList, const ImVec2 &loc) const;
+    void tessellateChunks(Workers &workers) const;
+    void finishChunk(Chunk &chunk, const ImVec2 &loc, const ImVec4 &clipRect) const;
+    static void workerMain(Workers *workers);
+    void stopWorkers() const;
+    void dirtyZ(int z) const;
+    void dirtyDrawnZ(const Slot &slot) const { dirtyZ(slot.z); if (drawnZ(slot) != slot.z) dirtyZ(drawnZ(slot)); } // and displaced z
+    void touch(int slot) const { if (spatialIndex_ && !drawList_[slot].touched) { drawList_[slot].touched = true; touched_.push_back(slot); } }
+    bool gridRange(const ImRect &rect, int *x0, int *y0, int *x1, int *y1) const; // false when too many cells
+    int groupRange(int g, const ImRect &area, int *x0, int *y0, int *x1, int *y1) const;
+    static ImS64 gridKey(int x, int y) { return (ImS64)(((ImU64)(unsigned int)y << 32) | (unsigned int)x); }
+    void indexBounds(int slot) const;
+    void unindexBounds(int slot) const;
+    void updateBounds() const;
+    bool inView(const Slot &slot, const ImVec2 &loc) const;
+    bool drawCulled(ImDrawList *drawList, const ImVec2 &loc) const;
+    void pickCandidates(const ImRect &area) const;
+    draw_idx_t pickHits(const ImVec2 *point, float tolerance, const ImRect &area, ImVector<draw_idx_t> *hits) const; // topmost, all when hits given
+    static bool snapped(const ImVec2 &delta) { return (delta.x == (float)(int)delta.x) && (delta.y == (float)(int)delta.y); } // whole pixels
 
   private: // data members
-    bool          useCursorPosition_;
-    ImVec2        location_,
-                  size_;
-    ZStack        zStack_;
-    ClipRectStack clipRectStack_;
-    DrawList      drawList_;
+    bool                    useCursorPosition_;
+    ImVec2                  location_,
+                            size_;
+    View                    view_;
+    mutable ImVec2          drawLocation_; // canvas location on screen as of last draw()
+    ZStack                  zStack_;
+    ClipRectStack           clipRectStack_;
+    ClipRects               clipRects_;
+    ClipRectTable           clipRectTable_;
+    DrawList                drawList_;
+    int                     freeSlot_,  // head of free slot list
+                            slotsUsed_, // slots at or beyond this were released in bulk by clear() and are free
+                            slotGeneration_; // for slots added past drawList_ -- newer than handles to any compact() dropped
+    float                   compactRatio_;   // autoCompact()
+    int                     compactedHoles_; // free and reserved slots left by last compact()
+    Pool                    pools_[PrimitiveType_MAX]; // by type -- none for PrimitiveType_Custom
+    DrawBatchFunc           registered_[PrimitiveType_MAX - PrimitiveType_COUNT]; // by registered type -- nullptr until registerPrimitiveType()
+    RelocateFunc            relocators_[PrimitiveType_MAX - PrimitiveType_COUNT]; // nullptr for types that aren't move constructible
+    MoveBatchFunc           movers_[PrimitiveType_MAX - PrimitiveType_COUNT];     // by registered type -- translate() and translateAll()
+    ImU32                   typeIds_[PrimitiveType_MAX - PrimitiveType_COUNT];    // registerPrimitiveType()'s -- registered types' snapshot key
+    Arena                   strings_;
+    int                     ownsMemory_; // live primitives for which poolOwnsMemory()
+    AllocFunc               allocFunc_;
+    FreeFunc                freeFunc_;
+    void                    *allocUserData_;
+    SaveCustomFunc          saveCustom_;
+    LoadCustomFunc          loadCustom_;
+    void                    *snapshotUserData_;
+    ZIndex                  zIndex_; // sorted by z
+    ImS64                   orderMin_,
+                            orderMax_;
+    mutable DraggedList     dragged_; // slots with a drag and drop z offset -- draw() adopts any set directly through Primitive
+    mutable DisplacedList   displaced_; // sorted into draw order -- kept across draw() calls until displacedStale_
+    mutable bool            displacedStale_;
+    bool                    batchByType_,
+                            sortByState_;
+    mutable Batch           batch_, // z layer being drawn by type
+                            batchSorted_;
+    Batch                   moved_, // translate() and translateAll() primitives, then by type
+                            movedSorted_;
+    bool                    cacheGeometry_;
+    mutable ImDrawList      *cacheDrawList_; // tessellates dirty z layers
+    mutable ImDrawListFlags cacheFlags_;
+    mutable ImTextureID     cacheFontTexture_;
+    mutable GroupRuns       groupRuns_;   // by buildGeometry() -- where drawn group changes, so group moves needn't rebuild
+    mutable bool            buildingRuns_;
+    int                     threads_;
+    mutable Workers         *workers_;     // started by first parallel draw()
+    mutable Batch           deferred_;     // primitives drawn in z order, awaiting parallel tessellation
+    mutable ChunkList       chunks_;
+    mutable ImDrawList      *deferTarget_; // window draw list while draw() defers drawPrimitive() calls
+    Queue                   *queue_;
+    IngestList              ingests_; // first is being ingested
+    float                   ingestBudget_;
+    ImS64                   ingestItems_, // since ingests_ was last empty -- for ingestProgress()
+                            ingestDone_;
+    float                   ingestNs_;    // per item, recent average -- sizes batches to the budget
+    bool                    spatialIndex_;
+    float                   cellSize_;
+    mutable GroupGrids      grids_; // by group -- members are indexed in group space, so moving a group leaves its grid untouched
+    mutable ImVector<int>   touched_;
+    mutable unsigned int    mark_;
+    mutable bool            culling_; // this draw() call
+    mutable ImRect          visible_; // region in canvas space
+    mutable DisplacedList   candidates_;
+    GroupList               groups_; // GROUP_ROOT first
+    mutable GroupOffsets    groupOffsets_; // composed with ancestors', drag offsets included -- as of last resolveGroups()
+    GroupStack              groupStack_;
+    int                     freeGroup_;
+    mutable bool            groupsDirty_,     // resolveGroups() pending
+                            groupsDisplaced_; // some group has a composed z offset
+    mutable unsigned int    groupMark_;
+    mutable int             drawCmds_,
+                            stateChanges_, // while walking z index
+                            lastClipRect_,
+                            lastVertices_, // emitted by last draw() -- reserved up front by the next
+                            lastIndices_;
+    mutable ImTextureID     lastTexture_;
+#ifdef STATEFUL_CANVAS_STATS
+    mutable Stats           stats_;
+#endif
 };
 
 //--------------------------------------------------------------------------------------------------------------------------------------------------------------
 template<typename T>
 T* StatefulCanvas::item(draw_idx_t idx) {
   static_assert(std::is_base_of<StatefulCanvas::Primitive, T>::value);
-  assert((idx >= 0) && (idx < drawList_.size()));
-  return (T*)drawList_[idx];
+  Slot *slot = findSlot(idx);
+
+  if (!slot)
+    return nullptr;
+
+  assert((slot->primitive->z == slot->z) && "Primitive::z written directly -- use StatefulCanvas::setZ()");
+  dirtyDrawnZ(*slot); // assume caller changes it
+  touch(slotIndex(idx));
+
+  if (Lod *lod = findLod(slot->primitive))
+    lod->lodDirty = true;
+
+  if (TextLayout *layout = findTextLayout(slot->primitive))
+    layout->invalidateLayout();
+
+  return (T*)slot->primitive;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+template<typename T>
+T *StatefulCanvas::allocate(PrimitiveType type) {
+  static_assert(alignof(T) <= 8);
+  T *primitive    = new (poolAlloc(type, sizeof(T))) T;
+  primitive->type = (unsigned char)type;
+  assert((void *)static_cast<Primitive *>(primitive) == (void *)primitive); // destroy() releases the Primitive pointer
+  return primitive;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+template<typename T>
+StatefulCanvas::PrimitiveType StatefulCanvas::registerPrimitiveType(ImU32 typeId) {
+  static_assert(std::is_base_of<Primitive, T>::value, "registered types derive from StatefulCanvas::Primitive");
+  static_assert(!std::is_same<decltype(&T::draw), decltype(&Primitive::draw)>::value, "registered types define draw()");
+  static_assert(!std::is_same<decltype(&T::moveTo), decltype(&Primitive::moveTo)>::value, "registered types define moveTo()");
+  static_assert(!std::is_same<decltype(&T::bounds), decltype(&Primitive::bounds)>::value, "registered types define bounds() -- culling and pick() use it");
+  static_assert(alignof(T) <= 8, "pool objects are 8 byte aligned");
+  PrimitiveType type                       = registeredType<T>();
+  assert(!typeId || (findTypeId(typeId) < 0) || (findTypeId(typeId) == type)); // one type per snapshot key
+  registered_[type - PrimitiveType_COUNT] = drawBatch<T>;
+  movers_[type - PrimitiveType_COUNT]     = moveBatch<T>;
+  typeIds_[type - PrimitiveType_COUNT]    = typeId;
+  pools_[type].objectSize                 = (int)((sizeof(T) + 7) & ~(size_t)7); // for reserve()
+
+  if constexpr (std::is_move_constructible<T>::value)
+    relocators_[type - PrimitiveType_COUNT] = relocate<T>; // packed by compact()
+
+  return type;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+template<typename T, typename... Args>
+StatefulCanvas::draw_idx_t StatefulCanvas::emplace(Args &&...args) {
+  PrimitiveType type = registeredType<T>();
+  assert(registered_[type - PrimitiveType_COUNT]); // see registerPrimitiveType()
+  T *primitive       = new (poolAlloc(type, sizeof(T))) T(std::forward<Args>(args)...);
+  primitive->type    = (unsigned char)type;
+  primitive->z       = z();
+  assert((void *)static_cast<Primitive *>(primitive) == (void *)primitive); // destroy() releases the Primitive pointer
+  return addToDrawList(primitive);
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+template<typename T>
+StatefulCanvas::PrimitiveType StatefulCanvas::registeredType() { // numbered on first use, so every canvas agrees
+  static const PrimitiveType type = (PrimitiveType)(PrimitiveType_COUNT + nextRegisteredType());
+  return type;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+template<typename T>
+StatefulCanvas::Primitive *StatefulCanvas::relocate(Primitive *primitive, void *to) { // arrays are OwnedVectors, so they move
+  T *moved = new (to) T(std::move(*static_cast<T *>(primitive)));
+  static_cast<T *>(primitive)->~T();
+  return moved;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+template<typename T>
+void StatefulCanvas::moveBatch(Primitive *const *primitives, int n, float x, float y) {
+  for (int i = 0; i < n; ++i)
+    if constexpr (std::is_same<T, Primitive>::value)
+      primitives[i]->moveTo(x, y); // custom primitives
+    else
+      static_cast<T *>(primitives[i])->T::moveTo(x, y); // statically dispatched
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+template<typename T>
+void StatefulCanvas::drawBatch(ImDrawList *drawList, Primitive *const *primitives, int n, const BatchContext &context) {
+  for (int i = 0; i < n; ++i) {
+    Primitive *primitive = primitives[i];
+
+    if (!primitive->visible) {
+#ifdef STATEFUL_CANVAS_STATS
+      ++statsTarget()->hidden;
+#endif
+      continue;
+    }
+
+#ifdef STATEFUL_CANVAS_STATS
+    int    vtxStart = drawList->VtxBuffer.Size,
+           idxStart = drawList->IdxBuffer.Size;
+    double start    = statsNow();
+#endif
+    bool clip = primitive->clip && !context.clipped;
+
+    if (clip) {
+      const ImVec4 &rect = primitive->clipRect;
+      drawList->PushClipRect(ImVec2(rect.x, rect.y), ImVec2(rect.z, rect.w));
+#ifdef STATEFUL_CANVAS_STATS
+      ++statsTarget()->clipPushes;
+#endif
+    }
+
+    ImVec2 groupLoc = context.loc + context.groupOffsets[primitive->group] * context.view->zoom;
+
+    if constexpr (std::is_same<T, Primitive>::value)
+      primitive->drawView(drawList, groupLoc, *context.view); // custom primitives
+    else if constexpr (!std::is_same<decltype(&T::drawView), decltype(&Primitive::drawView)>::value)
+      static_cast<T *>(primitive)->T::drawView(drawList, groupLoc, *context.view); // statically dispatched
+    else { // as Primitive::drawView(), with draw() statically dispatched
+      int vtx = drawList->VtxBuffer.Size;
+      static_cast<T *>(primitive)->T::draw(drawList, groupLoc);
+
+      if (context.view->zoom != 1.0f)
+        for (int v = vtx; v < drawList->VtxBuffer.Size; ++v)
+          drawList->VtxBuffer[v].pos = groupLoc + (drawList->VtxBuffer[v].pos - groupLoc) * context.view->zoom;
+    }
+
+    if (clip)
+      drawList->PopClipRect();
+
+#ifdef STATEFUL_CANVAS_STATS
+    statsDrawn(primitive->type, drawList, vtxStart, idxStart, start);
+#endif
+  }
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+template<typename T, typename Init>
+StatefulCanvas::draw_idx_t StatefulCanvas::queueAdd(PrimitiveType type, int z, Init init) {
+  static_assert(std::is_base_of<StatefulCanvas::Primitive, T>::value);
+  assert(type != PrimitiveType_Custom); // see queueCustom()
+  draw_idx_t idx = reserveHandle();
+
+  enqueue(newCommand<QueuedAdd<T, Init>>(type, std::move(init)), idx, z, QueuedAdd<T, Init>::apply);
+
+  return idx;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+template<typename T, typename Update>
+void StatefulCanvas::queueUpdate(draw_idx_t idx, Update update) {
+  static_assert(std::is_base_of<StatefulCanvas::Primitive, T>::value);
+
+  enqueue(newCommand<QueuedUpdate<T, Update>>(std::move(update)), idx, 0, QueuedUpdate<T, Update>::apply);
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+template<typename C, typename... Args>
+C *StatefulCanvas::newCommand(Args &&...args) {
+  static_assert(std::is_base_of<StatefulCanvas::Command, C>::value);
+
+  return new (allocCommand(sizeof(C), alignof(C))) C(std::forward<Args>(args)...);
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+template<typename T, typename Init>
+void StatefulCanvas::QueuedAdd<T, Init>::apply(StatefulCanvas *canvas, Command *command) {
+  QueuedAdd *queued    = static_cast<QueuedAdd *>(command);
+  T         *primitive = canvas->allocate<T>(queued->type);
+  primitive->z         = queued->z;
+  queued->init(primitive);
+  canvas->adopt(queued->idx, primitive);
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+template<typename T, typename Update>
+void StatefulCanvas::QueuedUpdate<T, Update>::apply(StatefulCanvas *canvas, Command *command) {
+  QueuedUpdate *queued = static_cast<QueuedUpdate *>(command);
+
+  if (T *primitive = canvas->item<T>(queued->idx))
+    queued->update(primitive);
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+template<typename T, typename Init>
+StatefulCanvas::DrawIdxRange StatefulCanvas::addRangeToDrawList(PrimitiveType type, int n, Init init) { // init(primitive, i) sets per item fields
+  assert(n >= 0);
+  poolReserve(type, sizeof(T), n);
+  DrawIdxRange range = claimSlots(n);
+  ZLayer       &layer = zLayer(z());
+  layer.raised.reserve(layer.raised.size() + n);
+
+  for (int i = 0; i < n; ++i) {
+    T *primitive = allocate<T>(type);
+    primitive->z = layer.z;
+    init(primitive, i);
+    addClipRect(primitive);
+    attach(slotIndex(range.first) + i, primitive, layer);
+  }
+
+  return range;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+inline const StatefulCanvas::Slot *StatefulCanvas::findSlot(draw_idx_t idx) const {
+  if (idx < 0)
+    return nullptr;
+
+  int slot = slotIndex(idx);
+
+  if ((slot >= slotsUsed_) || !drawList_[slot].primitive || (drawList_[slot].generation != (int)(idx >> 32)))
+    return nullptr;
+
+  return &drawList_[slot];
 }
 
 //--------------------------------------------------------------------------------------------------------------------------------------------------------------
@@ -0,0 +1,571 @@
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+// The MIT License (MIT)
+//
+// Copyright (c) 2020 Jason Paul Weiss
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+// Headless StatefulCanvas benchmark -- Dear ImGui frames rendered into ImDrawData, no backend
+//
+// usage: stateful_canvas_benchmark [max primitives]
+//
+// Reports, for N from 1000 up to max primitives (default 1000000):
+//   ns/item  time per primitive added, erased and re-added, saved or loaded, or drawn per frame (per point for polylines)
+//   vertices vertices a frame of the scene emits
+//   allocs   heap allocations (ImGui allocator and operator new) per add, churn op or frame
+//
+// Fails if a warmed up draw() of an unchanged scene allocates.
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+
+#include "StatefulCanvas.h"
+#include <atomic>
+#include <chrono>
+#include <new>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+using ImGui::StatefulCanvas;
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+static std::atomic<long long> NewAllocations(0); // parallel draws allocate on worker threads
+static int                    Failures = 0;
+
+void *operator new(size_t size) {
+  ++NewAllocations;
+
+  if (void *ptr = malloc(size ? size : 1))
+    return ptr;
+
+  throw std::bad_alloc();
+}
+
+void operator delete(void *ptr) noexcept { free(ptr); }
+void operator delete(void *ptr, size_t) noexcept { free(ptr); }
+
+static long long Allocations() { // ImGui's through StatefulCanvas::countAllocations()
+  return NewAllocations + (long long)StatefulCanvas::allocations();
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+static const float Width  = 1920.0f,
+                   Height = 1080.0f;
+
+struct Random { // deterministic, so runs are comparable
+  unsigned int state = 12345;
+  unsigned int next() { state = state * 1664525u + 1013904223u; return state >> 8; }
+  float next(float max) { return (float)next() / (float)(1 << 24) * max; }
+  ImVec2 point() { return ImVec2(next(Width), next(Height)); }
+  ImU32 color() { return next() | IM_COL32_A_MASK; }
+};
+
+struct Marker : StatefulCanvas::Primitive { // client primitive -- heap allocated by custom(), or pooled once registered
+  Marker(const ImVec2 &p, ImU32 color) : p(p), color(color) { }
+  virtual void draw(ImDrawList *drawList, const ImVec2 &loc) override {
+    drawList->AddTriangleFilled(loc + p, loc + p + ImVec2(6, 0), loc + p + ImVec2(3, 5), color);
+  }
+  virtual void moveTo(float x, float y) override { p += ImVec2(x, y); } // relative, as built-in primitives move
+  virtual bool bounds(ImRect *rect) const override { *rect = ImRect(p, p + ImVec2(6, 5)); return true; }
+
+  ImVec2 p;
+  ImU32  color;
+};
+
+struct Timer {
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  double ns() const { return (double)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count(); }
+};
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+static void Report(const char *scenario, int n, double nsPerItem, int vertices, double allocations) {
+  printf("%-34s %8d %12.1f %12d %12.3f\n", scenario, n, nsPerItem, vertices, allocations);
+  fflush(stdout);
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+static int Frame(StatefulCanvas &canvas, double *drawNs = nullptr, long long *drawAllocations = nullptr) { // returns vertices emitted
+  ImGui::NewFrame();
+  ImGui::SetNextWindowPos(ImVec2(0, 0));
+  ImGui::SetNextWindowSize(ImVec2(Width, Height));
+  ImGui::Begin("Benchmark", nullptr, ImGuiWindowFlags_NoDecoration | ImGuiWindowFlags_NoBackground | ImGuiWindowFlags_NoSavedSettings);
+  long long allocations = Allocations();
+  Timer     timer;
+  canvas.draw("canvas");
+
+  if (drawNs)
+    *drawNs += timer.ns();
+
+  if (drawAllocations)
+    *drawAllocations += Allocations() - allocations;
+
+  ImGui::End();
+  ImGui::Render();
+  return ImGui::GetDrawData()->TotalVtxCount;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+static StatefulCanvas::draw_idx_t AddPrimitive(StatefulCanvas &canvas, int type, Random &random) { // one primitive of a built-in type, at random
+  static const ImVec2 Points[8] = {{0, 0}, {9, 3}, {14, 11}, {10, 20}, {2, 22}, {-6, 15}, {-8, 6}, {-3, 1}};
+  ImVec2              p         = random.point(),
+                      offsets[8];
+  ImU32               color     = random.color();
+  ImTextureID         texture   = (ImTextureID)(intptr_t)1;
+
+  for (int i = 0; i < 8; ++i)
+    offsets[i] = p + Points[i];
+
+  if (type == StatefulCanvas::PrimitiveType_Line)
+    return canvas.line(p, p + ImVec2(24, 12), color);
+  else if (type == StatefulCanvas::PrimitiveType_Rect)
+    return canvas.rect(p, p + ImVec2(24, 12), color, 2.0f);
+  else if (type == StatefulCanvas::PrimitiveType_RectFilled)
+    return canvas.rectFilled(p, p + ImVec2(24, 12), color);
+  else if (type == StatefulCanvas::PrimitiveType_RectFilledMultiColor)
+    return canvas.rectFilledMultiColor(p, p + ImVec2(24, 12), color, color ^ 0xFF, color ^ 0xFF00, color ^ 0xFF0000);
+  else if (type == StatefulCanvas::PrimitiveType_Quad)
+    return canvas.quad(offsets[0], offsets[1], offsets[3], offsets[5], color);
+  else if (type == StatefulCanvas::PrimitiveType_QuadFilled)
+    return canvas.quadFilled(offsets[0], offsets[1], offsets[3], offsets[5], color);
+  else if (type == StatefulCanvas::PrimitiveType_Triangle)
+    return canvas.triangle(offsets[0], offsets[2], offsets[4], color);
+  else if (type == StatefulCanvas::PrimitiveType_TriangleFilled)
+    return canvas.triangleFilled(offsets[0], offsets[2], offsets[4], color);
+  else if (type == StatefulCanvas::PrimitiveType_Circle)
+    return canvas.circle(p, 8.0f, color);
+  else if (type == StatefulCanvas::PrimitiveType_CircleFilled)
+    return canvas.circleFilled(p, 8.0f, color);
+  else if (type == StatefulCanvas::PrimitiveType_Ngon)
+    return canvas.ngon(p, 8.0f, color, 6);
+  else if (type == StatefulCanvas::PrimitiveType_NgonFilled)
+    return canvas.ngonFilled(p, 8.0f, color, 6);
+  else if (type == StatefulCanvas::PrimitiveType_Text)
+    return canvas.text(p, color, "label 1234");
+  else if (type == StatefulCanvas::PrimitiveType_Text2)
+    return canvas.text(nullptr, 0.0f, p, color, "label 1234 wrapped", nullptr, 40.0f);
+  else if (type == StatefulCanvas::PrimitiveType_Polyline)
+    return canvas.polyline(offsets, 8, color, true);
+  else if (type == StatefulCanvas::PrimitiveType_ConvexPolyFilled)
+    return canvas.convexPolyFilled(offsets, 8, color);
+  else if (type == StatefulCanvas::PrimitiveType_BezierCurve)
+    return canvas.bezierCurve(offsets[0], offsets[2], offsets[4], offsets[6], color, 1.0f, 12);
+  else if (type == StatefulCanvas::PrimitiveType_Image)
+    return canvas.image(texture, p, p + ImVec2(16, 16));
+  else if (type == StatefulCanvas::PrimitiveType_ImageQuad)
+    return canvas.imageQuad(texture, offsets[0], offsets[1], offsets[3], offsets[5]);
+  else if (type == StatefulCanvas::PrimitiveType_ImageRounded)
+    return canvas.imageRounded(texture, p, p + ImVec2(16, 16), ImVec2(0, 0), ImVec2(1, 1), color, 4.0f);
+  else if (type == StatefulCanvas::PrimitiveType_StreamingPolyline) {
+    StatefulCanvas::draw_idx_t idx = canvas.streamingPolyline(8, color);
+    canvas.streamAppend(idx, offsets, 8);
+    return idx;
+  }
+
+  return StatefulCanvas::DRAW_IDX_NONE;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+static void BenchBuild(int n) { // add n primitives of each type to an empty canvas
+  static const char *Names[StatefulCanvas::PrimitiveType_Custom] = {
+    "build line", "build rect", "build rectFilled", "build rectFilledMultiColor", "build quad", "build quadFilled", "build triangle",
+    "build triangleFilled", "build circle", "build circleFilled", "build ngon", "build ngonFilled", "build text", "build text2", "build polyline",
+    "build convexPolyFilled", "build bezierCurve", "build image", "build imageQuad", "build imageRounded", "build streamingPolyline"
+  };
+
+  for (int type = 0; type < StatefulCanvas::PrimitiveType_Custom; ++type) {
+    StatefulCanvas canvas(0, 0, Width, Height);
+    Random         random;
+    long long      allocations = Allocations();
+    Timer          timer;
+
+    for (int i = 0; i < n; ++i)
+      AddPrimitive(canvas, type, random);
+
+    double ns   = timer.ns();
+    allocations = Allocations() - allocations;
+    Report(Names[type], n, ns / n, Frame(canvas), (double)allocations / n);
+  }
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+static void BenchChurn(int n) { // n lines, then n erases of a random line each followed by an add
+  StatefulCanvas                         canvas(0, 0, Width, Height);
+  Random                                 random;
+  ImVector<StatefulCanvas::draw_idx_t> handles;
+  handles.resize(n);
+
+  for (int i = 0; i < n; ++i)
+    handles[i] = canvas.line(random.point(), random.point(), random.color());
+
+  long long allocations = Allocations();
+  Timer     timer;
+
+  for (int i = 0; i < n; ++i) {
+    int r = (int)(random.next() % (unsigned int)n);
+    canvas.erase(handles[r]);
+    handles[r] = canvas.line(random.point(), random.point(), random.color());
+  }
+
+  double ns   = timer.ns();
+  allocations = Allocations() - allocations;
+  Report("churn erase + add line", n, ns / n, Frame(canvas), (double)allocations / n);
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+static void BenchCompact(int n) { // n primitives of mixed types, 90% erased at random, then compact() -- ns/item is per primitive added
+  StatefulCanvas                         canvas(0, 0, Width, Height);
+  Random                                 random;
+  ImVector<StatefulCanvas::draw_idx_t> handles;
+
+  for (int i = 0; i < n; ++i)
+    handles.push_back(AddPrimitive(canvas, i % StatefulCanvas::PrimitiveType_Custom, random));
+
+  for (int i = 0; i < n; ++i)
+    if (random.next() % 10 != 0)
+      canvas.erase(handles[i]);
+
+  size_t    before      = canvas.memoryUsage().total;
+  long long allocations = Allocations();
+  Timer     timer;
+  canvas.compact();
+  double ns             = timer.ns();
+  allocations           = Allocations() - allocations;
+  Report("compact, 90% erased", n, ns / n, Frame(canvas), (double)allocations / n);
+
+  if (canvas.memoryUsage().total >= before) {
+    fprintf(stderr, "FAILED compact: %zu bytes before, %zu after\n", before, canvas.memoryUsage().total);
+    ++Failures;
+  }
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+static int IngestLines(StatefulCanvas *canvas, int, int n, void *userData) {
+  Random &random = *(Random *)userData;
+
+  for (int i = 0; i < n; ++i)
+    canvas->line(random.point(), random.point(), random.color());
+
+  return n;
+}
+
+static void BenchIngest(int n) { // n lines ingested in 2 ms slices, as draw() would over successive frames
+  StatefulCanvas canvas(0, 0, Width, Height);
+  Random         random;
+  long long      allocations = Allocations();
+  Timer          timer;
+  canvas.ingest(IngestLines, n, &random);
+
+  while (canvas.ingesting())
+    canvas.applyIngest(2.0f);
+
+  double ns   = timer.ns();
+  allocations = Allocations() - allocations;
+  Report("ingest line, 2 ms slices", n, ns / n, Frame(canvas), (double)allocations / n);
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+static void BenchTranslate(int n) { // n points in polylines of 1000, translated through handles then all at once -- ns/item is per point
+  StatefulCanvas                         canvas(0, 0, Width, Height);
+  Random                                 random;
+  ImVector<StatefulCanvas::draw_idx_t> handles;
+  ImVector<ImVec2>                       points;
+  points.resize(1000);
+
+  for (int i = 0; i < n; i += points.Size) {
+    for (int j = 0; j < points.Size; ++j)
+      points[j] = random.point();
+
+    handles.push_back(canvas.polyline(points.Data, points.Size, random.color(), false));
+  }
+
+  int       items       = handles.Size * points.Size;
+  long long allocations = Allocations();
+  Timer     timer;
+  canvas.translate(handles.Data, handles.Size, 1.0f, -1.0f);
+  double ns             = timer.ns();
+  allocations           = Allocations() - allocations;
+  Report("translate polyline points", items, ns / items, Frame(canvas), (double)allocations / items);
+
+  allocations = Allocations();
+  timer       = Timer();
+  canvas.translateAll(-1.0f, 1.0f);
+  ns          = timer.ns();
+  allocations = Allocations() - allocations;
+  Report("translateAll polyline points", items, ns / items, Frame(canvas), (double)allocations / items);
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+static void BenchUpdate(int n) { // n points in polylines of 1000 and n / 10 labels, rebuilt in place as a per tick update would -- ns/item is per point
+  StatefulCanvas                         canvas(0, 0, Width, Height);
+  Random                                 random;
+  ImVector<StatefulCanvas::draw_idx_t> polylines,
+                                         labels;
+  ImVector<ImVec2>                       points;
+  char                                   label[32];
+  points.resize(1000);
+
+  for (int i = 0; i < n; i += points.Size) {
+    for (int j = 0; j < points.Size; ++j)
+      points[j] = random.point();
+
+    polylines.push_back(canvas.polyline(points.Data, points.Size, random.color(), false));
+  }
+
+  for (int i = 0; i < n / 10; ++i)
+    labels.push_back(canvas.text(random.point(), random.color(), "0000.00"));
+
+  Frame(canvas);
+  int       items       = polylines.Size * points.Size;
+  long long allocations = Allocations();
+  Timer     timer;
+
+  for (int i = 0; i < polylines.Size; ++i) {
+    for (int j = 0; j < points.Size; ++j)
+      points[j] = random.point();
+
+    canvas.setPoints(polylines[i], points.Data, points.Size);
+  }
+
+  double ns   = timer.ns();
+  allocations = Allocations() - allocations;
+  Report("setPoints polyline (per point)", items, ns / items, Frame(canvas), (double)allocations / items);
+
+  allocations = Allocations();
+  timer       = Timer();
+
+  for (int i = 0; i < labels.Size; ++i) {
+    int length = snprintf(label, sizeof(label), "%.2f", random.next(1000.0f)); // fits the "0000.00" stored
+    canvas.setText(labels[i], std::string_view(label, length));
+  }
+
+  ns          = timer.ns();
+  allocations = Allocations() - allocations;
+  Report("setText", labels.Size, ns / labels.Size, Frame(canvas), (double)allocations / labels.Size);
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+static void BenchSnapshot(int n) { // save and load n primitives of mixed types -- file written to the working directory
+  static const char *Path = "stateful_canvas_benchmark.snapshot";
+  StatefulCanvas canvas(0, 0, Width, Height);
+  Random         random;
+
+  for (int i = 0; i < n; ++i)
+    AddPrimitive(canvas, i % StatefulCanvas::PrimitiveType_Custom, random);
+
+  long long allocations = Allocations();
+  Timer     timer;
+
+  if (!canvas.save(Path)) {
+    fprintf(stderr, "FAILED snapshot save: %s\n", Path);
+    ++Failures;
+    return;
+  }
+
+  double ns   = timer.ns();
+  allocations = Allocations() - allocations;
+  Report("snapshot save", n, ns / n, Frame(canvas), (double)allocations / n);
+
+  StatefulCanvas loaded(0, 0, Width, Height);
+  allocations = Allocations();
+  timer       = Timer();
+  bool ok     = loaded.load(Path);
+  ns          = timer.ns();
+  allocations = Allocations() - allocations;
+  remove(Path);
+
+  if (!ok) {
+    fprintf(stderr, "FAILED snapshot load: %s\n", Path);
+    ++Failures;
+    return;
+  }
+
+  Report("snapshot load", n, ns / n, Frame(loaded), (double)allocations / n);
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+static void BenchDraw(const char *scenario, StatefulCanvas &canvas, int n) { // steady state frames -- items is n primitives (or points)
+  int frames = ImClamp(2000000 / n, 3, 100);
+  Frame(canvas); // warm up caches and draw list capacity
+  Frame(canvas);
+
+  double    ns              = 0;
+  int       vertices        = 0;
+  long long allocations     = Allocations(),
+            drawAllocations = 0;
+
+  for (int f = 0; f < frames; ++f)
+    vertices = Frame(canvas, &ns, &drawAllocations);
+
+  allocations = Allocations() - allocations;
+  Report(scenario, n, ns / ((double)frames * n), vertices, (double)allocations / frames);
+
+  if (drawAllocations) {
+    fprintf(stderr, "FAILED %s: draw() allocated %lld times in %d warmed up frames\n", scenario, drawAllocations, frames);
+    ++Failures;
+  }
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+static void BenchScenes(int n) {
+  { // few z layers, many primitives each
+    StatefulCanvas canvas(0, 0, Width, Height);
+    Random         random;
+
+    for (int i = 0; i < n; ++i) {
+      canvas.pushZ(i % 4);
+      canvas.line(random.point(), random.point(), random.color());
+      canvas.popZ();
+    }
+
+    BenchDraw("draw dense z", canvas, n);
+    canvas.batchByType(true);
+    BenchDraw("draw dense z, batched", canvas, n);
+    canvas.batchByType(false);
+    canvas.parallelDraw(4);
+    BenchDraw("draw dense z, 4 threads", canvas, n);
+    canvas.parallelDraw(1);
+    canvas.cacheGeometry(true);
+    BenchDraw("draw dense z, cached", canvas, n);
+  }
+
+  { // a z layer per primitive
+    StatefulCanvas canvas(0, 0, Width, Height);
+    Random         random;
+
+    for (int i = 0; i < n; ++i) {
+      canvas.pushZ(i);
+      canvas.line(random.point(), random.point(), random.color());
+      canvas.popZ();
+    }
+
+    BenchDraw("draw sparse z", canvas, n);
+  }
+
+  { // clip rect change every few primitives
+    StatefulCanvas canvas(0, 0, Width, Height);
+    Random         random;
+
+    for (int i = 0; i < n; ++i) {
+      if (i % 4 == 0) {
+        ImVec2 min = random.point();
+        canvas.pushClipRect(min, min + ImVec2(200, 200));
+      }
+
+      canvas.rectFilled(random.point(), random.point(), random.color());
+
+      if (i % 4 == 3)
+        canvas.popClipRect();
+    }
+
+    if (n % 4)
+      canvas.popClipRect();
+
+    BenchDraw("draw clip heavy", canvas, n);
+    canvas.sortByState(true);
+    BenchDraw("draw clip heavy, sorted by state", canvas, n);
+  }
+
+  { // n points in polylines of up to 10000 points
+    StatefulCanvas   canvas(0, 0, Width, Height);
+    Random           random;
+    ImVector<ImVec2> points;
+
+    for (int left = n; left > 0; left -= points.size()) {
+      points.resize(ImMin(left, 10000));
+
+      for (int i = 0; i < points.size(); ++i)
+        points[i] = ImVec2(Width * i / points.size(), random.next(Height));
+
+      canvas.polyline(points.Data, points.size(), random.color(), false);
+    }
+
+    BenchDraw("draw large polylines (per point)", canvas, n);
+  }
+
+  { // labels
+    StatefulCanvas canvas(0, 0, Width, Height);
+    Random         random;
+    char           label[32];
+
+    for (int i = 0; i < n; ++i) {
+      snprintf(label, sizeof(label), "label %d", i);
+      canvas.text(random.point(), random.color(), label);
+    }
+
+    BenchDraw("draw text heavy", canvas, n);
+  }
+
+  { // client primitives, virtual and statically dispatched
+    StatefulCanvas custom(0, 0, Width, Height),
+                   registered(0, 0, Width, Height);
+    Random         random;
+    registered.registerPrimitiveType<Marker>();
+
+    for (int i = 0; i < n; ++i) {
+      ImVec2 p     = random.point();
+      ImU32  color = random.color();
+      custom.custom(new Marker(p, color));
+      registered.emplace<Marker>(p, color);
+    }
+
+    custom.batchByType(true);
+    registered.batchByType(true);
+    BenchDraw("draw custom, batched", custom, n);
+    BenchDraw("draw registered, batched", registered, n);
+  }
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+int main(int argc, char **argv) {
+  int maxN = (argc > 1) ? atoi(argv[1]) : 1000000;
+
+  if (maxN < 1000) {
+    fprintf(stderr, "usage: %s [max primitives >= 1000]\n", argv[0]);
+    return 1;
+  }
+
+  StatefulCanvas::countAllocations();
+  ImGui::CreateContext();
+  ImGuiIO &io = ImGui::GetIO();
+  io.DisplaySize  = ImVec2(Width, Height);
+  io.DeltaTime    = 1.0f / 60.0f;
+  io.IniFilename  = nullptr;
+  io.BackendFlags |= ImGuiBackendFlags_RendererHasVtxOffset; // large scenes exceed 64K vertices per draw list
+
+  unsigned char *pixels;
+  int           width, height;
+  io.Fonts->GetTexDataAsRGBA32(&pixels, &width, &height); // builds font atlas -- no texture is uploaded
+
+  printf("%-34s %8s %12s %12s %12s\n", "scenario", "N", "ns/item", "vertices", "allocs");
+
+  for (int n = 1000; n <= maxN; n *= 10) {
+    BenchBuild(n);
+    BenchChurn(n);
+    BenchCompact(n);
+    BenchIngest(n);
+    BenchTranslate(n);
+    BenchUpdate(n);
+    BenchSnapshot(n);
+    BenchScenes(n);
+  }
+
+  ImGui::DestroyContext();
+  return Failures ? 1 : 0;
+}
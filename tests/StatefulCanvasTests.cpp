@@ -0,0 +1,1214 @@
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+// The MIT License (MIT)
+//
+// Copyright (c) 2020 Jason Paul Weiss
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+// Headless StatefulCanvas tests -- Dear ImGui frames rendered into ImDrawData, no backend
+//
+// usage: stateful_canvas_tests
+//
+// Prints each failed check and returns non-zero when any failed.
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+
+#include "StatefulCanvas.h"
+#include <atomic>
+#include <new>
+#include <string>
+#include <thread>
+#include <float.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+using ImGui::StatefulCanvas;
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+static int                    Checks   = 0,
+                              Failures = 0;
+static std::atomic<long long> NewAllocations(0); // parallel draws allocate on worker threads
+static long long              DrawAllocations;  // by the last Frame()'s draw() -- ImGui's and operator new's
+
+void *operator new(size_t size) {
+  ++NewAllocations;
+
+  if (void *ptr = malloc(size ? size : 1))
+    return ptr;
+
+  throw std::bad_alloc();
+}
+
+void operator delete(void *ptr) noexcept { free(ptr); }
+void operator delete(void *ptr, size_t) noexcept { free(ptr); }
+
+static long long Allocations() { // ImGui's through StatefulCanvas::countAllocations()
+  return NewAllocations + (long long)StatefulCanvas::allocations();
+}
+
+#define CHECK(condition) Check((condition), #condition, __FILE__, __LINE__)
+
+static void Check(bool passed, const char *condition, const char *file, int line) {
+  ++Checks;
+
+  if (!passed) {
+    ++Failures;
+    printf("%s:%d: check failed: %s\n", file, line, condition);
+    fflush(stdout);
+  }
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+static const float Width  = 640.0f,
+                   Height = 480.0f;
+
+static const ImU32 Red   = IM_COL32(255, 0, 0, 255),
+                   Green = IM_COL32(0, 255, 0, 255),
+                   Blue  = IM_COL32(0, 0, 255, 255);
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+struct DrawOutput { // window draw list after draw()
+  ImVector<ImDrawVert> vertices;
+  ImVector<ImDrawIdx>  indices;
+  ImVector<ImDrawCmd>  cmds;
+};
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+static void Frame(StatefulCanvas &canvas, ImVector<ImU32> *colors = nullptr, ImVector<ImDrawVert> *vertices = nullptr, DrawOutput *output = nullptr) {
+  ImGui::NewFrame();
+  ImGui::SetNextWindowPos(ImVec2(0, 0));
+  ImGui::SetNextWindowSize(ImVec2(Width, Height));
+  ImGui::Begin("Tests", nullptr, ImGuiWindowFlags_NoDecoration | ImGuiWindowFlags_NoBackground | ImGuiWindowFlags_NoSavedSettings);
+  ImDrawList *drawList = ImGui::GetWindowDrawList();
+  int         first    = drawList->VtxBuffer.size();
+  long long   before   = Allocations();
+  canvas.draw("canvas");
+  DrawAllocations = Allocations() - before;
+
+  if (output) {
+    output->vertices = drawList->VtxBuffer;
+    output->indices  = drawList->IdxBuffer;
+    output->cmds     = drawList->CmdBuffer;
+  }
+
+  if (vertices)
+    vertices->resize(0);
+
+  for (int i = first; vertices && (i < drawList->VtxBuffer.size()); ++i)
+    vertices->push_back(drawList->VtxBuffer[i]);
+
+  if (colors) { // runs collapsed
+    colors->resize(0);
+
+    for (int i = first; i < drawList->VtxBuffer.size(); ++i)
+      if (colors->empty() || (colors->back() != drawList->VtxBuffer[i].col))
+        colors->push_back(drawList->VtxBuffer[i].col);
+  }
+
+  ImGui::End();
+  ImGui::Render();
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+static bool Colors(const ImVector<ImU32> &colors, ImU32 c0, ImU32 c1) { // drawn in exactly this order
+  return (colors.size() == 2) && (colors[0] == c0) && (colors[1] == c1);
+}
+
+static bool Colors(const ImVector<ImU32> &colors, ImU32 c0, ImU32 c1, ImU32 c2) {
+  return (colors.size() == 3) && (colors[0] == c0) && (colors[1] == c1) && (colors[2] == c2);
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+static float Left(const ImVector<ImDrawVert> &vertices, ImU32 color) { // leftmost vertex of color
+  float left = FLT_MAX;
+
+  for (int i = 0; i < vertices.size(); ++i)
+    if (vertices[i].col == color)
+      left = ImMin(left, vertices[i].pos.x);
+
+  return left;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+static void TestZOrder(bool cacheGeometry) { // user-001
+  StatefulCanvas canvas(0, 0, Width, Height);
+  canvas.cacheGeometry(cacheGeometry);
+  StatefulCanvas::draw_idx_t red   = canvas.rectFilled(ImVec2(10, 10), ImVec2(20, 20), Red),
+                             green = canvas.rectFilled(ImVec2(30, 30), ImVec2(40, 40), Green),
+                             blue  = canvas.rectFilled(ImVec2(50, 50), ImVec2(60, 60), Blue);
+  ImVector<ImU32> colors;
+
+  Frame(canvas, &colors);
+  CHECK(Colors(colors, Red, Green, Blue)); // same z draws in add order
+  canvas.raise(red);
+  Frame(canvas, &colors);
+  CHECK(Colors(colors, Green, Blue, Red));
+  canvas.lower(blue);
+  Frame(canvas, &colors);
+  CHECK(Colors(colors, Blue, Green, Red));
+  canvas.setZ(green, -1);
+  Frame(canvas, &colors);
+  CHECK(Colors(colors, Green, Blue, Red));
+  CHECK((canvas.z(green) == -1) && (canvas.item<StatefulCanvas::RectFilled>(green)->z == -1));
+  canvas.setZ(blue, 2);
+  canvas.setZ(green, 2); // on top of blue, already at 2
+  Frame(canvas, &colors);
+  CHECK(Colors(colors, Red, Blue, Green));
+  canvas.setZ(green, 0);
+  canvas.lower(green);
+  Frame(canvas, &colors);
+  CHECK(Colors(colors, Green, Red, Blue));
+  canvas.erase(blue); // unindexes z 2, its last primitive
+  Frame(canvas, &colors);
+  CHECK(Colors(colors, Green, Red));
+
+#ifdef NDEBUG // asserted otherwise
+  ImVector<ImDrawVert> vertices;
+  canvas.item<StatefulCanvas::RectFilled>(red)->z = 5; // written directly -- red stays in the layer it is indexed in
+  Frame(canvas);
+  canvas.moveTo(red, 100, 0); // dirties that layer
+  Frame(canvas, &colors, &vertices);
+  CHECK(Colors(colors, Green, Red) && (Left(vertices, Red) == 110));
+#endif
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+static void TestPick(bool spatialIndex) { // user-007
+  StatefulCanvas canvas(0, 0, Width, Height);
+  canvas.spatialIndex(spatialIndex, 32.0f);
+  StatefulCanvas::draw_idx_t below = canvas.rectFilled(ImVec2(10, 10), ImVec2(110, 110), Red),
+                             above = canvas.rectFilled(ImVec2(60, 60), ImVec2(160, 160), Green),
+                             line  = canvas.line(ImVec2(300, 300), ImVec2(400, 300), Blue, 2.0f);
+  ImVector<StatefulCanvas::draw_idx_t> hits;
+
+  CHECK(canvas.pick(ImVec2(20, 20)) == below);
+  CHECK(canvas.pick(ImVec2(80, 80)) == above);
+  CHECK(canvas.pick(ImVec2(200, 200)) == StatefulCanvas::DRAW_IDX_NONE);
+  CHECK(canvas.pick(ImVec2(80, 80), 0.0f, &hits) == 2);
+  CHECK((hits.size() == 2) && (hits[0] == above) && (hits[1] == below));
+  CHECK(canvas.pick(ImVec2(350, 303)) == StatefulCanvas::DRAW_IDX_NONE);
+  CHECK(canvas.pick(ImVec2(350, 303), 4.0f) == line);
+
+  CHECK(canvas.pickRect(ImVec2(0, 0), ImVec2(30, 30)) == below);
+  CHECK(canvas.pickRect(ImVec2(100, 100), ImVec2(120, 120)) == above);
+  CHECK(canvas.pickRect(ImVec2(0, 0), ImVec2(Width, Height), &hits) == 3);
+  CHECK(canvas.pickRect(ImVec2(500, 10), ImVec2(600, 50)) == StatefulCanvas::DRAW_IDX_NONE);
+
+  canvas.raise(below);
+  CHECK(canvas.pick(ImVec2(80, 80)) == below);
+  canvas.visible(below, false);
+  CHECK(canvas.pick(ImVec2(80, 80)) == above);
+  canvas.moveTo(above, 300, 0);
+  CHECK(canvas.pick(ImVec2(80, 80)) == StatefulCanvas::DRAW_IDX_NONE);
+  CHECK(canvas.pick(ImVec2(380, 80)) == above);
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+static void TestView(bool cacheGeometry) { // user-011
+  StatefulCanvas canvas(0, 0, Width, Height);
+  canvas.cacheGeometry(cacheGeometry);
+  StatefulCanvas::draw_idx_t red   = canvas.rectFilled(ImVec2(10, 10), ImVec2(20, 20), Red),
+                             green = canvas.rectFilled(ImVec2(100, 10), ImVec2(110, 20), Green);
+  ImVector<ImDrawVert>       vertices;
+
+  Frame(canvas, nullptr, &vertices); // places the canvas toScreen() and toCanvas() map through
+  CHECK(Left(vertices, Red) == canvas.toScreen(ImVec2(10, 10)).x);
+  ImVec2 pivot = canvas.toScreen(ImVec2(15, 15)); // red's center
+
+  canvas.zoom(2.0f, pivot);
+  CHECK((canvas.view().zoom == 2.0f) && (canvas.toScreen(ImVec2(15, 15)).x == pivot.x) && (canvas.toScreen(ImVec2(15, 15)).y == pivot.y));
+  Frame(canvas, nullptr, &vertices);
+  CHECK((Left(vertices, Red) == pivot.x - 10) && (Left(vertices, Green) == pivot.x + 170)); // geometry scaled about the pivot
+  CHECK(canvas.pick(canvas.toCanvas(pivot + ImVec2(8, 0))) == red); // pick() takes canvas points, so screen points go through toCanvas()
+  CHECK(canvas.pick(canvas.toCanvas(pivot + ImVec2(12, 0))) == StatefulCanvas::DRAW_IDX_NONE);
+  CHECK(canvas.pick(canvas.toCanvas(pivot + ImVec2(175, 0))) == green);
+  CHECK(canvas.item<StatefulCanvas::RectFilled>(red)->p0.x == 10); // stored geometry is untouched
+
+  canvas.pan(-30, 0);
+  Frame(canvas, nullptr, &vertices);
+  CHECK(Left(vertices, Red) == pivot.x - 40);
+  canvas.pan(30, 0);
+  canvas.zoom(0.5f, pivot);
+  Frame(canvas, nullptr, &vertices);
+  CHECK((canvas.view().zoom == 1.0f) && (Left(vertices, Red) == canvas.toScreen(ImVec2(10, 10)).x) && (canvas.toScreen(ImVec2(15, 15)).x == pivot.x));
+
+  StatefulCanvas::View view;
+  view.zoom = 3.0f;
+  CHECK((view.stroke(2.0f) == 6.0f) && (view.circleSegments(12) == 12)); // strokes zoom with geometry by default
+  view.scaleThickness = false;
+  view.autoSegments   = true;
+  CHECK((view.stroke(2.0f) == 2.0f) && (view.circleSegments(12) == 0)); // pixel widths, and segments from the on screen radius
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+static const ImVector<ImVec2> &Drawn(StatefulCanvas *canvas, StatefulCanvas::draw_idx_t polyline) { // points last drawn for a polyline
+  StatefulCanvas::Polyline *drawn = canvas->item<StatefulCanvas::Polyline>(polyline);
+  return (drawn->lodMode == StatefulCanvas::LevelOfDetail_Off) ? drawn->points : drawn->lodCache;
+}
+
+static bool Endpoints(const ImVector<ImVec2> &drawn, const ImVec2 *points, int n) { // first and last points kept exactly
+  return (drawn.size() >= 2) && (drawn[0].x == points[0].x) && (drawn[0].y == points[0].y) &&
+         (drawn.back().x == points[n - 1].x) && (drawn.back().y == points[n - 1].y);
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+static void TestLevelOfDetail() { // user-010
+  StatefulCanvas canvas(0, 0, Width, Height);
+  const int      n = 2000;
+  ImVec2         noisy[n],
+                 ramp[n],
+                 turn[n];
+
+  for (int i = 0; i < n; ++i) { // 20 points per pixel column over 100 columns
+    noisy[i]  = ImVec2((float)i * 0.05f, (float)((i * 37) % 29));
+    ramp[i]   = ImVec2((float)i * 0.05f, (float)i * 0.025f);
+    turn[i]   = ImVec2((float)((i < n / 2) ? i : n - 1 - i) * 0.05f, (float)i * 0.025f); // x doubles back halfway
+  }
+
+  StatefulCanvas::draw_idx_t noisyMinMax   = canvas.polyline(noisy, n, Red, false),
+                             noisySimplify = canvas.polyline(noisy, n, Red, false),
+                             rampMinMax    = canvas.polyline(ramp, n, Green, false),
+                             rampSimplify  = canvas.polyline(ramp, n, Green, false),
+                             rampAuto      = canvas.polyline(ramp, n, Green, false),
+                             turnAuto      = canvas.polyline(turn, n, Blue, false),
+                             off           = canvas.polyline(noisy, n, Blue, false);
+  canvas.levelOfDetail(noisyMinMax, StatefulCanvas::LevelOfDetail_MinMax);
+  canvas.levelOfDetail(noisySimplify, StatefulCanvas::LevelOfDetail_Simplify);
+  canvas.levelOfDetail(rampMinMax, StatefulCanvas::LevelOfDetail_MinMax);
+  canvas.levelOfDetail(rampSimplify, StatefulCanvas::LevelOfDetail_Simplify);
+  canvas.levelOfDetail(rampAuto, StatefulCanvas::LevelOfDetail_Auto);
+  canvas.levelOfDetail(turnAuto, StatefulCanvas::LevelOfDetail_Auto);
+  Frame(canvas);
+
+  int   minMax  = Drawn(&canvas, noisyMinMax).size(),
+        highest = 0;
+
+  for (int i = 0; i < minMax; ++i)
+    highest = ImMax(highest, (int)Drawn(&canvas, noisyMinMax)[i].y);
+
+  CHECK((minMax >= 2 * 100) && (minMax <= 4 * 100) && (highest == 28)); // up to first, lowest, highest and last per column
+  CHECK(Drawn(&canvas, noisySimplify).size() < n);
+  CHECK(Drawn(&canvas, rampSimplify).size() == 3); // collinear -- Douglas-Peucker keeps the ends of its two 1024 point chunks
+  CHECK(Drawn(&canvas, rampMinMax).size() >= 2 * 100); // while MinMax keeps each column's first and last
+  CHECK(Drawn(&canvas, rampAuto).size() == Drawn(&canvas, rampMinMax).size()); // x never decreases
+  CHECK(Drawn(&canvas, turnAuto).size() <= 5); // x doubles back -- simplified to the ends, the turn and chunk ends
+  CHECK(Drawn(&canvas, off).size() == n);
+  CHECK(Endpoints(Drawn(&canvas, noisyMinMax), noisy, n) && Endpoints(Drawn(&canvas, noisySimplify), noisy, n));
+  CHECK(Endpoints(Drawn(&canvas, rampMinMax), ramp, n) && Endpoints(Drawn(&canvas, rampSimplify), ramp, n));
+  CHECK(Endpoints(Drawn(&canvas, turnAuto), turn, n));
+
+  canvas.zoom(2.0f, ImVec2(0, 0)); // twice the pixel columns
+  Frame(canvas);
+  CHECK(Drawn(&canvas, noisyMinMax).size() > minMax);
+  CHECK(Drawn(&canvas, rampSimplify).size() == 3);
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+static void TestStaleHandles() { // user-002
+  StatefulCanvas canvas(0, 0, Width, Height);
+  StatefulCanvas::draw_idx_t a = canvas.rectFilled(ImVec2(10, 10), ImVec2(20, 20), Red),
+                             b = canvas.rectFilled(ImVec2(30, 30), ImVec2(40, 40), Green);
+
+  canvas.erase(a);
+  CHECK(!canvas.valid(a));
+  CHECK(canvas.valid(b));
+  CHECK(canvas.item<StatefulCanvas::RectFilled>(a) == nullptr);
+  CHECK(canvas.pick(ImVec2(15, 15)) == StatefulCanvas::DRAW_IDX_NONE);
+
+  StatefulCanvas::draw_idx_t c = canvas.rectFilled(ImVec2(10, 10), ImVec2(20, 20), Blue); // reuses a's slot
+  CHECK(c != a);
+  CHECK(!canvas.valid(a));
+  CHECK(canvas.valid(c));
+  CHECK(canvas.item<StatefulCanvas::RectFilled>(a) == nullptr);
+  CHECK(canvas.item<StatefulCanvas::RectFilled>(c)->color == Blue);
+  canvas.erase(a); // stale erase leaves c alone
+  CHECK(canvas.valid(c));
+
+  canvas.clear();
+  CHECK(!canvas.valid(b));
+  CHECK(!canvas.valid(c));
+
+  StatefulCanvas::draw_idx_t d = canvas.rectFilled(ImVec2(10, 10), ImVec2(20, 20), Red);
+  CHECK(canvas.valid(d));
+  CHECK(!canvas.valid(b) && !canvas.valid(c));
+  CHECK(canvas.item<StatefulCanvas::RectFilled>(b) == nullptr);
+  CHECK(canvas.item<StatefulCanvas::RectFilled>(c) == nullptr);
+
+  ImVector<ImU32> colors;
+  Frame(canvas, &colors);
+  CHECK((colors.size() == 1) && (colors[0] == Red));
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+static int IngestRects(StatefulCanvas *canvas, int first, int n, void *userData) { // userData gets the largest batch
+  int *largest = (int *)userData;
+  *largest = ImMax(*largest, n);
+
+  for (int i = first; i < first + n; ++i)
+    canvas->rectFilled(ImVec2((float)(i % 600), 10), ImVec2((float)(i % 600) + 4, 14), Red);
+
+  return n;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+static void TestIngestBudget() { // user-021
+  StatefulCanvas canvas(0, 0, Width, Height);
+  int            largest = 0;
+
+  canvas.ingest(IngestRects, 5000, &largest);
+  canvas.applyIngest(1e7f); // hours -- the batch estimate must clamp rather than overflow
+  CHECK(!canvas.ingesting());
+  CHECK(largest > 16);
+  CHECK(canvas.memoryUsage().live[StatefulCanvas::PrimitiveType_RectFilled] == 5000);
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+static void TestCachedLayers() { // user-005
+  StatefulCanvas canvas(0, 0, Width, Height);
+  canvas.cacheGeometry(true);
+  StatefulCanvas::draw_idx_t red = canvas.rectFilled(ImVec2(10, 10), ImVec2(20, 20), Red);
+  canvas.pushZ(1);
+  StatefulCanvas::draw_idx_t green = canvas.rectFilled(ImVec2(30, 30), ImVec2(40, 40), Green),
+                             blue  = canvas.rectFilled(ImVec2(50, 50), ImVec2(60, 60), Blue);
+  canvas.popZ();
+  ImVector<ImU32> colors;
+
+  Frame(canvas, &colors);
+  CHECK(Colors(colors, Red, Green, Blue));
+  canvas.setZ(red, 1); // into a layer with cached geometry
+  Frame(canvas, &colors);
+  CHECK(Colors(colors, Green, Blue, Red));
+  canvas.visible(green, false);
+  Frame(canvas, &colors);
+  CHECK(Colors(colors, Blue, Red));
+  canvas.item<StatefulCanvas::RectFilled>(blue)->color = Green;
+  Frame(canvas, &colors);
+  CHECK(Colors(colors, Green, Red));
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+static void TestGroupMove(bool cacheGeometry, bool spatialIndex) { // user-012
+  StatefulCanvas canvas(0, 0, Width, Height);
+  canvas.cacheGeometry(cacheGeometry);
+  canvas.spatialIndex(spatialIndex, 32.0f);
+  StatefulCanvas::draw_idx_t  red   = canvas.rectFilled(ImVec2(10, 10), ImVec2(20, 20), Red);
+  StatefulCanvas::group_idx_t group = canvas.newGroup();
+  canvas.pushGroup(group);
+  StatefulCanvas::draw_idx_t green = canvas.rectFilled(ImVec2(30, 30), ImVec2(40, 40), Green),
+                             blue  = canvas.rectFilled(ImVec2(50, 50), ImVec2(60, 60), Blue);
+  canvas.popGroup();
+  ImVector<ImU32>      colors;
+  ImVector<ImDrawVert> vertices;
+
+  Frame(canvas, &colors, &vertices);
+  CHECK(Colors(colors, Red, Green, Blue));
+  CHECK((Left(vertices, Red) == 10) && (Left(vertices, Green) == 30) && (Left(vertices, Blue) == 50));
+  canvas.groupMove(group, 100, 0);
+  Frame(canvas, &colors, &vertices);
+  CHECK(Colors(colors, Red, Green, Blue));
+  CHECK((Left(vertices, Red) == 10) && (Left(vertices, Green) == 130) && (Left(vertices, Blue) == 150));
+  CHECK(canvas.pick(ImVec2(35, 35)) == StatefulCanvas::DRAW_IDX_NONE);
+  CHECK(canvas.pick(ImVec2(135, 35)) == green);
+  CHECK(canvas.pickRect(ImVec2(145, 45), ImVec2(165, 65)) == blue);
+  CHECK(canvas.pick(ImVec2(15, 15)) == red);
+
+  canvas.groupMove(group, 0.5f, 0); // fractional -- rebuilt rather than translated off the pixel grid
+  Frame(canvas, &colors, &vertices);
+  CHECK((Left(vertices, Green) == 130.5f) && (Left(vertices, Blue) == 150.5f));
+  canvas.groupMove(group, -0.5f, 0);
+
+  canvas.setZ(red, 1);
+  Frame(canvas, &colors);
+  CHECK(Colors(colors, Green, Blue, Red));
+  canvas.groupDragAndDropStart(group, 2); // members draw above red until the drop
+  canvas.groupDragAndDropUpdate(group, 0, 100);
+  Frame(canvas, &colors, &vertices);
+  CHECK(Colors(colors, Red, Green, Blue));
+  CHECK(Left(vertices, Green) == 130);
+  Frame(canvas, &colors);
+  CHECK(Colors(colors, Red, Green, Blue));
+  CHECK(canvas.pick(ImVec2(135, 135)) == green);
+  canvas.groupDragAndDropEnd(group, 0, 100);
+  Frame(canvas, &colors);
+  CHECK(Colors(colors, Green, Blue, Red));
+  CHECK(canvas.pick(ImVec2(135, 135)) == green);
+
+  canvas.setGroup(green, StatefulCanvas::GROUP_ROOT); // leaves the group's offset behind
+  Frame(canvas, &colors, &vertices);
+  CHECK((Left(vertices, Green) == 30) && (Left(vertices, Blue) == 150));
+  CHECK(canvas.pick(ImVec2(35, 35)) == green);
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+static void TestStringArena() { // user-014
+  StatefulCanvas             canvas(0, 0, Width, Height);
+  StatefulCanvas::draw_idx_t label = canvas.text(ImVec2(10, 10), Red, "label");
+  std::string                shorter(100, 's'),
+                             longer(200, 'l');
+
+  for (int i = 0; i < 2000; ++i) // each longer string is stored anew -- 400 KB without packing
+    canvas.setText(label, (i & 1) ? shorter : longer);
+
+  const StatefulCanvas::Text *text = canvas.item<StatefulCanvas::Text>(label);
+  CHECK((text->text() + shorter.size() == text->textEnd()) && (shorter == text->text()));
+  CHECK(canvas.memoryUsage().strings < 256 * 1024);
+
+  ImVector<StatefulCanvas::draw_idx_t> texts;
+
+  for (int i = 0; i < 2000; ++i)
+    texts.push_back(canvas.text(ImVec2(10, 30), Green, longer.c_str()));
+
+  size_t full = canvas.memoryUsage().strings;
+
+  for (int i = 1; i < texts.size(); ++i)
+    canvas.erase(texts[i]);
+
+  CHECK(canvas.memoryUsage().strings < full / 4);
+  CHECK((longer == canvas.item<StatefulCanvas::Text>(texts[0])->text()) && (shorter == canvas.item<StatefulCanvas::Text>(label)->text()));
+  Frame(canvas);
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+static void TestClipRects(bool sortByState) { // user-013
+  StatefulCanvas canvas(0, 0, Width, Height);
+  canvas.sortByState(sortByState);
+  canvas.pushClipRect(ImVec2(0, 0), ImVec2(100, 100));
+  canvas.pushClipRect(ImVec2(50, 50), ImVec2(200, 200));
+  StatefulCanvas::draw_idx_t inner = canvas.line(ImVec2(0, 0), ImVec2(150, 150), Red);
+  canvas.popClipRect();
+  StatefulCanvas::draw_idx_t outer = canvas.line(ImVec2(0, 10), ImVec2(150, 10), Green);
+  canvas.popClipRect();
+  StatefulCanvas::draw_idx_t unclipped = canvas.line(ImVec2(0, 20), ImVec2(150, 20), Blue);
+  canvas.pushClipRect(ImVec2(50, 50), ImVec2(100, 100)); // inner's intersection again
+  StatefulCanvas::draw_idx_t again = canvas.line(ImVec2(0, 30), ImVec2(150, 30), Red);
+  canvas.popClipRect();
+
+  const StatefulCanvas::Line *line = canvas.item<StatefulCanvas::Line>(inner);
+  CHECK(line->clip && (line->clipRect.x == 50) && (line->clipRect.y == 50) && (line->clipRect.z == 100) && (line->clipRect.w == 100));
+  CHECK(canvas.item<StatefulCanvas::Line>(outer)->clip && (canvas.item<StatefulCanvas::Line>(outer)->clipRect.z == 100));
+  CHECK(!canvas.item<StatefulCanvas::Line>(unclipped)->clip);
+  CHECK(canvas.item<StatefulCanvas::Line>(again)->clipRectIdx == line->clipRectIdx); // interned once
+  CHECK(canvas.item<StatefulCanvas::Line>(outer)->clipRectIdx != line->clipRectIdx);
+
+  Frame(canvas);
+  CHECK(canvas.stateChanges() == 4); // inner, outer, canvas clip rect, inner -- sorting doesn't change what z order would need
+  CHECK(canvas.drawCmds() == (sortByState ? 3 : 4));
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+static void TestWarmDraw(bool cacheGeometry, bool spatialIndex, bool sortByState) { // user-019
+  StatefulCanvas canvas(0, 0, Width, Height);
+  canvas.cacheGeometry(cacheGeometry);
+  canvas.spatialIndex(spatialIndex, 32.0f);
+  canvas.sortByState(sortByState);
+  canvas.batchByType(sortByState);
+  ImVec2 points[] = {ImVec2(300, 300), ImVec2(340, 320), ImVec2(380, 300), ImVec2(420, 340)};
+
+  for (int i = 0; i < 200; ++i) {
+    float x = (float)(i % 20) * 30,
+          y = (float)(i / 20) * 40;
+    canvas.pushZ(i % 3);
+    canvas.rectFilled(ImVec2(x, y), ImVec2(x + 20, y + 20), Red);
+    canvas.line(ImVec2(x, y), ImVec2(x + 20, y + 30), Green, 2.0f);
+    canvas.circle(ImVec2(x + 10, y + 10), 8.0f, Blue);
+    canvas.text(ImVec2(x, y + 24), Red, "text");
+    canvas.popZ();
+  }
+
+  StatefulCanvas::group_idx_t group = canvas.newGroup();
+  canvas.pushGroup(group);
+  canvas.polyline(points, IM_ARRAYSIZE(points), Green, false, 3.0f);
+  canvas.rectFilled(ImVec2(300, 360), ImVec2(340, 400), Blue);
+  canvas.popGroup();
+
+  for (int i = 0; i < 3; ++i)
+    Frame(canvas);
+
+  for (int i = 0; i < 3; ++i) {
+    Frame(canvas);
+    CHECK(DrawAllocations == 0);
+  }
+
+  canvas.groupMove(group, 10, 0); // offsets only -- nothing is reindexed or rebuilt
+  Frame(canvas);
+  CHECK(DrawAllocations == 0);
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+static void TestCompact() { // user-025
+  StatefulCanvas canvas(0, 0, Width, Height);
+  const int      n        = 2000; // past autoCompact()'s minimum
+  ImVec2         points[] = {ImVec2(0, 0), ImVec2(10, 20), ImVec2(20, 0)};
+  ImVector<StatefulCanvas::draw_idx_t> handles;
+
+  for (int i = 0; i < n; ++i)
+    if (i % 3 == 0)
+      handles.push_back(canvas.text(ImVec2((float)i, 100), Red, (i % 2) ? "odd" : "even"));
+    else if (i % 3 == 1)
+      handles.push_back(canvas.polyline(points, IM_ARRAYSIZE(points), Green, false));
+    else
+      handles.push_back(canvas.rectFilled(ImVec2((float)i, 10), ImVec2((float)i + 4, 14), Blue));
+
+  StatefulCanvas::draw_idx_t stream = canvas.streamingPolyline(16, Blue);
+  canvas.item<StatefulCanvas::StreamingPolyline>(stream)->append(points, IM_ARRAYSIZE(points));
+
+  for (int i = 1; i < n; i += 2) // leaves holes throughout every pool
+    canvas.erase(handles[i]);
+
+  const ImVec2 *pointsData = canvas.item<StatefulCanvas::Polyline>(handles[4])->points.Data;
+  canvas.compact();
+
+  bool valid  = true,
+       intact = true;
+
+  for (int i = 0; i < n; ++i) {
+    valid = valid && (canvas.valid(handles[i]) == (i % 2 == 0));
+
+    if (i % 2)
+      continue;
+
+    if (i % 3 == 0) {
+      const StatefulCanvas::Text *text = canvas.item<StatefulCanvas::Text>(handles[i]);
+      intact = intact && (strcmp(text->text(), "even") == 0) && (text->p.x == i);
+    }
+    else if (i % 3 == 1)
+      intact = intact && (canvas.item<StatefulCanvas::Polyline>(handles[i])->points.size() == 3);
+    else {
+      const StatefulCanvas::RectFilled *rect = canvas.item<StatefulCanvas::RectFilled>(handles[i]);
+      intact = intact && (rect->p0.x == i) && (rect->color == Blue);
+    }
+  }
+
+  CHECK(valid);
+  CHECK(intact);
+  CHECK(canvas.item<StatefulCanvas::Polyline>(handles[4])->points.Data == pointsData); // moved, not copied
+  const StatefulCanvas::StreamingPolyline *streaming = canvas.item<StatefulCanvas::StreamingPolyline>(stream);
+  CHECK((streaming->buffer == streaming->ring.Data) && (streaming->count == 3) && (streaming->sample(2).x == 20));
+  CHECK(canvas.memoryUsage().live[StatefulCanvas::PrimitiveType_Text] == 334);
+  CHECK(canvas.memoryUsage().freeSlots == n / 2); // slots stay put, as handles index them
+  StatefulCanvas::draw_idx_t polyline = canvas.polyline(points, IM_ARRAYSIZE(points), Green, false); // fills a hole
+  CHECK(canvas.memoryUsage().freeSlots == n / 2 - 1);
+
+  canvas.autoCompact(0.1f);
+  const StatefulCanvas::RectFilled *rect = canvas.item<StatefulCanvas::RectFilled>(handles[8]);
+
+  for (int i = 6; i < n; i += 6) // texts other than the first
+    canvas.queueErase(handles[i]);
+
+  Frame(canvas); // applies the erases, but doesn't compact
+  size_t textBytes = canvas.memoryUsage().primitives[StatefulCanvas::PrimitiveType_Text];
+  CHECK(!canvas.valid(handles[6]));
+  CHECK(canvas.item<StatefulCanvas::RectFilled>(handles[8]) == rect);
+  canvas.erase(handles[2]); // compacts
+  CHECK(canvas.memoryUsage().primitives[StatefulCanvas::PrimitiveType_Text] < textBytes);
+  CHECK(canvas.memoryUsage().live[StatefulCanvas::PrimitiveType_Text] == 1);
+  CHECK(canvas.item<StatefulCanvas::RectFilled>(handles[8])->p0.x == 8);
+  CHECK(canvas.item<StatefulCanvas::Text>(handles[0]) && canvas.valid(polyline) && canvas.valid(stream));
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+static int QueueLines(StatefulCanvas *canvas, int n) { // handles returned -- the rest ran past the reserve
+  int handled = 0;
+
+  for (int i = 0; i < n; ++i)
+    handled += canvas->queueLine(ImVec2((float)i, 0), ImVec2((float)i, 10), Green) != StatefulCanvas::DRAW_IDX_NONE;
+
+  return handled;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+static void QueueChanges(StatefulCanvas *canvas, StatefulCanvas::draw_idx_t idx, int n) {
+  QueueLines(canvas, n);
+
+  for (int i = 0; i < n; ++i)
+    canvas->queueVisible(idx, i % 2);
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+static void QueueLinesThread(StatefulCanvas *canvas, int n, int *handled) {
+  *handled = QueueLines(canvas, n);
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+static void TestQueue() { // user-016
+  StatefulCanvas canvas(0, 0, Width, Height);
+  const int      n = 500;
+
+  CHECK(QueueLines(&canvas, 64) == 64); // a fresh canvas reserves handles for queued adds
+  Frame(canvas);
+  canvas.queueReserve(n);
+  CHECK(QueueLines(&canvas, n) == n);
+  Frame(canvas);
+  CHECK(canvas.memoryUsage().live[StatefulCanvas::PrimitiveType_Line] == 64 + n);
+#ifdef NDEBUG // asserted otherwise
+  CHECK(QueueLines(&canvas, 2 * n) == n); // ran past the reserve
+  Frame(canvas);
+  CHECK(canvas.memoryUsage().live[StatefulCanvas::PrimitiveType_Line] == 64 + 3 * n); // added all the same
+  CHECK(QueueLines(&canvas, 2 * n) == 2 * n); // window grew past the adds that ran out
+  Frame(canvas);
+#endif
+  canvas.clear();
+  CHECK(QueueLines(&canvas, n) == n); // clear() reserves a fresh window
+  Frame(canvas);
+  CHECK(canvas.memoryUsage().live[StatefulCanvas::PrimitiveType_Line] == n);
+
+  int         handled = 0;
+  std::thread producer(QueueLinesThread, &canvas, n, &handled);
+  producer.join();
+  Frame(canvas);
+  CHECK(handled == n);
+  CHECK(canvas.memoryUsage().live[StatefulCanvas::PrimitiveType_Line] == 2 * n);
+
+  StatefulCanvas::draw_idx_t line = canvas.line(ImVec2(0, 0), ImVec2(10, 10), Red);
+  QueueChanges(&canvas, line, n);
+  Frame(canvas); // nodes back in this thread's pool
+  long long allocations = Allocations();
+  QueueChanges(&canvas, line, n);
+  canvas.queueErase(line);
+  CHECK(Allocations() == allocations); // commands come from the warmed pool
+  Frame(canvas);
+  CHECK(!canvas.valid(line) && (canvas.memoryUsage().live[StatefulCanvas::PrimitiveType_Line] == 4 * n));
+
+  {
+    StatefulCanvas undrawn(0, 0, Width, Height);
+    undrawn.queueText(ImVec2(0, 0), Green, "queued");
+    QueueChanges(&undrawn, undrawn.line(ImVec2(0, 0), ImVec2(10, 10), Red), 8);
+  } // destroyed with commands it never applied
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+struct Dot : StatefulCanvas::Primitive { // client primitive -- custom(), or pooled once registered
+  Dot(const ImVec2 &p, ImU32 color) : p(p), color(color) { }
+  virtual void draw(ImDrawList *drawList, const ImVec2 &loc) override { drawList->AddRectFilled(loc + p, loc + p + ImVec2(2, 2), color); }
+  virtual void moveTo(float x, float y) override { p += ImVec2(x, y); }
+  virtual bool bounds(ImRect *rect) const override { *rect = ImRect(p, p + ImVec2(2, 2)); return true; }
+
+  ImVec2 p;
+  ImU32  color;
+};
+
+struct Tick : Dot { // a second registered type, saved like a dot
+  Tick(const ImVec2 &p, ImU32 color) : Dot(p, color) { }
+};
+
+static const ImU32 CustomDotId = 7, // SaveCustomFunc's typeId for custom() dots
+                   DotTypeId   = 8, // registerPrimitiveType()'s
+                   TickTypeId  = 9;
+
+static bool SaveDot(const StatefulCanvas::Primitive *primitive, ImU32 *typeId, ImVector<unsigned char> *data, void *) {
+  const Dot *dot = static_cast<const Dot *>(primitive); // only dots and ticks are custom or registered here
+  *typeId        = *typeId ? *typeId : CustomDotId; // registered types come with theirs
+  data->resize(sizeof(dot->p) + sizeof(dot->color));
+  memcpy(data->Data, &dot->p, sizeof(dot->p));
+  memcpy(data->Data + sizeof(dot->p), &dot->color, sizeof(dot->color));
+  return true;
+}
+
+static StatefulCanvas::Primitive *LoadDot(ImU32 typeId, const unsigned char *data, int size, void *) {
+  ImVec2 p;
+  ImU32  color;
+
+  if (size < (int)(sizeof(p) + sizeof(color)))
+    return nullptr;
+
+  memcpy(&p, data, sizeof(p));
+  memcpy(&color, data + sizeof(p), sizeof(color));
+
+  switch (typeId) {
+    case CustomDotId:
+    case DotTypeId:   return new Dot(p, color);
+    case TickTypeId:  return new Tick(p, color);
+    default:          return nullptr;
+  }
+}
+
+static bool Patch(const char *path, ImS32 from, ImS32 to) { // first aligned from past the snapshot header becomes to
+  FILE          *file = fopen(path, "r+b");
+  unsigned char bytes[4096];
+  size_t        size  = file ? fread(bytes, 1, sizeof(bytes), file) : 0;
+  bool          found = false;
+
+  for (size_t at = 80; !found && (at + sizeof(from) <= size); at += sizeof(from)) {
+    found = memcmp(bytes + at, &from, sizeof(from)) == 0;
+
+    if (found)
+      found = (fseek(file, (long)at, SEEK_SET) == 0) && (fwrite(&to, sizeof(to), 1, file) == 1);
+  }
+
+  return file && (fclose(file) == 0) && found;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+static void TestSnapshot() { // user-020
+  static const char *Path = "stateful_canvas_tests.snapshot";
+  StatefulCanvas     canvas(0, 0, Width, Height);
+  ImVec2             points[] = {ImVec2(0, 0), ImVec2(10, 20), ImVec2(20, 0)};
+  StatefulCanvas::PrimitiveType dotType  = canvas.registerPrimitiveType<Dot>(DotTypeId),
+                                tickType = canvas.registerPrimitiveType<Tick>(TickTypeId);
+  canvas.snapshotCustom(SaveDot, LoadDot);
+  canvas.line(ImVec2(0, 0), ImVec2(10, 10), Red);
+  canvas.text(ImVec2(5, 5), Green, "saved");
+  canvas.pushZ(2);
+  canvas.polyline(points, IM_ARRAYSIZE(points), Blue, true);
+  canvas.custom(new Dot(ImVec2(30, 30), Red));
+  canvas.emplace<Dot>(ImVec2(40, 40), Green);
+  canvas.emplace<Tick>(ImVec2(50, 50), Blue);
+  canvas.popZ();
+  CHECK(canvas.save(Path));
+
+  StatefulCanvas               loaded(0, 0, Width, Height);
+  StatefulCanvas::DrawIdxRange range;
+  loaded.registerPrimitiveType<Tick>(TickTypeId); // registration order doesn't matter -- records carry typeIds
+  loaded.registerPrimitiveType<Dot>(DotTypeId);
+  loaded.snapshotCustom(SaveDot, LoadDot);
+  bool ok = loaded.load(Path, &range);
+  remove(Path);
+  CHECK(ok && (range.count == 6));
+
+  if (!ok || (range.count != 6))
+    return;
+
+  const StatefulCanvas::Text     *text     = loaded.item<StatefulCanvas::Text>(range[1]);
+  const StatefulCanvas::Polyline *polyline = loaded.item<StatefulCanvas::Polyline>(range[2]);
+  const Dot                      *custom   = loaded.item<Dot>(range[3]),
+                                 *pooled   = loaded.item<Dot>(range[4]);
+  const Tick                     *tick     = loaded.item<Tick>(range[5]);
+  CHECK(loaded.item<StatefulCanvas::Line>(range[0])->color == Red);
+  CHECK((strcmp(text->text(), "saved") == 0) && (text->color == Green));
+  CHECK((polyline->points.size() == 3) && (polyline->points[1].y == 20) && polyline->closed && (polyline->z == 2));
+  CHECK((custom->type == StatefulCanvas::PrimitiveType_Custom) && (custom->p.x == 30) && (custom->color == Red));
+  CHECK((pooled->type == dotType) && (pooled->p.x == 40) && (pooled->color == Green)); // back in its pool, not custom
+  CHECK((tick->type == tickType) && (tick->p.x == 50) && (tick->color == Blue));
+  CHECK((loaded.memoryUsage().live[dotType] == 1) && (loaded.memoryUsage().live[tickType] == 1));
+
+  StatefulCanvas dotsOnly(0, 0, Width, Height); // records of types not registered under their typeId are skipped
+  dotsOnly.registerPrimitiveType<Dot>(DotTypeId);
+  dotsOnly.snapshotCustom(SaveDot, LoadDot);
+  CHECK(canvas.save(Path) && dotsOnly.load(Path, &range) && (range.count == 6));
+  remove(Path);
+  CHECK(dotsOnly.valid(range[4]) && !dotsOnly.valid(range[5]) && (dotsOnly.memoryUsage().live[tickType] == 0));
+
+  StatefulCanvas unhooked(0, 0, Width, Height); // custom and registered records are skipped without hooks
+  CHECK(canvas.save(Path) && unhooked.load(Path, &range) && (range.count == 6));
+  remove(Path);
+  CHECK(unhooked.valid(range[2]) && !unhooked.valid(range[3]) && !unhooked.valid(range[4]) && !unhooked.valid(range[5]));
+
+  StatefulCanvas streams(0, 0, Width, Height); // a corrupt ring capacity fails the load rather than allocating it
+  ImVec2         samples[] = {ImVec2(1, 2), ImVec2(3, 4)};
+  StatefulCanvas::draw_idx_t stream = streams.streamingPolyline(4099, Red);
+  streams.streamAppend(stream, samples, IM_ARRAYSIZE(samples));
+  CHECK(streams.save(Path) && loaded.load(Path, &range) && (loaded.item<StatefulCanvas::StreamingPolyline>(range[0])->capacity == 4099));
+  CHECK(Patch(Path, 4099, INT_MAX) && !loaded.load(Path) && (loaded.memoryUsage().live[StatefulCanvas::PrimitiveType_StreamingPolyline] == 0));
+  remove(Path);
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+static bool BulkAdds(StatefulCanvas *canvas) { // each bulk add's range indexes exactly what it added
+  static const char *const Strings[] = {"a", "bb", "ccc", "dddd", "eeeee"};
+  const int                n         = IM_ARRAYSIZE(Strings);
+  ImVec2                   p0s[n],
+                           p1s[n];
+  float                    radii[n];
+  ImU32                    colors[n];
+
+  for (int i = 0; i < n; ++i) {
+    p0s[i]    = ImVec2((float)i * 10, (float)i);
+    p1s[i]    = p0s[i] + ImVec2(5, 5);
+    radii[i]  = (float)i + 1;
+    colors[i] = IM_COL32(i, 0, 0, 255);
+  }
+
+  StatefulCanvas::DrawIdxRange lines   = canvas->lines(p0s, p1s, colors, n),
+                               rects   = canvas->rectsFilled(p0s, p1s, colors, n),
+                               circles = canvas->circles(p0s, radii, colors, n),
+                               texts   = canvas->texts(p0s, colors, Strings, n);
+  bool                         ok      = (lines.count == n) && (rects.count == n) && (circles.count == n) && (texts.count == n);
+
+  for (int i = 0; ok && (i < n); ++i) {
+    ok = canvas->valid(lines[i]) && canvas->valid(rects[i]) && canvas->valid(circles[i]) && canvas->valid(texts[i]);
+
+    if (!ok)
+      break;
+
+    const StatefulCanvas::Line       *line   = canvas->item<StatefulCanvas::Line>(lines[i]);
+    const StatefulCanvas::RectFilled *rect   = canvas->item<StatefulCanvas::RectFilled>(rects[i]);
+    const StatefulCanvas::Circle     *circle = canvas->item<StatefulCanvas::Circle>(circles[i]);
+    const StatefulCanvas::Text       *text   = canvas->item<StatefulCanvas::Text>(texts[i]);
+    ok = (line->type == StatefulCanvas::PrimitiveType_Line) && (line->p1.x == p1s[i].x) && (line->color == colors[i]) &&
+         (rect->type == StatefulCanvas::PrimitiveType_RectFilled) && (rect->p0.y == p0s[i].y) && (rect->color == colors[i]) &&
+         (circle->type == StatefulCanvas::PrimitiveType_Circle) && (circle->radius == radii[i]) && (circle->center.x == p0s[i].x) &&
+         (text->type == StatefulCanvas::PrimitiveType_Text) && (strcmp(text->text(), Strings[i]) == 0) && (text->p.x == p0s[i].x);
+  }
+
+  return ok;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+static void TestBulkRanges() { // user-008
+  static const char *Path = "stateful_canvas_tests.snapshot";
+  StatefulCanvas     canvas(0, 0, Width, Height);
+  CHECK(BulkAdds(&canvas));
+
+  ImVector<StatefulCanvas::draw_idx_t> handles;
+
+  for (int i = 0; i < 40; ++i)
+    handles.push_back(canvas.line(ImVec2((float)i, 0), ImVec2((float)i, 10), Green));
+
+  for (int i = 0; i < handles.size(); i += 2) // holes a range must not reuse
+    canvas.erase(handles[i]);
+
+  CHECK(BulkAdds(&canvas));
+  canvas.compact();
+  CHECK(BulkAdds(&canvas));
+  CHECK(canvas.valid(handles[1]) && !canvas.valid(handles[2]));
+  canvas.clear();
+  CHECK(BulkAdds(&canvas));
+
+  canvas.snapshotCustom(SaveDot, LoadDot);
+  canvas.custom(new Dot(ImVec2(5, 5), Red)); // skipped by a canvas without snapshot hooks
+  canvas.line(ImVec2(0, 0), ImVec2(10, 10), Blue);
+  CHECK(canvas.save(Path));
+
+  StatefulCanvas               loaded(0, 0, Width, Height);
+  StatefulCanvas::DrawIdxRange range;
+  bool                         ok = loaded.load(Path, &range);
+  remove(Path);
+  CHECK(ok && !loaded.valid(range[range.count - 2]) && loaded.valid(range[range.count - 1]));
+  CHECK(BulkAdds(&loaded));
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+static bool Same(const DrawOutput &a, const DrawOutput &b) { // byte for byte, commands field by field
+  if ((a.vertices.size() != b.vertices.size()) || (a.indices.size() != b.indices.size()) || (a.cmds.size() != b.cmds.size()))
+    return false;
+
+  if (memcmp(a.vertices.Data, b.vertices.Data, a.vertices.size_in_bytes()) || memcmp(a.indices.Data, b.indices.Data, a.indices.size_in_bytes()))
+    return false;
+
+  for (int i = 0; i < a.cmds.size(); ++i) {
+    const ImDrawCmd &ca = a.cmds[i],
+                    &cb = b.cmds[i];
+
+    if (memcmp(&ca.ClipRect, &cb.ClipRect, sizeof(ca.ClipRect)) || (ca.TextureId != cb.TextureId) || (ca.VtxOffset != cb.VtxOffset) ||
+        (ca.IdxOffset != cb.IdxOffset) || (ca.ElemCount != cb.ElemCount))
+      return false;
+  }
+
+  return true;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+static void TestParallelDraw() { // user-015
+  StatefulCanvas canvas(0, 0, Width, Height);
+  ImVec2         wave[200];
+
+  for (int i = 0; i < IM_ARRAYSIZE(wave); ++i)
+    wave[i] = ImVec2((float)i * 0.5f, (float)(i % 7) * 3.0f);
+
+  for (int i = 0; i < 3000; ++i) {
+    float x = (float)(i % 60) * 10,
+          y = (float)(i / 60) * 9;
+    ImU32 color = IM_COL32(i % 256, (i / 256) % 256, 128, 255);
+    canvas.pushZ(i % 4);
+
+    switch (i % 6) {
+      case 0: canvas.line(ImVec2(x, y), ImVec2(x + 8, y + 6), color, 1.5f); break;
+      case 1: canvas.circle(ImVec2(x + 4, y + 4), 4.0f, color, 0); break; // segments from the radius
+      case 2: canvas.text(ImVec2(x, y), color, (i % 12 < 6) ? "parallel" : "draw"); break;
+      case 3: {
+        StatefulCanvas::draw_idx_t idx = canvas.polyline(wave, IM_ARRAYSIZE(wave), color, false, 2.0f);
+        canvas.levelOfDetail(idx, (i % 12 < 6) ? StatefulCanvas::LevelOfDetail_Auto : StatefulCanvas::LevelOfDetail_Off);
+        break;
+      }
+      case 4: canvas.circleFilled(ImVec2(x + 4, y + 4), 3.0f, color, 10); break;
+      default:
+        canvas.pushClipRect(ImVec2(x, y), ImVec2(x + 5, y + 5));
+        canvas.rectFilled(ImVec2(x, y), ImVec2(x + 9, y + 8), color);
+        canvas.popClipRect();
+        break;
+    }
+
+    canvas.popZ();
+  }
+
+  DrawOutput serial,
+             parallel;
+  Frame(canvas, nullptr, nullptr, &serial);
+  canvas.parallelDraw(4);
+
+  for (int i = 0; i < 2; ++i) { // worker draw lists have no room yet, then get presized from the first frame's counts
+    Frame(canvas, nullptr, nullptr, &parallel);
+    CHECK(Same(serial, parallel));
+  }
+
+  for (int i = 0; i < 3; ++i) { // tessellated by the workers alone
+    Frame(canvas, nullptr, nullptr, &parallel);
+    CHECK(Same(serial, parallel));
+    CHECK(DrawAllocations == 0);
+  }
+
+  canvas.parallelDraw(1);
+  Frame(canvas, nullptr, nullptr, &parallel);
+  CHECK(Same(serial, parallel));
+}
+
+#ifdef STATEFUL_CANVAS_STATS
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+static int StatsVertices(const StatefulCanvas::Stats &stats) { // tessellated, summed over types
+  int vertices = 0;
+
+  for (int t = 0; t < StatefulCanvas::PrimitiveType_COUNT; ++t)
+    vertices += stats.types[t].vertices;
+
+  return vertices;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+static void TestStats() { // user-018
+  StatefulCanvas canvas(0, 0, Width, Height);
+  canvas.rectFilled(ImVec2(10, 10), ImVec2(20, 20), Red);
+  canvas.visible(canvas.rectFilled(ImVec2(30, 10), ImVec2(40, 20), Green), false);
+  canvas.pushClipRect(ImVec2(50, 10), ImVec2(55, 20));
+  canvas.rectFilled(ImVec2(50, 10), ImVec2(60, 20), Blue);
+  canvas.popClipRect();
+  canvas.pushZ(1);
+  canvas.line(ImVec2(0, 50), ImVec2(100, 50), Red);
+  canvas.circleFilled(ImVec2(50, 80), 10.0f, Green, 12);
+  canvas.rectFilled(ImVec2(5000, 10), ImVec2(5010, 20), Blue); // off canvas -- culled once indexed
+  canvas.popZ();
+  ImVector<ImDrawVert> vertices;
+
+  Frame(canvas, nullptr, &vertices);
+  const StatefulCanvas::Stats &stats = canvas.stats();
+  CHECK((stats.drawn == 5) && (stats.hidden == 1) && (stats.culled == 0) && (stats.visited == 6));
+  CHECK((stats.zLayers == 2) && (stats.layers.size() == 2) && (stats.layers[0].z == 0) && (stats.layers[0].drawn == 2) && (stats.layers[1].drawn == 3));
+  CHECK((stats.types[StatefulCanvas::PrimitiveType_RectFilled].drawn == 3) && (stats.types[StatefulCanvas::PrimitiveType_Line].drawn == 1));
+  CHECK(stats.types[StatefulCanvas::PrimitiveType_CircleFilled].drawn == 1);
+  CHECK(StatsVertices(stats) == vertices.size()); // every vertex emitted is counted against its type
+  CHECK(stats.clipPushes == 2); // the canvas's and the clipped rect's
+
+  canvas.spatialIndex(true, 64.0f);
+  Frame(canvas);
+  CHECK((stats.drawn == 4) && (stats.hidden == 1) && (stats.culled == 1) && (stats.visited == 6));
+
+  canvas.spatialIndex(false);
+  canvas.cacheGeometry(true);
+  Frame(canvas, nullptr, &vertices);
+  CHECK((stats.drawn == 5) && (stats.copiedVertices == vertices.size())); // built into the cache, then copied out
+  Frame(canvas);
+  CHECK((stats.drawn == 0) && (stats.copiedVertices == vertices.size())); // unchanged layers are copied, not drawn
+}
+#endif
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+static void TestPointKernels() { // user-023
+  ImVec2 in[10],
+         out[10];
+  bool   exact = true; // inputs and results are representable, so vector and scalar steps agree bit for bit
+
+  for (int n = 0; n < IM_ARRAYSIZE(in); ++n) { // every mix of AVX, SSE2 and scalar tail steps
+    for (int i = 0; i < IM_ARRAYSIZE(in); ++i) {
+      in[i]  = ImVec2((float)i - 3.5f, (float)(i * i) * 0.25f);
+      out[i] = ImVec2(-1, -1);
+    }
+
+    StatefulCanvas::transformPoints(out, in, n, 2.5f, ImVec2(3, -1));
+
+    for (int i = 0; i < IM_ARRAYSIZE(in); ++i)
+      exact &= (i < n) ? ((out[i].x == in[i].x * 2.5f + 3) && (out[i].y == in[i].y * 2.5f - 1)) : ((out[i].x == -1) && (out[i].y == -1));
+
+    StatefulCanvas::scalePoints(out, in, n, -0.5f);
+
+    for (int i = 0; i < n; ++i)
+      exact &= (out[i].x == in[i].x * -0.5f) && (out[i].y == in[i].y * -0.5f);
+
+    StatefulCanvas::translatePoints(out, out, n, ImVec2(0.25f, 8)); // in place
+
+    for (int i = 0; i < n; ++i)
+      exact &= (out[i].x == in[i].x * -0.5f + 0.25f) && (out[i].y == in[i].y * -0.5f + 8);
+
+    exact &= (n == IM_ARRAYSIZE(in)) || (out[n].x == -1); // and nothing past n
+  }
+
+  CHECK(exact);
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+static void AddMixed(StatefulCanvas *canvas, ImVector<StatefulCanvas::draw_idx_t> *handles) { // one of each kind of geometry, over three z layers
+  static const ImVec2 points[] = {ImVec2(10, 10), ImVec2(30, 25), ImVec2(50, 10), ImVec2(70, 30)};
+  canvas->registerPrimitiveType<Dot>();
+
+  for (int i = 0; i < 24; ++i) {
+    ImVec2 p((float)(i % 6) * 90, (float)(i / 6) * 80);
+    canvas->pushZ(i % 3);
+
+    switch (i % 8) {
+      case 0: handles->push_back(canvas->line(p, p + ImVec2(40, 30), Red, 2.0f)); break;
+      case 1: handles->push_back(canvas->rect(p, p + ImVec2(40, 30), Green)); break;
+      case 2: handles->push_back(canvas->circleFilled(p + ImVec2(20, 20), 15.0f, Blue, 12)); break;
+      case 3: handles->push_back(canvas->text(p, Red, "moved")); break;
+      case 4: {
+        ImVec2 moved[IM_ARRAYSIZE(points)];
+        StatefulCanvas::translatePoints(moved, points, IM_ARRAYSIZE(points), p);
+        handles->push_back(canvas->polyline(moved, IM_ARRAYSIZE(moved), Green, false, 1.5f));
+        break;
+      }
+      case 5: handles->push_back(canvas->triangleFilled(p, p + ImVec2(30, 5), p + ImVec2(10, 30), Blue)); break;
+      case 6: handles->push_back(canvas->emplace<Dot>(p, Red)); break;
+      default: handles->push_back(canvas->custom(new Dot(p, Green))); break;
+    }
+
+    canvas->popZ();
+  }
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+static void TestTranslate(bool cacheGeometry) { // user-023
+  StatefulCanvas                       moved(0, 0, Width, Height),
+                                       translated(0, 0, Width, Height);
+  ImVector<StatefulCanvas::draw_idx_t> movedHandles,
+                                       handles;
+  AddMixed(&moved, &movedHandles);
+  AddMixed(&translated, &handles);
+  moved.cacheGeometry(cacheGeometry);
+  moved.spatialIndex(true, 64.0f); // culls the same
+  translated.cacheGeometry(cacheGeometry);
+  translated.spatialIndex(true, 64.0f);
+  DrawOutput expected,
+             output;
+  Frame(moved);
+  Frame(translated); // cached before the move
+
+  for (int i = 0; i < movedHandles.size(); i += 2)
+    moved.moveTo(movedHandles[i], 7, -3);
+
+  ImVector<StatefulCanvas::draw_idx_t> even;
+
+  for (int i = 0; i < handles.size(); i += 2)
+    even.push_back(handles[i]);
+
+  translated.translate(even.Data, even.size(), 7, -3);
+  Frame(moved, nullptr, nullptr, &expected);
+  Frame(translated, nullptr, nullptr, &output);
+  CHECK(Same(expected, output));
+  CHECK(translated.pick(ImVec2(27, 12)) == handles[0]); // line from (0, 0) now starts at (7, -3)
+
+  for (int i = 0; i < movedHandles.size(); ++i)
+    moved.moveTo(movedHandles[i], -20, 11);
+
+  translated.translateAll(-20, 11);
+  Frame(moved, nullptr, nullptr, &expected);
+  Frame(translated, nullptr, nullptr, &output);
+  CHECK(Same(expected, output));
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+static bool SamePoints(const ImVector<ImVec2> &points, const ImVec2 *expected, int n) {
+  return (points.size() == n) && ((n == 0) || !memcmp(points.Data, expected, n * sizeof(ImVec2)));
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+static void TestSetPoints(bool spatialIndex) { // user-024
+  StatefulCanvas canvas(0, 0, Width, Height);
+  canvas.spatialIndex(spatialIndex, 32.0f);
+  const ImVec2 square[] = { ImVec2(10, 10), ImVec2(50, 10), ImVec2(50, 50), ImVec2(10, 50) },
+               moved[]  = { ImVec2(210, 10), ImVec2(250, 10), ImVec2(250, 50), ImVec2(210, 50) },
+               wide[]   = { ImVec2(10, 100), ImVec2(90, 100), ImVec2(100, 140), ImVec2(50, 180), ImVec2(0, 140) };
+  StatefulCanvas::draw_idx_t        poly = canvas.convexPolyFilled(square, IM_ARRAYSIZE(square), Red);
+  StatefulCanvas::ConvexPolyFilled *item = canvas.item<StatefulCanvas::ConvexPolyFilled>(poly);
+  item->points.reserve(8);
+  const ImVec2 *storage = item->points.Data;
+
+  Frame(canvas);
+  canvas.setPoints(poly, moved, IM_ARRAYSIZE(moved));
+  CHECK((item->points.Data == storage) && SamePoints(item->points, moved, IM_ARRAYSIZE(moved)));
+  CHECK((canvas.pick(ImVec2(30, 30)) == StatefulCanvas::DRAW_IDX_NONE) && (canvas.pick(ImVec2(230, 30)) == poly)); // bounds follow the points
+  canvas.setPoints(poly, wide, IM_ARRAYSIZE(wide));
+  CHECK((item->points.Data == storage) && SamePoints(item->points, wide, IM_ARRAYSIZE(wide))); // grown within capacity
+  canvas.setPoints(poly, square, 3);
+  CHECK((item->points.Data == storage) && SamePoints(item->points, square, 3));
+  Frame(canvas);
+
+  ImVector<ImVec2> next;
+  next.resize(IM_ARRAYSIZE(moved));
+  memcpy(next.Data, moved, sizeof(moved));
+  const ImVec2 *nextStorage = next.Data;
+  canvas.setPoints(poly, std::move(next));
+  CHECK((item->points.Data == nextStorage) && SamePoints(item->points, moved, IM_ARRAYSIZE(moved)));
+  CHECK((next.Data == storage) && SamePoints(next, square, 3)); // the previous points come back to refill
+  CHECK(canvas.pick(ImVec2(230, 30)) == poly);
+  Frame(canvas);
+}
+
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+int main() {
+  StatefulCanvas::countAllocations();
+  ImGui::CreateContext();
+  ImGuiIO &io = ImGui::GetIO();
+  io.DisplaySize  = ImVec2(Width, Height);
+  io.DeltaTime    = 1.0f / 60.0f;
+  io.IniFilename  = nullptr;
+  io.BackendFlags |= ImGuiBackendFlags_RendererHasVtxOffset;
+
+  unsigned char *pixels;
+  int           width, height;
+  io.Fonts->GetTexDataAsRGBA32(&pixels, &width, &height); // builds font atlas -- no texture is uploaded
+
+  TestZOrder(false);
+  TestZOrder(true);
+  TestPick(false);
+  TestPick(true);
+  TestView(false);
+  TestView(true);
+  TestLevelOfDetail();
+  TestStaleHandles();
+  TestIngestBudget();
+  TestCachedLayers();
+
+  for (int mode = 0; mode < 4; ++mode)
+    TestGroupMove(mode & 1, mode & 2);
+
+  TestStringArena();
+  TestClipRects(false);
+  TestClipRects(true);
+
+  for (int mode = 0; mode < 8; ++mode)
+    TestWarmDraw(mode & 1, mode & 2, mode & 4);
+
+  TestCompact();
+  TestQueue();
+  TestSnapshot();
+  TestBulkRanges();
+  TestParallelDraw();
+#ifdef STATEFUL_CANVAS_STATS
+  TestStats();
+#endif
+  TestPointKernels();
+  TestTranslate(false);
+  TestTranslate(true);
+  TestSetPoints(false);
+  TestSetPoints(true);
+
+  ImGui::DestroyContext();
+  printf("%d checks, %d failed\n", Checks, Failures);
+  return Failures ? 1 : 0;
+}